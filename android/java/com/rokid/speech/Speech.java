@@ -216,5 +216,7 @@ public class Speech extends GenericConfig {
 		// 当前语音的额外参数
 		//   噪声阈值
 		public String voice_extra;
+		// 请求时限(毫秒)，0不限时
+		public int deadline;
 	}
 }
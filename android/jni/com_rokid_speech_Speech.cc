@@ -34,6 +34,7 @@ enum VoiceOptionsFieldAlias {
 	OPTS_VOICE_POWER,
 	OPTS_SKILL_OPTIONS,
 	OPTS_VOICE_EXTRA,
+	OPTS_DEADLINE,
 
 	OPTS_FIELD_NUM
 };
@@ -166,6 +167,8 @@ static void com_rokid_speech_Speech__sdk_init(JNIEnv *env,
 			options_cls, "skill_options", "Ljava/lang/String;");
 	constants_.voice_options_fields[OPTS_VOICE_EXTRA] = env->GetFieldID(
 			options_cls, "voice_extra", "Ljava/lang/String;");
+	constants_.voice_options_fields[OPTS_DEADLINE] = env->GetFieldID(
+			options_cls, "deadline", "I");
 	constants_.voice_options_class = (jclass)env->NewGlobalRef(options_cls);
 }
 
@@ -243,6 +246,8 @@ static void jobj_to_voice_options(JNIEnv* env, jobject obj, VoiceOptions& opts)
 		opts.voice_extra = str;
 		env->ReleaseStringUTFChars(sv, str);
 	}
+
+	opts.deadline = env->GetIntField(obj, constants_.voice_options_fields[OPTS_DEADLINE]);
 }
 
 static jint com_rokid_speech_Speech__sdk_put_text(JNIEnv *env, jobject thiz, jlong speechl, jstring str, jobject opts) {
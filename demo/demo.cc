@@ -10,6 +10,7 @@
 #include "speech_release_test.h"
 #include "speech_base_test.h"
 #include "speech_auto_close_test.h"
+#include "speech_replay_test.h"
 #include "clargs.h"
 #include "defs.h"
 #ifdef HAS_OPUS_CODEC
@@ -278,7 +279,7 @@ static void print_cmdline_prompt(const char* progname) {
     "\n"
     "OPTIONS:\n"
     "-t,--test=TESTCASE\n"
-    "\tTESTCASE: stress|speech-release|speech-base\n"
+    "\tTESTCASE: stress|speech-release|speech-base|auto-close|voice-replay\n"
     "-p,--pcm=FILE\n"
     "--wav=FILE\n"
     "\n"
@@ -305,7 +306,9 @@ static bool check_demo_options_valid(const DemoOptions& opts) {
 		return false;
 	if (opts.testcase == 4 && opts.pcm == nullptr && opts.wav == nullptr)
 		return false;
-	if (opts.testcase > 4)
+	if (opts.testcase == 5 && opts.pcm == nullptr && opts.wav == nullptr)
+		return false;
+	if (opts.testcase > 5)
 		return false;
 	return true;
 }
@@ -330,6 +333,8 @@ static bool create_demo_options(clargs_h handle, DemoOptions& opts) {
           opts.testcase = 3;
         } else if (strcmp(value, "auto-close") == 0) {
           opts.testcase = 4;
+        } else if (strcmp(value, "voice-replay") == 0) {
+          opts.testcase = 5;
         }
       }
     } else if (strcmp(key, "p") == 0 || strcmp(key, "pcm") == 0) {
@@ -385,6 +390,9 @@ int main(int argc, char** argv) {
     case 4:
       SpeechAutoCloseTest::test(opts, demo_options);
       break;
+    case 5:
+      SpeechReplayTest::test(opts, demo_options);
+      break;
   }
 
   clargs_destroy(h);
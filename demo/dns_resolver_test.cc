@@ -0,0 +1,117 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <thread>
+#include "dns_resolver.h"
+#include "connect_addr.h"
+#include "alt_chrono.h"
+
+using namespace rokid::speech;
+using std::string;
+using std::vector;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		++failures; \
+	} \
+} while (0)
+
+// first address getaddrinfo returns for 'host', empty if failed
+static string lookup(const char* host) {
+	struct addrinfo hints;
+	struct addrinfo* res;
+	char buf[INET6_ADDRSTRLEN];
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, "443", &hints, &res))
+		return string();
+	if (res->ai_family == AF_INET)
+		inet_ntop(AF_INET, &((struct sockaddr_in*)res->ai_addr)->sin_addr,
+				buf, sizeof(buf));
+	else
+		inet_ntop(AF_INET6, &((struct sockaddr_in6*)res->ai_addr)->sin6_addr,
+				buf, sizeof(buf));
+	freeaddrinfo(res);
+	return string(buf);
+}
+
+static void test_resolver() {
+	DnsResolver r;
+	string addr;
+	int cbs = 0;
+	vector<string> addrs;
+
+	// never block, no address before first resolution
+	SteadyClock::time_point tp = SteadyClock::now();
+	r.start("localhost", 443, 1, vector<string>(), [&cbs]() { ++cbs; });
+	CHECK(duration_cast<microseconds>(SteadyClock::now() - tp).count() < 50000);
+	usleep(500000);
+	CHECK(r.get_address(addr));
+	CHECK(cbs == 1);
+	printf("localhost resolved to %s in %u ms\n", addr.c_str(),
+			r.last_resolve_ms());
+	r.get_addresses(addrs);
+	CHECK(!addrs.empty() && addrs[0] == addr);
+	r.stop();
+
+	DnsResolver s;
+	vector<string> static_addrs;
+	static_addrs.push_back("10.0.0.1");
+	static_addrs.push_back("[fe80::1]");
+	s.start("no.such.host.invalid", 443, 0, static_addrs, NULL);
+	CHECK(s.get_address(addr) && addr == "10.0.0.1");
+	s.mark_failure(addr);
+	CHECK(s.get_address(addr) && addr == "[fe80::1]");
+	s.stop();
+
+	CHECK(DnsResolver::is_ip_literal("1.2.3.4"));
+	CHECK(DnsResolver::is_ip_literal("[::1]"));
+	CHECK(DnsResolver::is_ip_literal("::1"));
+	CHECK(!DnsResolver::is_ip_literal("apigwws.open.rokid.com"));
+}
+
+static void test_connect_addr() {
+	const char* host = "speech.host.invalid";
+
+	CHECK(ConnectAddrScope::available());
+	CHECK(lookup(host).empty());
+	{
+		// resolved without dns query
+		SteadyClock::time_point tp = SteadyClock::now();
+		ConnectAddrScope scope(host, "10.1.2.3");
+		CHECK(lookup(host) == "10.1.2.3");
+		CHECK(duration_cast<microseconds>(SteadyClock::now() - tp).count()
+				< 10000);
+		// other hosts not affected
+		CHECK(lookup("127.0.0.1") == "127.0.0.1");
+		{
+			ConnectAddrScope inner(host, "[fe80::2]");
+			CHECK(lookup(host) == "fe80::2");
+		}
+		CHECK(lookup(host) == "10.1.2.3");
+		// other threads not affected
+		string other = "-";
+		std::thread th([&other, host]() { other = lookup(host); });
+		th.join();
+		CHECK(other.empty());
+	}
+	CHECK(lookup(host).empty());
+}
+
+int main(int argc, char** argv) {
+	test_resolver();
+	test_connect_addr();
+	printf("dns resolver test: %s, %d failures\n",
+			failures ? "FAILED" : "passed", failures);
+	return failures ? 1 : 0;
+}
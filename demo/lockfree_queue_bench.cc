@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+#include "lockfree_queue.h"
+#include "alt_chrono.h"
+
+// N producers, one consumer waiting with timeout (as SpeechConnection::recv)
+// mutex + condition_variable fifo vs MpmcQueue + EventCount
+
+using namespace rokid::speech;
+using std::mutex;
+using std::unique_lock;
+using std::lock_guard;
+using std::vector;
+using std::thread;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+#define ITEMS_PER_PRODUCER 200000
+#define QUEUE_SIZE 1024
+#define WAIT_TIMEOUT 1000
+
+// producer index in high 8 bits, sequence in low 24 bits
+static inline uint32_t make_item(uint32_t producer, uint32_t seq) {
+	return (producer << 24) | seq;
+}
+
+class LockedFifo {
+public:
+	bool push(uint32_t v) {
+		lock_guard<mutex> locker(mutex_);
+		if (items_.size() >= QUEUE_SIZE)
+			return false;
+		items_.push_back(v);
+		cond_.notify_one();
+		return true;
+	}
+
+	bool pop(uint32_t& v, uint32_t timeout) {
+		unique_lock<mutex> locker(mutex_);
+		if (items_.empty())
+			cond_.wait_for(locker, std::chrono::milliseconds(timeout));
+		if (items_.empty())
+			return false;
+		v = items_.front();
+		items_.pop_front();
+		return true;
+	}
+
+private:
+	mutex mutex_;
+	std::condition_variable cond_;
+	std::deque<uint32_t> items_;
+};
+
+class LockFreeFifo {
+public:
+	LockFreeFifo() : queue_(QUEUE_SIZE) {
+	}
+
+	bool push(uint32_t v) {
+		if (!queue_.try_push(v))
+			return false;
+		event_.notify();
+		return true;
+	}
+
+	bool pop(uint32_t& v, uint32_t timeout) {
+		uint32_t key;
+		while (!queue_.try_pop(v)) {
+			key = event_.prepare_wait();
+			if (queue_.try_pop(v)) {
+				event_.cancel_wait(key);
+				return true;
+			}
+			if (!event_.wait_for(key, timeout))
+				return queue_.try_pop(v);
+		}
+		return true;
+	}
+
+private:
+	MpmcQueue<uint32_t> queue_;
+	EventCount event_;
+};
+
+// return microseconds, 0 if items lost or out of order
+template <typename Q>
+static int64_t run(uint32_t producers) {
+	Q q;
+	vector<thread> threads;
+	vector<uint32_t> next(producers, 0);
+	uint32_t total = producers * ITEMS_PER_PRODUCER;
+	uint32_t got = 0;
+	bool ok = true;
+	SteadyClock::time_point tp = SteadyClock::now();
+
+	thread consumer([&]() {
+		uint32_t v;
+		while (got < total) {
+			if (!q.pop(v, WAIT_TIMEOUT)) {
+				printf("consumer timeout, %u items received\n", got);
+				ok = false;
+				return;
+			}
+			uint32_t p = v >> 24;
+			if (p >= producers || (v & 0xffffff) != next[p]) {
+				ok = false;
+				return;
+			}
+			++next[p];
+			++got;
+		}
+	});
+	for (uint32_t i = 0; i < producers; ++i) {
+		threads.push_back(thread([&q, i]() {
+			for (uint32_t j = 0; j < ITEMS_PER_PRODUCER; ++j) {
+				while (!q.push(make_item(i, j)))
+					std::this_thread::yield();
+			}
+		}));
+	}
+	for (size_t i = 0; i < threads.size(); ++i)
+		threads[i].join();
+	consumer.join();
+	if (!ok)
+		return 0;
+	return duration_cast<microseconds>(SteadyClock::now() - tp).count();
+}
+
+int main(int argc, char** argv) {
+	static const uint32_t producers[] = { 1, 2, 4, 8, 16 };
+	int failures = 0;
+
+	printf("%u items per producer, one consumer\n", ITEMS_PER_PRODUCER);
+	printf("producers   mutex(ms)  lockfree(ms)  speedup\n");
+	for (size_t i = 0; i < sizeof(producers) / sizeof(producers[0]); ++i) {
+		int64_t a = run<LockedFifo>(producers[i]);
+		int64_t b = run<LockFreeFifo>(producers[i]);
+		if (a == 0 || b == 0) {
+			printf("%9u   items lost or out of order\n", producers[i]);
+			++failures;
+			continue;
+		}
+		printf("%9u   %9.1f  %12.1f  %6.2fx\n", producers[i], a / 1000.0,
+				b / 1000.0, (double)a / b);
+	}
+	return failures ? 1 : 0;
+}
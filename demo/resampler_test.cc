@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+#include "resampler.h"
+#include "voice_frontend.h"
+#include "alt_chrono.h"
+
+// Resampler accuracy (output length, passband gain, stopband rejection,
+// chunking), VoiceFrontend format conversion, and throughput
+
+using namespace rokid::speech;
+using std::vector;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+#define AMPLITUDE 10000.0
+// passband gain error, stopband attenuation required
+#define MAX_PASSBAND_DB 0.5
+#define MIN_STOPBAND_DB 80.0
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		++failures; \
+	} \
+} while (0)
+
+static void make_tone(uint32_t rate, double freq, vector<float>& out) {
+	for (uint32_t i = 0; i < out.size(); ++i)
+		out[i] = AMPLITUDE * sin(2 * M_PI * freq * i / rate);
+}
+
+// resample 'in' to 16k, 'chunk' input samples per process
+static void resample(uint32_t rate, const vector<float>& in, uint32_t chunk,
+		vector<float>& out) {
+	Resampler rs;
+	vector<float> buf;
+	uint32_t c;
+	uint32_t n;
+
+	CHECK(rs.init(rate, VOICE_SAMPLE_RATE));
+	out.clear();
+	for (uint32_t off = 0; off < in.size(); off += c) {
+		c = std::min(chunk, (uint32_t)in.size() - off);
+		buf.resize(rs.max_output(c));
+		n = rs.process(in.data() + off, c, buf.data());
+		CHECK(n <= buf.size());
+		out.insert(out.end(), buf.begin(), buf.begin() + n);
+	}
+}
+
+// gain in dB of second half of 'out', filter settled
+static double gain_db(const vector<float>& out) {
+	double e = 0;
+	uint32_t start = out.size() / 2;
+	for (uint32_t i = start; i < out.size(); ++i)
+		e += (double)out[i] * out[i];
+	e /= out.size() - start;
+	return 10 * log10(e / (AMPLITUDE * AMPLITUDE / 2));
+}
+
+static void test_tone(uint32_t rate, double freq, uint32_t chunk) {
+	vector<float> in(rate);
+	vector<float> out;
+	vector<float> whole;
+	double db;
+	float diff = 0;
+
+	make_tone(rate, freq, in);
+	resample(rate, in, chunk, out);
+	db = gain_db(out);
+	printf("%5u Hz -> 16k, tone %5.0f Hz, chunk %4u: %6zu samples, %7.2f dB\n",
+			rate, freq, chunk, out.size(), db);
+	// one second in, about one second out
+	CHECK(out.size() + 64 >= VOICE_SAMPLE_RATE
+			&& out.size() <= VOICE_SAMPLE_RATE);
+	if (freq < VOICE_SAMPLE_RATE / 2 * 0.4)
+		CHECK(fabs(db) < MAX_PASSBAND_DB);
+	else if (freq > VOICE_SAMPLE_RATE / 2)
+		CHECK(db < -MIN_STOPBAND_DB);
+	// output independent of input chunking
+	resample(rate, in, in.size(), whole);
+	CHECK(whole.size() == out.size());
+	for (uint32_t i = 0; i < std::min(whole.size(), out.size()); ++i)
+		diff = std::max(diff, fabsf(whole[i] - out[i]));
+	CHECK(diff < 0.01f);
+}
+
+static void test_resampler() {
+	static const uint32_t rates[] = { 48000, 44100, 32000, 22050, 8000 };
+	vector<float> in(1000, 1.0f);
+	vector<float> out(1000);
+	Resampler rs;
+
+	for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); ++i) {
+		test_tone(rates[i], 1000, 480);
+		test_tone(rates[i], 3000, 441);
+		if (rates[i] / 2 > 9000)
+			test_tone(rates[i], 9000, 1000);
+	}
+	CHECK(rs.init(16000, 16000) && rs.passthrough());
+	CHECK(!rs.init(0, 16000));
+	// history cleared by reset
+	CHECK(rs.init(48000, 16000));
+	rs.process(in.data(), in.size(), out.data());
+	rs.reset();
+	std::fill(in.begin(), in.end(), 0.0f);
+	uint32_t n = rs.process(in.data(), in.size(), out.data());
+	for (uint32_t i = 0; i < n; ++i)
+		CHECK(out[i] == 0.0f);
+}
+
+static void test_frontend() {
+	VoiceFrontend fe;
+	uint32_t samples;
+	const int16_t* out;
+	int bad = 0;
+
+	// int32 4 channels, only channel 1 mixed
+	// input split at odd sizes, partial frames kept
+	vector<int32_t> s32(4 * 1000);
+	vector<int16_t> r;
+	static const uint32_t chunks[] = { 7, 100, 3, 1001, 16 };
+	CHECK(fe.init(16000, SampleFormat::S32, 4, 0x2));
+	for (int i = 0; i < 1000; ++i)
+		for (int c = 0; c < 4; ++c)
+			s32[i * 4 + c] = c == 1 ? (i - 500) * 65536 * 10 : 12345678;
+	const uint8_t* p = (const uint8_t*)s32.data();
+	uint32_t len = s32.size() * 4;
+	for (uint32_t off = 0, i = 0; off < len; ++i) {
+		uint32_t c = std::min(chunks[i % 5], len - off);
+		out = fe.process(p + off, c, samples);
+		r.insert(r.end(), out, out + samples);
+		off += c;
+	}
+	CHECK(r.size() == 1000);
+	for (int i = 0; i < (int)r.size(); ++i) {
+		int e = std::max(-32768, std::min(32767, (i - 500) * 10));
+		if (r[i] != e)
+			++bad;
+	}
+	CHECK(bad == 0);
+
+	// int16 stereo, unaligned input, channels averaged
+	VoiceFrontend st;
+	vector<uint8_t> raw(1 + 4 * 100);
+	int16_t frame[2];
+	CHECK(st.init(16000, SampleFormat::S16, 2, 0));
+	for (int i = 0; i < 100; ++i) {
+		frame[0] = i * 2;
+		frame[1] = i * 4;
+		memcpy(&raw[1 + i * 4], frame, sizeof(frame));
+	}
+	out = st.process(raw.data() + 1, 400, samples);
+	CHECK(samples == 100);
+	for (bad = 0; bad < (int)samples && out[bad] == bad * 3; ++bad);
+	CHECK(bad == (int)samples);
+
+	// float 8 channels 48k
+	VoiceFrontend fl;
+	vector<float> f32(8 * 48000);
+	double e = 0;
+	CHECK(fl.init(48000, SampleFormat::F32, 8, 0));
+	for (int i = 0; i < 48000; ++i)
+		for (int c = 0; c < 8; ++c)
+			f32[i * 8 + c] = 0.3f * sin(2 * M_PI * 1000 * i / 48000.0);
+	out = fl.process((const uint8_t*)f32.data(), f32.size() * 4, samples);
+	for (uint32_t i = samples / 2; i < samples; ++i)
+		e += (double)out[i] * out[i];
+	e = sqrt(e / (samples - samples / 2));
+	printf("f32 8ch 48k: %u samples, rms %.1f, expect %.1f\n", samples, e,
+			0.3 * 32768 / sqrt(2));
+	CHECK(fabs(e / (0.3 * 32768 / sqrt(2)) - 1) < 0.01);
+}
+
+// cpu time of one second audio, 10ms chunks as put_voice
+static void bench(uint32_t rate) {
+	Resampler rs;
+	uint32_t chunk = rate / 100;
+	vector<float> in(rate);
+	vector<float> out(rs.max_output(chunk) + VOICE_SAMPLE_RATE);
+	uint32_t seconds = 100;
+
+	make_tone(rate, 1000, in);
+	rs.init(rate, VOICE_SAMPLE_RATE);
+	out.resize(rs.max_output(chunk));
+	SteadyClock::time_point tp = SteadyClock::now();
+	for (uint32_t i = 0; i < seconds; ++i) {
+		for (uint32_t off = 0; off < rate; off += chunk)
+			rs.process(in.data() + off, chunk, out.data());
+	}
+	int64_t us = duration_cast<microseconds>(SteadyClock::now() - tp).count();
+	printf("%5u Hz -> 16k: %.3f ms per second of audio\n", rate,
+			us / 1000.0 / seconds);
+}
+
+int main(int argc, char** argv) {
+	test_resampler();
+	test_frontend();
+	bench(48000);
+	bench(44100);
+	bench(8000);
+	printf("resampler test: %s, %d failures\n",
+			failures ? "FAILED" : "passed", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include "speech.h"
+
+// mutex acquisitions per voice frame
+// pthread_mutex_lock/trylock interposed by this executable, std::mutex of
+// libspeech and of its dependencies are all counted while enabled
+//   caller: locks taken by the thread invoking put_voice
+//   total: locks taken by all threads (sdk work/loop threads included)
+// mutex reacquired inside pthread_cond_wait is not counted
+//
+// usage: speech-lock-bench [host [port]]
+
+using namespace rokid::speech;
+using std::shared_ptr;
+using std::mutex;
+using std::unique_lock;
+using std::thread;
+
+#define VOICES 10
+#define FRAMES_PER_VOICE 100
+// 20ms of 16k 16bit pcm
+#define FRAME_SIZE 640
+
+typedef int (*MutexFunc)(pthread_mutex_t*);
+
+static std::atomic<bool> counting(false);
+static std::atomic<uint64_t> total_locks(0);
+static thread_local uint64_t thread_locks = 0;
+
+static MutexFunc next_func(const char* name) {
+	MutexFunc f = (MutexFunc)dlsym(RTLD_NEXT, name);
+	if (f == NULL) {
+		fprintf(stderr, "%s not found\n", name);
+		abort();
+	}
+	return f;
+}
+
+static inline void count_lock() {
+	if (counting.load(std::memory_order_relaxed)) {
+		++thread_locks;
+		total_locks.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+extern "C" int pthread_mutex_lock(pthread_mutex_t* m) {
+	static MutexFunc func = next_func("pthread_mutex_lock");
+	count_lock();
+	return func(m);
+}
+
+extern "C" int pthread_mutex_trylock(pthread_mutex_t* m) {
+	static MutexFunc func = next_func("pthread_mutex_trylock");
+	count_lock();
+	return func(m);
+}
+
+class Results {
+public:
+	void poll_routine(shared_ptr<Speech> speech) {
+		SpeechResult r;
+		while (speech->poll(r)) {
+			if (r.type == SPEECH_RES_END || r.type == SPEECH_RES_ERROR
+					|| r.type == SPEECH_RES_CANCELLED) {
+				unique_lock<mutex> locker(mutex_);
+				if (r.type != SPEECH_RES_END)
+					++errors_;
+				++finished_;
+				cond_.notify_one();
+			}
+		}
+	}
+
+	// false if timeout
+	bool wait(uint32_t count) {
+		unique_lock<mutex> locker(mutex_);
+		return cond_.wait_for(locker, std::chrono::seconds(30),
+				[this, count]() { return finished_ >= count; });
+	}
+
+	uint32_t errors() {
+		unique_lock<mutex> locker(mutex_);
+		return errors_;
+	}
+
+private:
+	mutex mutex_;
+	std::condition_variable cond_;
+	uint32_t finished_ = 0;
+	uint32_t errors_ = 0;
+};
+
+// put frames back to back (interval 0), or paced as real time capture
+static bool run(shared_ptr<Speech>& speech, Results& results,
+		uint32_t& finished, uint32_t interval_us) {
+	uint8_t frame[FRAME_SIZE] = { 0 };
+	uint64_t caller = 0;
+	uint64_t total;
+	uint32_t frames = VOICES * FRAMES_PER_VOICE;
+
+	total_locks = 0;
+	for (uint32_t i = 0; i < VOICES; ++i) {
+		thread_locks = 0;
+		counting = true;
+		int32_t id = speech->start_voice();
+		for (uint32_t j = 0; j < FRAMES_PER_VOICE; ++j) {
+			speech->put_voice(id, frame, sizeof(frame));
+			if (interval_us)
+				usleep(interval_us);
+		}
+		speech->end_voice(id);
+		caller += thread_locks;
+		if (!results.wait(++finished)) {
+			counting = false;
+			printf("voice %d not finished\n", id);
+			return false;
+		}
+		counting = false;
+	}
+	total = total_locks;
+	printf("%-12s %6u frames  caller %6.2f  total %6.2f locks/frame\n",
+			interval_us ? "paced" : "back to back", frames,
+			(double)caller / frames, (double)total / frames);
+	return true;
+}
+
+int main(int argc, char** argv) {
+	PrepareOptions opts;
+	opts.host = "apigwws.open.rokid.com";
+	opts.port = 443;
+	opts.branch = "/api";
+	opts.key = "6DDECE40ED024837AC9BDC4039DC3245";
+	opts.device_type_id = "B16B2DFB5A004DCBAFD0C0291C211CE1";
+	opts.device_id = "ming.demo";
+	opts.secret = "F2A1FDC667A042F3A44E516282C3E1D7";
+	if (argc > 1)
+		opts.host = argv[1];
+	if (argc > 2)
+		opts.port = atoi(argv[2]);
+
+	shared_ptr<Speech> speech = Speech::new_instance();
+	shared_ptr<SpeechOptions> sopts = SpeechOptions::new_instance();
+	Results results;
+	uint32_t finished = 0;
+	bool ok;
+
+	speech->prepare(opts);
+	sopts->set_codec(Codec::PCM);
+	sopts->set_vad_mode(VadMode::LOCAL);
+	speech->config(sopts);
+	thread poll_thread([&results, speech]() { results.poll_routine(speech); });
+
+	// connect and warm up buffer pools, not counted
+	int32_t id = speech->start_voice();
+	speech->end_voice(id);
+	ok = results.wait(++finished);
+	ok = ok && run(speech, results, finished, 0);
+	ok = ok && run(speech, results, finished, 20000);
+	if (ok && results.errors())
+		printf("%u voices failed\n", results.errors());
+
+	speech->release();
+	poll_thread.join();
+	return ok && results.errors() == 0 ? 0 : 1;
+}
@@ -0,0 +1,112 @@
+#include <unistd.h>
+#include <thread>
+#include "speech_replay_test.h"
+#include "rlog.h"
+
+using namespace rokid::speech;
+using namespace std;
+
+#define TAG "SpeechReplayTest"
+#define VOICES 3
+// 80ms of 16k 16bit pcm
+#define FRAME_SIZE 2560
+// reconnect after at most 1 second of voice sent,
+// within default replay bytes (set_voice_replay)
+#define RECONN_FRAME 12
+#define RESULT_TIMEOUT 30
+
+void SpeechReplayTest::run(const PrepareOptions& opt, const uint8_t* data, uint32_t size) {
+  shared_ptr<Speech> speech = Speech::new_instance();
+  shared_ptr<SpeechOptions> sopts = SpeechOptions::new_instance();
+  uint32_t frames = size / FRAME_SIZE;
+  uint32_t reconn_frame = frames / 2;
+  uint32_t passed = 0;
+  SpeechStats before;
+  SpeechStats after;
+  SpeechResultType type;
+  int32_t id;
+
+  if (frames < 2) {
+    KLOGE(TAG, "voice data too short, %u bytes", size);
+    return;
+  }
+  if (reconn_frame > RECONN_FRAME)
+    reconn_frame = RECONN_FRAME;
+  speech->prepare(opt);
+  sopts->set_vad_mode(VadMode::LOCAL);
+  speech->config(sopts);
+
+  thread poll_thread(
+      [this, &speech]() {
+        this->poll_routine(speech);
+      });
+
+  for (uint32_t i = 0; i < VOICES; ++i) {
+    speech->get_stats(before);
+    id = speech->start_voice();
+    for (uint32_t f = 0; f < frames; ++f) {
+      if (f == reconn_frame) {
+        KLOGI(TAG, "voice %d: reconnect after %u frames", id, f);
+        speech->reconn();
+      }
+      speech->put_voice(id, data + f * FRAME_SIZE, FRAME_SIZE);
+      usleep(80 * 1000);
+    }
+    speech->end_voice(id);
+    type = wait_result(id);
+    speech->get_stats(after);
+    if (type == SPEECH_RES_END
+        && after.replayed_voices > before.replayed_voices) {
+      ++passed;
+      KLOGI(TAG, "voice %d replayed %u ms after connection broken",
+          id, after.last_replay_ms);
+    } else {
+      KLOGE(TAG, "voice %d: result type %d, err %d, replayed %u, "
+          "replay failed %u", id, type, err_,
+          after.replayed_voices - before.replayed_voices,
+          after.failed_voice_replays - before.failed_voice_replays);
+    }
+  }
+  KLOGI(TAG, "voice replay test: %u/%u passed", passed, VOICES);
+
+  speech->release();
+  poll_thread.join();
+}
+
+SpeechResultType SpeechReplayTest::wait_result(int32_t id) {
+  unique_lock<mutex> locker(mutex_);
+  if (!cond_.wait_for(locker, chrono::seconds(RESULT_TIMEOUT),
+        [this, id]() { return finished_id_ == id; })) {
+    err_ = SPEECH_TIMEOUT;
+    return SPEECH_RES_ERROR;
+  }
+  return finished_type_;
+}
+
+void SpeechReplayTest::poll_routine(shared_ptr<Speech>& speech) {
+  SpeechResult result;
+
+  while (true) {
+    if (!speech->poll(result))
+      break;
+    switch (result.type) {
+      case SPEECH_RES_END:
+      case SPEECH_RES_CANCELLED:
+      case SPEECH_RES_ERROR: {
+        lock_guard<mutex> locker(mutex_);
+        finished_id_ = result.id;
+        finished_type_ = result.type;
+        err_ = result.err;
+        cond_.notify_one();
+        break;
+      }
+      default:
+        break;
+    }
+  }
+}
+
+void SpeechReplayTest::test(const PrepareOptions& opts, const DemoOptions& dopts) {
+  SpeechReplayTest test;
+  test.do_test(opts, dopts);
+}
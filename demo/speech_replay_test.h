@@ -0,0 +1,28 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include "speech.h"
+#include "defs.h"
+#include "speech_base_test.h"
+
+// reconnect in the middle of each voice request
+// voice replayed on new connection, request not fail
+class SpeechReplayTest : public SpeechBaseTest {
+public:
+  static void test(const rokid::speech::PrepareOptions& opts, const DemoOptions& dopts);
+
+  void run(const rokid::speech::PrepareOptions& opt, const uint8_t* data, uint32_t size);
+
+private:
+  void poll_routine(std::shared_ptr<rokid::speech::Speech>& speech);
+
+  // wait voice 'id' finished, return result type
+  rokid::speech::SpeechResultType wait_result(int32_t id);
+
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  int32_t finished_id_ = 0;
+  rokid::speech::SpeechResultType finished_type_ = rokid::speech::SPEECH_RES_END;
+  int32_t err_ = 0;
+};
@@ -0,0 +1,124 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include "pending_queue.h"
+#include "alt_chrono.h"
+
+// StreamQueue as used by SpeechImpl: voice frames queued per request,
+// requests overlap, part of them cancelled
+// checks pop order of every session, prints time per queue operation
+
+using namespace rokid::speech;
+using std::string;
+using std::shared_ptr;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+typedef StreamQueue<string, int> Queue;
+
+#define SESSIONS 20000
+#define FRAMES_PER_SESSION 50
+// 20ms of 16k 16bit pcm
+#define FRAME_SIZE 640
+// requests started before the current one is popped
+#define OVERLAP 4
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		++failures; \
+	} \
+} while (0)
+
+// pop all available, check tags and data count of each stream
+// id multiple of 4 erased, popped as REMOVED
+static uint32_t drain(Queue& q, uint32_t& ops) {
+	shared_ptr<string> data;
+	int32_t id;
+	int32_t cur = 0;
+	uint32_t err;
+	uint32_t frames = 0;
+	uint32_t ends = 0;
+	int32_t r;
+
+	while ((r = q.pop(id, data, err)) != Queue::POP_TYPE_EMPTY) {
+		++ops;
+		switch (r) {
+		case Queue::POP_TYPE_START:
+			CHECK(cur == 0);
+			cur = id;
+			frames = 0;
+			break;
+		case Queue::POP_TYPE_DATA:
+			CHECK(id == cur && data->size() == FRAME_SIZE);
+			++frames;
+			break;
+		case Queue::POP_TYPE_END:
+			CHECK(id == cur && frames == FRAMES_PER_SESSION);
+			cur = 0;
+			++ends;
+			break;
+		case Queue::POP_TYPE_REMOVED:
+			// erased before or after START popped
+			CHECK(cur == 0 || id == cur);
+			CHECK(id % 4 == 0);
+			cur = 0;
+			break;
+		default:
+			CHECK(false);
+			break;
+		}
+	}
+	return ends;
+}
+
+static int64_t run(uint32_t& ops) {
+	Queue q;
+	shared_ptr<string> frame = std::make_shared<string>(FRAME_SIZE, 'x');
+	int32_t next = 1;
+	uint32_t ends = 0;
+	int32_t id;
+
+	ops = 0;
+	SteadyClock::time_point tp = SteadyClock::now();
+	for (uint32_t s = 0; s < SESSIONS; s += OVERLAP) {
+		for (uint32_t i = 0; i < OVERLAP; ++i) {
+			CHECK(q.start(next + i));
+			++ops;
+		}
+		for (uint32_t k = 0; k < FRAMES_PER_SESSION; ++k) {
+			for (uint32_t i = 0; i < OVERLAP; ++i)
+				q.stream(next + i, frame);
+			ops += OVERLAP;
+		}
+		for (uint32_t i = 0; i < OVERLAP; ++i) {
+			id = next + i;
+			// one of four requests cancelled
+			if (id % 4 == 0)
+				q.erase(id);
+			else
+				q.end(id);
+			++ops;
+		}
+		ends += drain(q, ops);
+		next += OVERLAP;
+	}
+	int64_t us = duration_cast<microseconds>(SteadyClock::now() - tp).count();
+	CHECK(q.size() == 0);
+	CHECK(ends == SESSIONS / 4 * 3);
+	return us;
+}
+
+int main(int argc, char** argv) {
+	uint32_t ops;
+	int64_t us = run(ops);
+
+	printf("%u sessions, %u queue operations: %.1f ms, %.1f ns per operation\n",
+			SESSIONS, ops, us / 1000.0, us * 1000.0 / ops);
+	printf("stream queue bench: %s, %d failures\n",
+			failures ? "FAILED" : "passed", failures);
+	return failures ? 1 : 0;
+}
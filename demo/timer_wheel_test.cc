@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+#include <thread>
+#include "timer_wheel.h"
+
+// TimerWheel timing, cancellation and level cascading
+// usage: timer-wheel-test [long]
+//   long: also cascade from level 2 (timers of about 41 seconds)
+
+using namespace rokid::speech;
+using std::vector;
+using std::atomic;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+
+#define TIMERS 2000
+// allowed lateness, ms
+#define MAX_LATE 100
+
+static int failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		++failures; \
+	} \
+} while (0)
+
+static int64_t elapsed(SteadyClock::time_point tp) {
+	return duration_cast<milliseconds>(SteadyClock::now() - tp).count();
+}
+
+// 'delays' scheduled at once, every fifth cancelled
+static void test_timing(const vector<uint32_t>& delays, const char* name) {
+	TimerWheel* w = TimerWheel::instance();
+	uint32_t n = delays.size();
+	vector<atomic<int64_t> > fired(n);
+	vector<TimerWheel::TimerId> ids(n);
+	uint32_t max_delay = 0;
+	int64_t max_late = 0;
+	uint32_t early = 0;
+	uint32_t missed = 0;
+	uint32_t cancelled = 0;
+	SteadyClock::time_point tp = SteadyClock::now();
+
+	for (uint32_t i = 0; i < n; ++i) {
+		fired[i] = -1;
+		ids[i] = w->schedule(delays[i], [&fired, i, tp]() {
+			fired[i] = elapsed(tp);
+		});
+		CHECK(ids[i] != 0);
+		if (delays[i] > max_delay)
+			max_delay = delays[i];
+	}
+	for (uint32_t i = 0; i < n; i += 5) {
+		if (w->cancel(ids[i]))
+			++cancelled;
+	}
+	std::this_thread::sleep_for(milliseconds(max_delay + 2 * MAX_LATE));
+	for (uint32_t i = 0; i < n; ++i) {
+		if (i % 5 == 0) {
+			// fired before cancelled only if due at once
+			CHECK(fired[i] < 0 || delays[i] < TIMER_WHEEL_TICK);
+			continue;
+		}
+		if (fired[i] < 0) {
+			++missed;
+			continue;
+		}
+		if (fired[i] < delays[i])
+			++early;
+		else if (fired[i] - delays[i] > max_late)
+			max_late = fired[i] - delays[i];
+	}
+	printf("%s: %u timers up to %u ms, %u cancelled, "
+			"%u early, %u missed, max late %d ms\n", name, n, max_delay,
+			cancelled, early, missed, (int)max_late);
+	CHECK(early == 0);
+	CHECK(missed == 0);
+	CHECK(max_late <= MAX_LATE);
+	CHECK(w->size() == 0);
+}
+
+static void test_cancel() {
+	TimerWheel* w = TimerWheel::instance();
+	atomic<bool> entered(false);
+	atomic<bool> done(false);
+	atomic<int> self_cancel(-1);
+	TimerWheel::TimerId id;
+
+	// cancel waits running callback
+	id = w->schedule(0, [&entered, &done]() {
+		entered = true;
+		std::this_thread::sleep_for(milliseconds(200));
+		done = true;
+	});
+	while (!entered)
+		std::this_thread::sleep_for(milliseconds(1));
+	CHECK(!w->cancel(id));
+	CHECK(done);
+	// cancel of fired timer
+	CHECK(!w->cancel(id));
+	CHECK(!w->cancel(0));
+
+	// cancel itself in callback, not wait
+	static TimerWheel::TimerId self;
+	self = w->schedule(10, [w, &self_cancel]() {
+		self_cancel = w->cancel(self) ? 1 : 0;
+	});
+	std::this_thread::sleep_for(milliseconds(10 + MAX_LATE));
+	CHECK(self_cancel == 0);
+}
+
+int main(int argc, char** argv) {
+	vector<uint32_t> delays(TIMERS);
+
+	srand(1);
+	// level 0 (< 640ms) and cascade from level 1
+	for (uint32_t i = 0; i < TIMERS; ++i)
+		delays[i] = i % 7 ? rand() % 800 : rand() % 3000;
+	test_timing(delays, "level 0-1");
+	test_cancel();
+	if (argc > 1 && strcmp(argv[1], "long") == 0) {
+		// level 2 starts at 64 * 64 ticks
+		delays.resize(4);
+		delays[0] = 40950;
+		delays[1] = 41000;
+		delays[2] = 41010;
+		delays[3] = 41500;
+		test_timing(delays, "level 2");
+	}
+	printf("timer wheel test: %s, %d failures\n",
+			failures ? "FAILED" : "passed", failures);
+	return failures ? 1 : 0;
+}
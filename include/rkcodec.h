@@ -42,6 +42,24 @@ private:
 	uint16_t* _pcm_buffer;
 };
 
+// opus encoder parameters except sample rate, bitrate and duration
+typedef struct RKOpusEncoderParams {
+	// OPUS_APPLICATION_xxx
+	int application = OPUS_APPLICATION_VOIP;
+	int complexity = 8;
+	bool vbr = true;
+	bool fec = false;
+	// expected packet loss percentage, for fec
+	int packet_loss = 0;
+	bool dtx = false;
+
+	bool operator==(const struct RKOpusEncoderParams& o) const {
+		return application == o.application && complexity == o.complexity
+			&& vbr == o.vbr && fec == o.fec && packet_loss == o.packet_loss
+			&& dtx == o.dtx;
+	}
+} RKOpusEncoderParams;
+
 // speech  pcm -->  opus
 class RKOpusEncoder {
 public:
@@ -53,12 +71,29 @@ public:
 	//   sample_rate: pcm sample rate
 	//   duration: duration(ms) per opus frame
 	//   bitrate: opus bitrate
-	bool init(uint32_t sample_rate, uint32_t bitrate, uint32_t duration);
+	//   duration: 10, 20, 40, 60
+	bool init(uint32_t sample_rate, uint32_t bitrate, uint32_t duration,
+			const RKOpusEncoderParams& params = RKOpusEncoderParams());
 
 	uint32_t pcm_frame_size() const {
 		return _pcm_frame_size;
 	}
 
+	uint32_t duration() const {
+		return _duration;
+	}
+
+	const RKOpusEncoderParams& params() const {
+		return _params;
+	}
+
+	// change bitrate of initialized encoder, applied from next frame
+	bool set_bitrate(uint32_t bitrate);
+
+	uint32_t bitrate() const {
+		return _bitrate;
+	}
+
 	// param 'pcm': pcm data, in short
 	//       'size':  pcm data size, in short
 	//       'enc_size':  opus data size in bytes at this invocation of 'encode'
@@ -71,6 +106,9 @@ public:
 private:
 	// samples per pcm frame
 	uint32_t _pcm_frame_size;
+	uint32_t _bitrate;
+	uint32_t _duration;
+	RKOpusEncoderParams _params;
 	OpusEncoder* _opus_encoder;
 	uint8_t* _opus_buffer;
 	// a pcm frame array
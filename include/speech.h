@@ -26,6 +26,145 @@ enum SpeechError {
 	SPEECH_UNKNOWN,
 };
 
+// put_voice返回值
+enum PutVoiceResult {
+	PUT_VOICE_SUCCESS = 0,
+	// 超出缓存预算, 已丢弃更早的未发送语音以容纳本次数据
+	PUT_VOICE_DROPPED = 1,
+	// sdk未初始化, 或id无效(未start_voice, 已结束或已取消)
+	PUT_VOICE_INVALID = -1,
+	// 超出缓存预算, 本次数据被丢弃
+	PUT_VOICE_REJECTED = -2,
+};
+
+// 未发送语音超出缓存预算时的处理策略
+enum class VoiceDropPolicy {
+	// 丢弃最早的未发送语音
+	DROP_OLDEST,
+	// 拒绝新的语音数据
+	REJECT_NEW
+};
+
+// put_voice输入pcm采样格式
+enum class SampleFormat {
+	// 16bit整数
+	S16 = 0,
+	// 32bit整数
+	S32,
+	// 32bit浮点, 范围[-1.0, 1.0]
+	F32
+};
+
+enum class OpusApplication {
+	// 针对语音优化
+	VOIP = 0,
+	AUDIO,
+	// 算法延迟最低, 不做语音优化
+	RESTRICTED_LOWDELAY
+};
+
+// codec为PCM时sdk本地opus编码参数
+struct OpusProfile {
+	// 每帧时长(毫秒), 限定值10 20 40 60
+	// 帧越长每秒包数越少, 延迟越大
+	uint32_t frame_duration = 20;
+	OpusApplication application = OpusApplication::VOIP;
+	// 0 - 10, 越高音质越好, cpu占用越高
+	uint32_t complexity = 8;
+	bool vbr = true;
+	// 带内前向纠错, 'packet_loss'为预期丢包率(百分比)
+	// 数据经tcp传输, 通常无需开启
+	bool fec = false;
+	uint32_t packet_loss = 0;
+	// 静音时几乎不产生数据
+	bool dtx = false;
+};
+
+// 语音请求队列统计
+struct SpeechStats {
+	// 尚未发送的语音数据(字节, 帧数)
+	uint32_t queued_voice_bytes = 0;
+	uint32_t queued_voice_frames = 0;
+	// 尚未发送的语音数据峰值(字节)
+	uint32_t max_queued_voice_bytes = 0;
+	// 超出预算被丢弃的较早语音(帧数, 字节)
+	uint32_t dropped_voice_frames = 0;
+	uint32_t dropped_voice_bytes = 0;
+	// 超出预算被拒绝的新语音(帧数, 字节)
+	uint32_t rejected_voice_frames = 0;
+	uint32_t rejected_voice_bytes = 0;
+	// 网络发送积压时合并到前一请求发送的语音帧数
+	uint32_t coalesced_voice_frames = 0;
+	// 发送线程取出的语音帧数及批次, 同一批次只加锁一轮
+	uint32_t sent_voice_frames = 0;
+	uint32_t voice_send_batches = 0;
+	// 当前opus编码码率, 0: 未在本地编码
+	uint32_t voice_bitrate = 0;
+	// 结果尚未被poll取完的请求数, 及其峰值
+	uint32_t pending_ops = 0;
+	uint32_t max_pending_ops = 0;
+	// 超出set_max_pending_ops上限被丢弃结果的请求数
+	uint32_t dropped_ops = 0;
+	// 连接断开后在新连接上重发的语音请求数, 及重发失败的次数
+	uint32_t replayed_voices = 0;
+	uint32_t failed_voice_replays = 0;
+	// 最近一次重发, 发现连接断开到重发完成的时间(毫秒)
+	uint32_t last_replay_ms = 0;
+};
+
+// 语音请求的信号统计, sdk在put_voice时计算
+// 统计对象为送往服务端的16k单声道int16语音(codec为PCM时)
+struct VoiceSignalStats {
+	// 已统计的采样数
+	uint32_t samples = 0;
+	// 均方根值, 以int16满量程为1.0
+	float rms = 0.0f;
+	// 'rms' 以dBFS表示(满量程正弦波为0), 最小 -96
+	float rms_dbfs = -96.0f;
+	// 最大采样绝对值, 以int16满量程为1.0
+	float peak = 0.0f;
+	// 达到int16上下限的采样数(削波)
+	uint32_t clipped = 0;
+};
+
+// put_voice语音前处理单元
+// codec为PCM时, sdk将输入转换为16k单声道后按顺序调用各单元, 再编码发送
+// 采样以float表示, 范围与int16相同, 在sdk内部缓冲区原地处理
+// 只在put_voice调用线程调用
+class VoiceStage {
+public:
+	virtual ~VoiceStage() {}
+
+	// 统计数据中的名称
+	virtual const char* name() const = 0;
+
+	// 新的语音请求开始, 清除滤波器状态
+	virtual void reset() {}
+
+	// 原地处理'count'个采样
+	virtual void process(float* samples, uint32_t count) = 0;
+
+	// sdk内置单元(向量化实现)
+	// 去除直流分量, 'time_constant' 直流估计的时间常数(毫秒)
+	static std::shared_ptr<VoiceStage> new_dc_removal(
+			uint32_t time_constant = 100);
+	// 2阶巴特沃斯高通滤波, 'cutoff' 截止频率(Hz)
+	static std::shared_ptr<VoiceStage> new_high_pass(float cutoff = 80.0f);
+	// 固定增益(dB), 超出int16范围的采样在编码前饱和
+	static std::shared_ptr<VoiceStage> new_gain(float db);
+};
+
+// 语音前处理单元耗时统计
+struct VoiceStageStats {
+	std::string name;
+	// 调用次数, 处理的采样数
+	uint64_t calls = 0;
+	uint64_t samples = 0;
+	// 累计耗时, 单次最大耗时(微秒)
+	uint64_t total_us = 0;
+	uint32_t max_us = 0;
+};
+
 enum SpeechResultType {
 	SPEECH_RES_INTER = 0,
 	SPEECH_RES_START,
@@ -81,6 +220,53 @@ public:
 	// 默认值0xffffffff bytes
 	virtual void set_voice_fragment(uint32_t size) = 0;
 
+	// 语音识别过程中连接断开时, 保留已发送的语音数据(至多max_bytes字节)
+	// 在timeout毫秒内重连成功则以同一id重发语音, 不产生错误
+	// 任一值为0时禁用
+	// 默认值 max_bytes 131072, timeout 3000
+	virtual void set_voice_replay(uint32_t max_bytes, uint32_t timeout) = 0;
+
+	// 未发送语音数据的缓存预算(字节), 网络断开或拥塞时限制内存占用
+	// 'session_bytes' 单次语音请求, 'instance_bytes' 所有语音请求
+	// 0: 不限制
+	// 默认值 session_bytes 524288, instance_bytes 1048576, DROP_OLDEST
+	virtual void set_voice_budget(uint32_t session_bytes,
+			uint32_t instance_bytes,
+			VoiceDropPolicy policy = VoiceDropPolicy::DROP_OLDEST) = 0;
+
+	// codec为PCM时本地opus编码的码率范围(bps)
+	// 按上行吞吐量及往返时间在范围内自动调整, min == max时固定码率
+	// 默认值 min 12000, max 27800
+	virtual void set_opus_bitrate(uint32_t min, uint32_t max) = 0;
+
+	// codec为PCM时本地opus编码参数, 见OpusProfile
+	// 默认值 20ms帧, VOIP, complexity 8, vbr, 无fec, 无dtx
+	virtual void set_opus_profile(const OpusProfile& profile) = 0;
+
+	// codec为PCM时put_voice输入pcm的采样率(16bit单声道)
+	// 非16000时sdk重采样为16000
+	// 默认值 16000
+	virtual void set_input_sample_rate(uint32_t rate) = 0;
+
+	// codec为PCM时put_voice输入pcm的采样格式及声道数, 多声道交错排列
+	// 'channel_mask' bit n为1: 声道n参与混音(取平均), 0: 全部声道
+	// sdk转换为16bit单声道后编码
+	// 默认值 S16, 1, 0
+	virtual void set_input_format(SampleFormat format, uint32_t channels,
+			uint32_t channel_mask = 0) = 0;
+
+	// codec为PCM时put_voice语音前处理单元, 按顺序原地处理, 见VoiceStage
+	// 在opus编码前执行, 替代应用层逐级复制处理
+	// 默认值 空(不处理)
+	virtual void set_voice_stages(
+			const std::vector<std::shared_ptr<VoiceStage> >& stages) = 0;
+
+	// 结果尚未被poll取完的请求数上限
+	// 超出时丢弃最早的已结束请求的结果, 避免应用不调用poll时内存无限增长
+	// 0: 不限制
+	// 默认值 256
+	virtual void set_max_pending_ops(uint32_t max) = 0;
+
 	static std::shared_ptr<SpeechOptions> new_instance();
 };
 
@@ -101,6 +287,9 @@ public:
 	// extra data that will send to skill service
 	std::string skill_options;
 	std::string voice_extra;
+	// milliseconds since put_text/start_voice, 0: no deadline
+	// speech not finished in time ends with SPEECH_TIMEOUT error
+	uint32_t deadline;
 };
 
 class Speech {
@@ -115,7 +304,8 @@ public:
 
 	virtual int32_t start_voice(const VoiceOptions* options = NULL) = 0;
 
-	virtual void put_voice(int32_t id, const uint8_t* data, uint32_t length) = 0;
+	// return: PutVoiceResult
+	virtual int32_t put_voice(int32_t id, const uint8_t* data, uint32_t length) = 0;
 
 	virtual void end_voice(int32_t id) = 0;
 
@@ -134,6 +324,23 @@ public:
 	// 后台立即尝试重连网络服务
 	virtual void reconn() = 0;
 
+	virtual void get_connection_stats(ConnectionStats& stats) = 0;
+
+	virtual void get_stats(SpeechStats& stats) = 0;
+
+	// 获取语音请求'id'的信号统计, 可替代应用层计算voice_power
+	// 仅保留最近两个语音请求的统计
+	// return: false  'id'无统计数据
+	virtual bool get_voice_stats(int32_t id, VoiceSignalStats& stats) = 0;
+
+	// 获取各语音前处理单元的耗时统计, 顺序同set_voice_stages
+	virtual void get_voice_stage_stats(std::vector<VoiceStageStats>& stats) = 0;
+
+	// 提示sdk即将发起语音请求(如唤醒词一级触发时调用)
+	// 若连接已断开, 后台立即开始连接及认证, 不阻塞调用线程
+	// 若连接已就绪, 推迟连接空闲断开
+	virtual void prewarm() = 0;
+
 	static std::shared_ptr<Speech> new_instance();
 };
 
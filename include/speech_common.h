@@ -3,6 +3,7 @@
 #include <stdint.h>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace rokid {
 namespace speech {
@@ -22,12 +23,127 @@ public:
   std::string device_id;
 
   // milliseconds
+  // 断线重连最大等待时间, 实际等待时间按失败原因及连续失败次数指数退避并随机化
   uint32_t reconn_interval;
   uint32_t ping_interval;
   uint32_t no_resp_timeout;
 
   // seconds
   uint32_t conn_duration;
+
+  // false: 无语音数据超过conn_duration后断开连接, 下次请求时再重新连接
+  // true: 热备模式, prepare后立即建立连接,
+  //       无语音数据超过conn_duration后主动重建连接, 始终保持连接就绪
+  bool warm_standby;
+
+  // 缓存tls会话的文件路径, 进程重启后仍可恢复tls会话
+  // 为空则tls会话只缓存于内存
+  // 文件含会话密钥, 以0600权限创建, 应位于仅本应用可访问的目录
+  std::string tls_session_file;
+
+  // 域名解析结果缓存时间(秒), 过期前后台自动刷新, 连接时不再阻塞等待dns
+  // 0: 不解析域名, 只使用'host_addrs'; 'host_addrs'也为空则每次连接时解析
+  // 连接缓存的ip地址, websocket升级请求的Host头及tls SNI仍为'host'
+  // 默认300
+  uint32_t dns_ttl;
+
+  // 预先解析的'host'地址列表(ipv4或ipv6)
+  // dns解析尚无结果或解析失败时使用
+  std::vector<std::string> host_addrs;
+
+  // 备用服务端点, "host", "host:port"或"[ipv6]:port", 未指定port则使用'port'
+  // 与'host'一起参与连接竞速, 优先选择连接+认证耗时短的端点
+  std::vector<std::string> backup_endpoints;
+
+  // 连接竞速间隔(毫秒), 连接尚未就绪则每隔'race_delay'并行尝试下一个候选地址
+  // 0: 前一个地址连接失败后才尝试下一个
+  uint32_t race_delay;
+
+  // 已发送数据超过此时间(毫秒)未被服务端确认, 由内核断开tcp连接(TCP_USER_TIMEOUT)
+  // 0: 使用系统默认值
+  uint32_t tcp_user_timeout;
+
+  // 乐观认证: 连接建立中即接受请求, 紧随认证请求写入socket, 不等待认证结果
+  // 省去首个请求等待认证响应的一个往返时间
+  // 认证失败或其它连接竞速胜出时, 在最终就绪的连接上重发
+  // 默认false
+  bool optimistic_auth;
+};
+
+// 连接失败原因
+// 按严重程度排序, 一轮连接多个地址均失败时取最严重者
+enum class ConnectFailure {
+  NONE = 0,
+  // 已就绪的连接断开
+  LOST,
+  // 已就绪的连接服务端无响应
+  NO_RESPONSE,
+  // 域名尚未解析出地址
+  DNS,
+  // tcp连接失败
+  TCP,
+  // tls握手或websocket握手失败
+  TLS,
+  // 认证失败
+  AUTH
+};
+
+// 网络连接统计信息
+struct ConnectionStats {
+  // 发起连接次数
+  uint32_t connect_count = 0;
+  // 认证成功次数
+  uint32_t auth_count = 0;
+  // tls会话恢复(非完整握手)次数
+  uint32_t tls_resumed_count = 0;
+  // 最近一次连接, 发起连接到websocket连接建立耗时(tcp, tls, http upgrade)(毫秒)
+  // 未启用dns缓存时包括dns解析耗时
+  uint32_t last_connect_ms = 0;
+  // 最近一次后台dns解析耗时(毫秒)
+  uint32_t last_dns_ms = 0;
+  // 最近一次连接, tls握手耗时(毫秒)
+  uint32_t last_tls_handshake_ms = 0;
+  // 最近一次连接, 发送认证请求到认证成功耗时(毫秒)
+  uint32_t last_auth_ms = 0;
+  // 最近一次连接是否恢复了tls会话
+  bool last_tls_resumed = false;
+  // 并行尝试多个地址的连接次数
+  uint32_t race_count = 0;
+  // 最近一次连接的端点, 0: host, n: backup_endpoints[n - 1]
+  uint32_t last_endpoint = 0;
+  // 连接失败及断开次数
+  uint32_t failure_count = 0;
+  // 最近一次连接失败原因
+  ConnectFailure last_failure = ConnectFailure::NONE;
+  // 最近一次连接失败后, 等待重连的时间(毫秒)
+  uint32_t last_reconn_delay_ms = 0;
+  // ping/pong测得的平滑往返时间及其偏差(毫秒)
+  uint32_t srtt_ms = 0;
+  uint32_t rttvar_ms = 0;
+  // 会话进行中检测到连接失效(连续2次ping均pong超时)的次数
+  uint32_t dead_peer_count = 0;
+  // 最近一次连接, 发起连接到首个请求写入socket的时间(毫秒)
+  uint32_t last_first_req_ms = 0;
+  // 乐观认证模式下, 认证完成前写入的请求数
+  uint32_t early_req_count = 0;
+  // 乐观认证写入的请求因认证失败或其它连接胜出而重发的次数
+  uint32_t early_replay_count = 0;
+  // 网络线程被唤醒发送数据的次数, 及发送的数据帧数(含ping)
+  // 多个线程同时发送的数据帧合并为一次唤醒
+  uint32_t send_batch_count = 0;
+  uint32_t send_frame_count = 0;
+  // 网络线程唤醒总次数(定时器, 其它线程唤醒, 重连等待)
+  uint32_t wakeup_count = 0;
+  // 最近一分钟的唤醒次数
+  uint32_t wakeups_per_minute = 0;
+  // 已提交但尚未发送到网络的数据(字节): 待网络线程写入及socket发送缓冲区中的数据
+  uint32_t send_backlog_bytes = 0;
+  // 上述积压数据的峰值(字节)
+  uint32_t max_send_backlog_bytes = 0;
+  // 发送吞吐量(字节/秒, 平滑值), 链路未饱和时即实际发送速率
+  uint32_t send_throughput = 0;
+  // 当前连接ping/pong测得的最小往返时间(毫秒)
+  uint32_t min_rtt_ms = 0;
 };
 
 enum class Lang {
@@ -59,6 +59,42 @@ public:
 	static std::shared_ptr<TtsOptions> new_instance();
 };
 
+// tts语音数据接收端
+// 设置后, tts语音数据不再经由poll返回(TTS_RES_VOICE),
+// 而是在sdk网络接收线程中直接写入sink
+// write实现不可阻塞, 否则将阻塞网络数据接收
+class TtsVoiceSink {
+public:
+	virtual ~TtsVoiceSink() {}
+
+	// 'data' only valid during this invocation
+	virtual void write(int32_t id, const uint8_t* data, uint32_t length) = 0;
+};
+
+// sdk提供的无锁单生产者单消费者字节环形缓冲区
+// 生产者为sdk网络接收线程, 消费者为app播放线程
+// 缓冲区剩余空间不足时, 整块丢弃本次写入的数据并计入'dropped'
+// 已写入的数据不会被截断, 读出的字节流保持帧/采样对齐
+class TtsVoiceRing : public TtsVoiceSink {
+public:
+	virtual ~TtsVoiceRing() {}
+
+	// read at most 'size' bytes, never block
+	// return bytes read
+	virtual uint32_t read(uint8_t* buf, uint32_t size) = 0;
+
+	// bytes available for read
+	virtual uint32_t available() const = 0;
+
+	virtual uint32_t capacity() const = 0;
+
+	// total bytes of whole chunks dropped because ring full
+	virtual uint64_t dropped() const = 0;
+
+	// 'capacity' will be rounded up to power of 2
+	static std::shared_ptr<TtsVoiceRing> new_instance(uint32_t capacity);
+};
+
 class Tts {
 public:
 	virtual ~Tts() {}
@@ -83,9 +119,14 @@ public:
 
 	virtual void config(const std::shared_ptr<TtsOptions>& options) = 0;
 
+	// 设置tts语音数据接收端, 'sink'为空则恢复由poll返回语音数据
+	virtual void set_voice_sink(const std::shared_ptr<TtsVoiceSink>& sink) = 0;
+
 	// 后台立即尝试重连网络服务
 	virtual void reconn() = 0;
 
+	virtual void get_connection_stats(ConnectionStats& stats) = 0;
+
 	static std::shared_ptr<Tts> new_instance();
 };
 
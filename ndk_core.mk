@@ -12,14 +12,24 @@ LOCAL_C_INCLUDES := \
 COMMON_SRC := \
 	src/common/log_plugin.cc \
 	src/common/speech_connection.cc \
+	src/common/tls_session_cache.cc \
+	src/common/dns_resolver.cc \
+	src/common/connect_addr.cc \
+	src/common/endpoint_selector.cc \
+	src/common/reconn_policy.cc \
+	src/common/timer_wheel.cc \
 	src/common/nanopb_encoder.cc \
 	src/common/nanopb_decoder.cc
 
 TTS_SRC := \
-	src/tts/tts_impl.cc
+	src/tts/tts_impl.cc \
+	src/tts/tts_voice_ring.cc
 
 SPEECH_SRC := \
-	src/speech/speech_impl.cc
+	src/speech/speech_impl.cc \
+	src/speech/resampler.cc \
+	src/speech/voice_frontend.cc \
+	src/speech/voice_stage.cc
 
 PB_SRC := \
 	nanopb-gen/auth.pb.c \
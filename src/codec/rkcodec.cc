@@ -11,6 +11,16 @@ namespace rokid {
 namespace speech {
 
 static const uint32_t OPUS_BUFFER_SIZE = 16 * 1024;
+// encoded packet prefixed by one byte length
+static const uint32_t MAX_PACKET_SIZE = 255;
+
+// bytes available for next packet, 'used' bytes of buffer used
+static inline opus_int32 packet_space(uint32_t used) {
+	if (used + 1 >= OPUS_BUFFER_SIZE)
+		return 0;
+	uint32_t left = OPUS_BUFFER_SIZE - used - 1;
+	return left < MAX_PACKET_SIZE ? left : MAX_PACKET_SIZE;
+}
 
 RKOpusDecoder::RKOpusDecoder() : _opu_frame_size(0),
 		_pcm_frame_size(0), _opus_decoder(NULL), _pcm_buffer(NULL) {
@@ -73,8 +83,8 @@ void RKOpusDecoder::close() {
 }
 
 
-RKOpusEncoder::RKOpusEncoder() : _pcm_frame_size(0),
-	_opus_encoder(NULL), _opus_buffer(NULL) {
+RKOpusEncoder::RKOpusEncoder() : _pcm_frame_size(0), _bitrate(0),
+	_duration(0), _opus_encoder(NULL), _opus_buffer(NULL) {
 }
 
 RKOpusEncoder::~RKOpusEncoder() {
@@ -82,20 +92,33 @@ RKOpusEncoder::~RKOpusEncoder() {
 }
 
 bool RKOpusEncoder::init(uint32_t sample_rate, uint32_t bitrate,
-		uint32_t duration) {
+		uint32_t duration, const RKOpusEncoderParams& params) {
 	if (_opus_encoder) {
 		return true;
 	}
+	if (duration != 10 && duration != 20 && duration != 40 && duration != 60) {
+		KLOGW(ENC_TAG, "invalid frame duration %u", duration);
+		return false;
+	}
 	int err;
-	_opus_encoder = opus_encoder_create(sample_rate, 1, OPUS_APPLICATION_VOIP, &err);
+	_opus_encoder = opus_encoder_create(sample_rate, 1, params.application, &err);
 	if (err != OPUS_OK) {
 		KLOGW(ENC_TAG, "opus encoder create failed: %d\n", err);
+		_opus_encoder = NULL;
 		return false;
 	}
-	opus_encoder_ctl(_opus_encoder, OPUS_SET_VBR(1));
+	opus_encoder_ctl(_opus_encoder, OPUS_SET_VBR(params.vbr ? 1 : 0));
 	opus_encoder_ctl(_opus_encoder, OPUS_SET_BITRATE(bitrate));
-	opus_encoder_ctl(_opus_encoder, OPUS_SET_COMPLEXITY(8));
-	opus_encoder_ctl(_opus_encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+	_bitrate = bitrate;
+	opus_encoder_ctl(_opus_encoder, OPUS_SET_COMPLEXITY(params.complexity));
+	if (params.application != OPUS_APPLICATION_RESTRICTED_LOWDELAY)
+		opus_encoder_ctl(_opus_encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+	opus_encoder_ctl(_opus_encoder, OPUS_SET_INBAND_FEC(params.fec ? 1 : 0));
+	opus_encoder_ctl(_opus_encoder,
+			OPUS_SET_PACKET_LOSS_PERC(params.packet_loss));
+	opus_encoder_ctl(_opus_encoder, OPUS_SET_DTX(params.dtx ? 1 : 0));
+	_duration = duration;
+	_params = params;
 
 	_pcm_frame_size = sample_rate * duration / 1000;
 	_opus_buffer = (uint8_t*)mmap(NULL, OPUS_BUFFER_SIZE,
@@ -105,6 +128,18 @@ bool RKOpusEncoder::init(uint32_t sample_rate, uint32_t bitrate,
 	return true;
 }
 
+bool RKOpusEncoder::set_bitrate(uint32_t bitrate) {
+	if (_opus_encoder == NULL)
+		return false;
+	int err = opus_encoder_ctl(_opus_encoder, OPUS_SET_BITRATE(bitrate));
+	if (err != OPUS_OK) {
+		KLOGW(ENC_TAG, "set bitrate %u failed: %d", bitrate, err);
+		return false;
+	}
+	_bitrate = bitrate;
+	return true;
+}
+
 const uint8_t* RKOpusEncoder::encode(const uint16_t* pcm,
 		uint32_t size, uint32_t& enc_size) {
 	enc_size = 0;
@@ -131,7 +166,7 @@ const uint8_t* RKOpusEncoder::encode(const uint16_t* pcm,
 		c = opus_encode(_opus_encoder,
 				reinterpret_cast<opus_int16*>(a_pcm_frame),
 				_pcm_frame_size, _opus_buffer + enc_size + 1,
-				OPUS_BUFFER_SIZE - enc_size - 1);
+				packet_space(enc_size));
 		if (c < 0) {
 			KLOGW(ENC_TAG, "encode failed1: opu_encode error %d", c);
 			return NULL;
@@ -148,12 +183,12 @@ const uint8_t* RKOpusEncoder::encode(const uint16_t* pcm,
 			c = opus_encode(_opus_encoder,
 					reinterpret_cast<const opus_int16*>(pcm),
 					_pcm_frame_size, _opus_buffer + enc_size + 1,
-					OPUS_BUFFER_SIZE - enc_size - 1);
+					packet_space(enc_size));
 			if (c < 0) {
 				KLOGW(ENC_TAG, "encode failed2: opu_encode error %d", c);
 				return NULL;
 			}
-			// TODO: assert c < 256
+			// c <= MAX_PACKET_SIZE, fit in length byte
 			_opus_buffer[enc_size] = c;
 			enc_size += c + 1;
 			pcm += _pcm_frame_size;
@@ -175,6 +210,8 @@ void RKOpusEncoder::close() {
 		pcm_frame_used_bytes = 0;
 		munmap(_opus_buffer, OPUS_BUFFER_SIZE);
 		_pcm_frame_size = 0;
+		_bitrate = 0;
+		_duration = 0;
 		opus_encoder_destroy(_opus_encoder);
 		_opus_encoder = NULL;
 	}
@@ -0,0 +1,81 @@
+#include <string.h>
+#include <dlfcn.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include "connect_addr.h"
+#include "rlog.h"
+
+#define ADDR_TAG "speech.ConnectAddr"
+
+using std::string;
+
+typedef int (*GetaddrinfoFunc)(const char*, const char*,
+    const struct addrinfo*, struct addrinfo**);
+
+// set by ConnectAddrScope of current thread
+static thread_local const char* override_host = NULL;
+static thread_local const char* override_addr = NULL;
+
+static GetaddrinfoFunc next_getaddrinfo() {
+  static GetaddrinfoFunc func = (GetaddrinfoFunc)dlsym(RTLD_NEXT,
+      "getaddrinfo");
+  return func;
+}
+
+// interpose getaddrinfo of libc
+// forward to libc, except the host overridden on current thread
+extern "C" __attribute__((visibility("default")))
+int getaddrinfo(const char* node, const char* service,
+    const struct addrinfo* hints, struct addrinfo** res) {
+  GetaddrinfoFunc func = next_getaddrinfo();
+  if (func == NULL)
+    return EAI_FAIL;
+  if (node == NULL || override_host == NULL
+      || strcmp(node, override_host) != 0)
+    return func(node, service, hints, res);
+  struct addrinfo h;
+  memset(&h, 0, sizeof(h));
+  if (hints)
+    h = *hints;
+  // never query dns
+  h.ai_flags |= AI_NUMERICHOST;
+  return func(override_addr, service, &h, res);
+}
+
+namespace rokid {
+namespace speech {
+
+ConnectAddrScope::ConnectAddrScope(const string& host, const string& addr)
+    : host_(host), addr_(addr), prev_host_(override_host),
+    prev_addr_(override_addr) {
+  if (addr_.length() > 2 && addr_[0] == '['
+      && addr_[addr_.length() - 1] == ']')
+    addr_ = addr_.substr(1, addr_.length() - 2);
+  override_host = host_.c_str();
+  override_addr = addr_.c_str();
+}
+
+ConnectAddrScope::~ConnectAddrScope() {
+  override_host = prev_host_;
+  override_addr = prev_addr_;
+}
+
+static bool check_interposed() {
+  Dl_info self;
+  Dl_info bound;
+  void* func = dlsym(RTLD_DEFAULT, "getaddrinfo");
+  if (func && dladdr((void*)check_interposed, &self)
+      && dladdr(func, &bound) && self.dli_fbase == bound.dli_fbase)
+    return true;
+  KLOGI(ADDR_TAG, "getaddrinfo not interposed, uWS resolves host itself");
+  return false;
+}
+
+bool ConnectAddrScope::available() {
+  static bool r = check_interposed();
+  return r;
+}
+
+} // namespace speech
+} // namespace rokid
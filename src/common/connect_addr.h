@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+
+namespace rokid {
+namespace speech {
+
+// uWS Hub::connect resolves the host of uri with getaddrinfo, and sends
+// the host as Host header and tls server name (SNI)
+// within the scope, getaddrinfo of 'host' on current thread returns the
+// ip address 'addr' instead, without dns query
+//   uri keeps the host name, connection goes to the cached address
+// scopes may nest (connect invoked in a callback of connect)
+class ConnectAddrScope {
+public:
+  // 'addr' ip literal, ipv6 may be in brackets
+  ConnectAddrScope(const std::string& host, const std::string& addr);
+
+  ~ConnectAddrScope();
+
+  // getaddrinfo of this library takes effect
+  // false if libc bound first (library dlopen'd with RTLD_LOCAL),
+  // uWS resolves the host itself then
+  static bool available();
+
+private:
+  std::string host_;
+  std::string addr_;
+  const char* prev_host_;
+  const char* prev_addr_;
+};
+
+} // namespace speech
+} // namespace rokid
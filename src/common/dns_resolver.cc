@@ -0,0 +1,262 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#if defined(__GNU_LIBRARY__) || defined(__GLIBC__)
+#include <arpa/nameser.h>
+#include <resolv.h>
+#endif
+#include "dns_resolver.h"
+#include "rlog.h"
+
+#define DNS_TAG "speech.DnsResolver"
+// retry interval when resolve failed (milliseconds)
+#define DNS_RETRY_INTERVAL 5000
+
+using std::mutex;
+using std::unique_lock;
+using std::lock_guard;
+using std::string;
+using std::vector;
+using std::thread;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+namespace rokid {
+namespace speech {
+
+DnsResolver::DnsResolver() : thread_(NULL), port_(0), ttl_(0), cursor_(0),
+    last_resolve_ms_(0), refresh_requested_(false), stopped_(true) {
+}
+
+DnsResolver::~DnsResolver() {
+  stop();
+}
+
+void DnsResolver::start(const string& host, uint32_t port, uint32_t ttl,
+    const vector<string>& static_addrs, ResolvedCallback cb) {
+  if (thread_)
+    return;
+  host_ = host;
+  port_ = port;
+  ttl_ = seconds(ttl);
+  static_addrs_.clear();
+  for (size_t i = 0; i < static_addrs.size(); ++i) {
+    const string& a = static_addrs[i];
+    if (a.find(':') != string::npos && a[0] != '[')
+      static_addrs_.push_back("[" + a + "]");
+    else
+      static_addrs_.push_back(a);
+  }
+  addrs_.clear();
+  resolved_cb_ = cb;
+  cursor_ = 0;
+  // ttl 0: not resolve, only use 'static_addrs'
+  if (ttl == 0) {
+    expire_tp_ = SteadyClock::time_point::max();
+    return;
+  }
+  expire_tp_ = SteadyClock::now();
+  refresh_requested_ = true;
+  stopped_ = false;
+  thread_ = new thread([this] { this->run(); });
+}
+
+void DnsResolver::stop() {
+  unique_lock<mutex> locker(mutex_);
+  if (thread_ == NULL)
+    return;
+  stopped_ = true;
+  cond_.notify_one();
+  locker.unlock();
+  // getaddrinfo not cancellable, wait it return
+  thread_->join();
+  delete thread_;
+  thread_ = NULL;
+}
+
+bool DnsResolver::get_address(string& addr) {
+  lock_guard<mutex> locker(mutex_);
+  if (thread_ && SteadyClock::now() >= expire_tp_ && !refresh_requested_) {
+    refresh_requested_ = true;
+    cond_.notify_one();
+  }
+  const vector<string>& addrs = current_addrs();
+  if (addrs.empty())
+    return false;
+  addr = addrs[cursor_ % addrs.size()];
+  return true;
+}
+
+void DnsResolver::get_addresses(vector<string>& addrs) {
+  lock_guard<mutex> locker(mutex_);
+  if (thread_ && SteadyClock::now() >= expire_tp_ && !refresh_requested_) {
+    refresh_requested_ = true;
+    cond_.notify_one();
+  }
+  const vector<string>& cur = current_addrs();
+  addrs.clear();
+  for (size_t i = 0; i < cur.size(); ++i)
+    addrs.push_back(cur[(cursor_ + i) % cur.size()]);
+}
+
+void DnsResolver::mark_failure(const string& addr) {
+  lock_guard<mutex> locker(mutex_);
+  const vector<string>& addrs = current_addrs();
+  if (addrs.empty() || addrs[cursor_ % addrs.size()] != addr)
+    return;
+  cursor_ = (cursor_ + 1) % addrs.size();
+  KLOGI(DNS_TAG, "connect to %s failed, next address %s", addr.c_str(),
+      addrs[cursor_].c_str());
+  // all addresses tried, maybe they are out of date
+  if (cursor_ == 0) {
+    refresh_requested_ = true;
+    cond_.notify_one();
+  }
+}
+
+void DnsResolver::refresh() {
+  lock_guard<mutex> locker(mutex_);
+  refresh_requested_ = true;
+  cond_.notify_one();
+}
+
+uint32_t DnsResolver::last_resolve_ms() {
+  lock_guard<mutex> locker(mutex_);
+  return last_resolve_ms_;
+}
+
+bool DnsResolver::is_ip_literal(const string& host) {
+  struct in6_addr buf;
+  if (inet_pton(AF_INET, host.c_str(), &buf) == 1)
+    return true;
+  if (host.length() > 2 && host[0] == '[' && host[host.length() - 1] == ']')
+    return inet_pton(AF_INET6, host.substr(1, host.length() - 2).c_str(),
+        &buf) == 1;
+  return inet_pton(AF_INET6, host.c_str(), &buf) == 1;
+}
+
+const vector<string>& DnsResolver::current_addrs() const {
+  return addrs_.empty() ? static_addrs_ : addrs_;
+}
+
+void DnsResolver::run() {
+  unique_lock<mutex> locker(mutex_);
+  SteadyClock::time_point next_tp = SteadyClock::now();
+  SteadyClock::time_point tp;
+  vector<string> addrs;
+  string cur;
+  bool r;
+  bool notify;
+
+  KLOGV(DNS_TAG, "resolver thread run, host %s", host_.c_str());
+  while (!stopped_) {
+    if (!refresh_requested_ && SteadyClock::now() < next_tp) {
+      cond_.wait_until(locker, next_tp);
+      continue;
+    }
+    refresh_requested_ = false;
+    locker.unlock();
+    tp = SteadyClock::now();
+    addrs.clear();
+    r = resolve(addrs);
+    locker.lock();
+    if (stopped_)
+      break;
+    last_resolve_ms_ = duration_cast<milliseconds>(
+        SteadyClock::now() - tp).count();
+    notify = false;
+    if (r) {
+      KLOGI(DNS_TAG, "%s resolved, %lu addresses, first %s, %u ms",
+          host_.c_str(), addrs.size(), addrs[0].c_str(), last_resolve_ms_);
+      notify = current_addrs().empty();
+      // keep current address if still valid
+      cur = notify ? string()
+        : current_addrs()[cursor_ % current_addrs().size()];
+      addrs_.swap(addrs);
+      cursor_ = 0;
+      for (size_t i = 0; i < addrs_.size(); ++i) {
+        if (addrs_[i] == cur) {
+          cursor_ = i;
+          break;
+        }
+      }
+      tp = SteadyClock::now();
+      expire_tp_ = tp + ttl_;
+      // refresh before expire
+      next_tp = tp + duration_cast<milliseconds>(ttl_) * 3 / 4;
+    } else {
+      KLOGW(DNS_TAG, "resolve %s failed, %u ms, %s", host_.c_str(),
+          last_resolve_ms_, current_addrs().empty() ? "no address available"
+          : "use stale addresses");
+      next_tp = SteadyClock::now() + milliseconds(DNS_RETRY_INTERVAL);
+    }
+    if (notify && resolved_cb_) {
+      locker.unlock();
+      resolved_cb_();
+      locker.lock();
+    }
+  }
+  KLOGV(DNS_TAG, "resolver thread quit");
+}
+
+void DnsResolver::reload_config() {
+// glibc bug: gethostbyname not reread resolv.conf if the file changed
+// glibc 2.26 fix the bug
+#if defined(__GLIBC__)
+  if (__GLIBC__ <= 2 && __GLIBC_MINOR__ <= 26)
+    res_init();
+// old version glibc not defined __GLIBC__, but defined __GNU_LIBRARY__ and __GNU_LIBRARY_MINOR__
+#elif defined(__GNU_LIBRARY__)
+  res_init();
+#endif
+}
+
+bool DnsResolver::resolve(vector<string>& addrs) {
+  reload_config();
+  struct addrinfo hints;
+  struct addrinfo* result;
+  char port[8];
+  char buf[INET6_ADDRSTRLEN];
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_ADDRCONFIG;
+  snprintf(port, sizeof(port), "%u", port_);
+  int err = getaddrinfo(host_.c_str(), port, &hints, &result);
+  if (err) {
+    KLOGW(DNS_TAG, "getaddrinfo %s: %s", host_.c_str(), gai_strerror(err));
+    return false;
+  }
+  for (struct addrinfo* it = result; it; it = it->ai_next) {
+    const void* sa;
+    if (it->ai_family == AF_INET)
+      sa = &reinterpret_cast<struct sockaddr_in*>(it->ai_addr)->sin_addr;
+    else if (it->ai_family == AF_INET6)
+      sa = &reinterpret_cast<struct sockaddr_in6*>(it->ai_addr)->sin6_addr;
+    else
+      continue;
+    if (inet_ntop(it->ai_family, sa, buf, sizeof(buf)) == NULL)
+      continue;
+    string addr = it->ai_family == AF_INET6
+      ? string("[") + buf + "]" : string(buf);
+    bool dup = false;
+    for (size_t i = 0; i < addrs.size(); ++i) {
+      if (addrs[i] == addr) {
+        dup = true;
+        break;
+      }
+    }
+    if (!dup)
+      addrs.push_back(addr);
+  }
+  freeaddrinfo(result);
+  return !addrs.empty();
+}
+
+} // namespace speech
+} // namespace rokid
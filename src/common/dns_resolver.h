@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <string>
+#include <vector>
+#include <functional>
+#include "alt_chrono.h"
+
+namespace rokid {
+namespace speech {
+
+// 在独立线程中异步解析服务器域名并缓存结果
+// 连接线程只读取缓存, 永不因dns阻塞
+//   解析成功的结果缓存'ttl'秒, 过期前后台自动刷新
+//   刷新失败时继续使用旧结果
+//   可预置地址列表, dns解析无结果时使用
+class DnsResolver {
+public:
+  typedef std::function<void()> ResolvedCallback;
+
+  DnsResolver();
+
+  ~DnsResolver();
+
+  // 'ttl' seconds, cache time of resolve result
+  //       0: not resolve, only use 'static_addrs'
+  // 'static_addrs' pre-resolved addresses of 'host'
+  // 'cb' invoked in resolver thread when addresses available
+  //      after no address available before
+  void start(const std::string& host, uint32_t port, uint32_t ttl,
+      const std::vector<std::string>& static_addrs, ResolvedCallback cb);
+
+  void stop();
+
+  // current address of host, never block
+  // return false if no address available
+  bool get_address(std::string& addr);
+
+  // all addresses of host, current address first, never block
+  void get_addresses(std::vector<std::string>& addrs);
+
+  // connect to 'addr' failed, use next address and refresh if needed
+  void mark_failure(const std::string& addr);
+
+  // resolve immediately in background
+  void refresh();
+
+  // milliseconds of lastest resolve
+  uint32_t last_resolve_ms();
+
+  static bool is_ip_literal(const std::string& host);
+
+private:
+  // reread resolv.conf if libc not do it
+  static void reload_config();
+
+  void run();
+
+  bool resolve(std::vector<std::string>& addrs);
+
+  // must lock 'mutex_' before invoke
+  const std::vector<std::string>& current_addrs() const;
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::thread* thread_;
+  std::string host_;
+  uint32_t port_;
+  std::chrono::seconds ttl_;
+  std::vector<std::string> static_addrs_;
+  std::vector<std::string> addrs_;
+  ResolvedCallback resolved_cb_;
+  SteadyClock::time_point expire_tp_;
+  uint32_t cursor_;
+  uint32_t last_resolve_ms_;
+  bool refresh_requested_;
+  bool stopped_;
+};
+
+} // namespace speech
+} // namespace rokid
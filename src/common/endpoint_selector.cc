@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <algorithm>
+#include "endpoint_selector.h"
+#include "rlog.h"
+
+#define EP_TAG "speech.EndpointSelector"
+// assumed connect + auth time of endpoint never connected (milliseconds)
+#define UNKNOWN_SRTT 1000
+// score penalty per continuous failure (milliseconds)
+#define FAILURE_PENALTY 2000
+#define MAX_FAILURE_PENALTY 30000
+#define NO_STICKY 0xffffffff
+
+using std::mutex;
+using std::lock_guard;
+using std::string;
+using std::vector;
+
+namespace rokid {
+namespace speech {
+
+// parse "host", "host:port", "[ipv6]:port"
+static void parse_endpoint(const string& s, uint32_t default_port,
+    string& host, uint32_t& port) {
+  size_t pos;
+  port = default_port;
+  if (s[0] == '[') {
+    pos = s.find(']');
+    if (pos == string::npos) {
+      host = s;
+      return;
+    }
+    host = s.substr(0, pos + 1);
+    if (pos + 1 < s.length() && s[pos + 1] == ':')
+      port = atoi(s.c_str() + pos + 2);
+    return;
+  }
+  pos = s.find(':');
+  // ipv6 address without brackets, no port
+  if (pos != string::npos && s.find(':', pos + 1) != string::npos) {
+    host = "[" + s + "]";
+    return;
+  }
+  host = s.substr(0, pos);
+  if (pos != string::npos)
+    port = atoi(s.c_str() + pos + 1);
+}
+
+EndpointSelector::EndpointSelector() : sticky_(NO_STICKY) {
+}
+
+EndpointSelector::~EndpointSelector() {
+  stop();
+}
+
+void EndpointSelector::initialize(const PrepareOptions& options,
+    DnsResolver::ResolvedCallback cb) {
+  Endpoint ep;
+  vector<string> no_addrs;
+  bool use_resolver;
+
+  stop();
+  for (size_t i = 0; i <= options.backup_endpoints.size(); ++i) {
+    if (i == 0) {
+      ep.host = options.host;
+      ep.port = options.port;
+    } else {
+      if (options.backup_endpoints[i - 1].empty())
+        continue;
+      parse_endpoint(options.backup_endpoints[i - 1], options.port,
+          ep.host, ep.port);
+    }
+    ep.srtt = 0;
+    ep.failures = 0;
+    ep.resolver = NULL;
+    if (!DnsResolver::is_ip_literal(ep.host)) {
+      const vector<string>& static_addrs = i == 0 ? options.host_addrs
+        : no_addrs;
+      use_resolver = options.dns_ttl > 0 || !static_addrs.empty();
+      if (use_resolver) {
+        ep.resolver = new DnsResolver();
+        ep.resolver->start(ep.host, ep.port, options.dns_ttl,
+            static_addrs, cb);
+      }
+    } else if (ep.host[0] != '[' && ep.host.find(':') != string::npos) {
+      ep.host = "[" + ep.host + "]";
+    }
+    KLOGI(EP_TAG, "endpoint %lu: %s:%u", endpoints_.size(),
+        ep.host.c_str(), ep.port);
+    endpoints_.push_back(ep);
+  }
+}
+
+void EndpointSelector::stop() {
+  // resolver threads may invoke callback, not lock 'mutex_' here
+  for (size_t i = 0; i < endpoints_.size(); ++i) {
+    if (endpoints_[i].resolver) {
+      endpoints_[i].resolver->stop();
+      delete endpoints_[i].resolver;
+    }
+  }
+  endpoints_.clear();
+  sticky_ = NO_STICKY;
+}
+
+uint32_t EndpointSelector::score(uint32_t idx) const {
+  const Endpoint& ep = endpoints_[idx];
+  uint32_t r = ep.srtt ? ep.srtt : UNKNOWN_SRTT;
+  uint32_t penalty = ep.failures * FAILURE_PENALTY;
+  r += penalty > MAX_FAILURE_PENALTY ? MAX_FAILURE_PENALTY : penalty;
+  // stickiness, only switch to other endpoint if it is obviously faster
+  if (idx == sticky_)
+    r = r * 3 / 4;
+  return r;
+}
+
+bool EndpointSelector::select(vector<ConnectCandidate>& cands, uint32_t max) {
+  vector<uint32_t> order;
+  vector<string> addrs;
+  vector<string> v4;
+  vector<string> v6;
+  ConnectCandidate cand;
+  size_t i, j;
+
+  lock_guard<mutex> locker(mutex_);
+  cands.clear();
+  for (i = 0; i < endpoints_.size(); ++i)
+    order.push_back(i);
+  // stable: primary endpoint first if scores equal
+  std::stable_sort(order.begin(), order.end(),
+      [this](uint32_t a, uint32_t b) { return score(a) < score(b); });
+  for (i = 0; i < order.size() && cands.size() < max; ++i) {
+    const Endpoint& ep = endpoints_[order[i]];
+    cand.endpoint = order[i];
+    cand.host = ep.host;
+    cand.port = ep.port;
+    if (ep.resolver == NULL) {
+      cand.addr = ep.host;
+      cands.push_back(cand);
+      continue;
+    }
+    ep.resolver->get_addresses(addrs);
+    if (addrs.empty())
+      continue;
+    v4.clear();
+    v6.clear();
+    for (j = 0; j < addrs.size(); ++j) {
+      if (addrs[j][0] == '[')
+        v6.push_back(addrs[j]);
+      else
+        v4.push_back(addrs[j]);
+    }
+    // interleave address families, start with the family of first address
+    vector<string>& first = addrs[0][0] == '[' ? v6 : v4;
+    vector<string>& second = addrs[0][0] == '[' ? v4 : v6;
+    for (j = 0; j < first.size() || j < second.size(); ++j) {
+      if (j < first.size() && cands.size() < max) {
+        cand.addr = first[j];
+        cands.push_back(cand);
+      }
+      if (j < second.size() && cands.size() < max) {
+        cand.addr = second[j];
+        cands.push_back(cand);
+      }
+    }
+  }
+  return !cands.empty();
+}
+
+void EndpointSelector::on_success(const ConnectCandidate& cand, uint32_t ms) {
+  lock_guard<mutex> locker(mutex_);
+  if (cand.endpoint >= endpoints_.size())
+    return;
+  Endpoint& ep = endpoints_[cand.endpoint];
+  if (ms == 0)
+    ms = 1;
+  ep.srtt = ep.srtt ? (ep.srtt * 7 + ms) / 8 : ms;
+  ep.failures = 0;
+  if (sticky_ != cand.endpoint)
+    KLOGI(EP_TAG, "endpoint %s:%u selected, %u ms", ep.host.c_str(),
+        ep.port, ms);
+  sticky_ = cand.endpoint;
+}
+
+void EndpointSelector::on_failure(const ConnectCandidate& cand) {
+  lock_guard<mutex> locker(mutex_);
+  if (cand.endpoint >= endpoints_.size())
+    return;
+  Endpoint& ep = endpoints_[cand.endpoint];
+  ++ep.failures;
+  if (ep.resolver)
+    ep.resolver->mark_failure(cand.addr);
+  if (sticky_ == cand.endpoint)
+    sticky_ = NO_STICKY;
+}
+
+uint32_t EndpointSelector::last_resolve_ms() {
+  lock_guard<mutex> locker(mutex_);
+  if (endpoints_.empty() || endpoints_[0].resolver == NULL)
+    return 0;
+  return endpoints_[0].resolver->last_resolve_ms();
+}
+
+} // namespace speech
+} // namespace rokid
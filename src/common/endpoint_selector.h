@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "speech_common.h"
+#include "dns_resolver.h"
+
+namespace rokid {
+namespace speech {
+
+// 一个连接候选: 服务端点的一个地址
+typedef struct {
+  // index of endpoint, 0 is PrepareOptions.host
+  uint32_t endpoint;
+  std::string host;
+  uint32_t port;
+  // ip address, or 'host' if not resolve
+  std::string addr;
+} ConnectCandidate;
+
+// 服务端点(PrepareOptions.host及backup_endpoints)管理
+//   每个端点独立异步解析域名
+//   记录每个端点的连接+认证耗时(平滑值)及连续失败次数
+//   按耗时排序给出候选地址, 上次成功的端点优先(粘性), 除非其它端点明显更快
+class EndpointSelector {
+public:
+  EndpointSelector();
+
+  ~EndpointSelector();
+
+  // 'cb' invoked when some endpoint address available
+  //      after no address available before
+  void initialize(const PrepareOptions& options,
+      DnsResolver::ResolvedCallback cb);
+
+  void stop();
+
+  // candidates for next connect round, best first
+  // addresses of ipv6 and ipv4 interleaved
+  // return false if no address available
+  bool select(std::vector<ConnectCandidate>& cands, uint32_t max);
+
+  // 'ms' time of connect + auth
+  void on_success(const ConnectCandidate& cand, uint32_t ms);
+
+  void on_failure(const ConnectCandidate& cand);
+
+  // milliseconds of lastest dns resolve of primary endpoint
+  uint32_t last_resolve_ms();
+
+  uint32_t size() const { return endpoints_.size(); }
+
+private:
+  typedef struct {
+    std::string host;
+    uint32_t port;
+    // NULL if host is ip address
+    DnsResolver* resolver;
+    // smoothed connect + auth time, 0 if unknown
+    uint32_t srtt;
+    uint32_t failures;
+  } Endpoint;
+
+  // lower is better
+  uint32_t score(uint32_t idx) const;
+
+private:
+  std::mutex mutex_;
+  std::vector<Endpoint> endpoints_;
+  // endpoint of lastest success connection
+  uint32_t sticky_;
+};
+
+} // namespace speech
+} // namespace rokid
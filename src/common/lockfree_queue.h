@@ -0,0 +1,255 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <utility>
+#ifdef __linux__
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#else
+#include <mutex>
+#include <condition_variable>
+#endif
+#include "alt_chrono.h"
+
+#define CACHE_LINE_SIZE 64
+
+namespace rokid {
+namespace speech {
+
+// 无锁等待/唤醒 (eventcount)
+// 等待方: key = prepare_wait(), 再次检查条件, 不满足则wait(key)或
+//         wait_for(key, ms), 满足则cancel_wait(key)
+// 通知方: 修改条件后notify(), 无等待者时不进入内核
+//         一次通知唤醒已登记的全部等待者, 并清零等待者计数,
+//         等待者被唤醒前的后续通知也不进入内核
+// 状态为64位: 高32位epoch, 低32位当前epoch的等待者数
+// linux下基于futex(等待epoch变化), 其它平台以mutex/condition_variable实现
+class EventCount {
+public:
+	EventCount() : state_(0) {
+	}
+
+	uint32_t prepare_wait() {
+		uint64_t prev = state_.fetch_add(1, std::memory_order_seq_cst);
+		return static_cast<uint32_t>(prev >> EPOCH_SHIFT);
+	}
+
+	// condition satisfied, not wait
+	void cancel_wait(uint32_t key) {
+		uint64_t s = state_.load(std::memory_order_relaxed);
+		// epoch changed: notify already took this waiter
+		while (epoch_of(s) == key && (s & WAITERS_MASK)) {
+			if (state_.compare_exchange_weak(s, s - 1,
+						std::memory_order_seq_cst))
+				break;
+		}
+	}
+
+	void wait(uint32_t key) {
+#ifdef __linux__
+		while (epoch_of(state_.load(std::memory_order_acquire)) == key)
+			syscall(SYS_futex, epoch_word(), FUTEX_WAIT_PRIVATE, key,
+					NULL, NULL, 0);
+#else
+		std::unique_lock<std::mutex> locker(mutex_);
+		while (epoch_of(state_.load(std::memory_order_acquire)) == key)
+			cond_.wait(locker);
+#endif
+	}
+
+	// wait at most 'ms' milliseconds
+	// return false if timeout
+	bool wait_for(uint32_t key, uint32_t ms) {
+		bool r = true;
+#ifdef __linux__
+		SteadyClock::time_point deadline = SteadyClock::now()
+			+ std::chrono::milliseconds(ms);
+		SteadyClock::time_point now;
+		struct timespec ts;
+		while (epoch_of(state_.load(std::memory_order_acquire)) == key) {
+			now = SteadyClock::now();
+			if (now >= deadline) {
+				r = false;
+				break;
+			}
+			int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+					deadline - now).count();
+			ts.tv_sec = ns / 1000000000;
+			ts.tv_nsec = ns % 1000000000;
+			syscall(SYS_futex, epoch_word(), FUTEX_WAIT_PRIVATE, key, &ts,
+					NULL, 0);
+		}
+#else
+		std::unique_lock<std::mutex> locker(mutex_);
+		r = cond_.wait_for(locker, std::chrono::milliseconds(ms),
+				[this, key] {
+					return epoch_of(state_.load(std::memory_order_acquire)) != key;
+				});
+#endif
+		if (!r)
+			cancel_wait(key);
+		return r;
+	}
+
+	void notify() {
+		// pairs with 'state_' increment of prepare_wait:
+		// either waiter sees new condition, or we see the waiter
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		uint64_t s = state_.load(std::memory_order_relaxed);
+		while (true) {
+			if ((s & WAITERS_MASK) == 0)
+				return;
+			// next epoch, no waiters
+			if (state_.compare_exchange_weak(s,
+						(s & ~WAITERS_MASK) + (1ULL << EPOCH_SHIFT),
+						std::memory_order_seq_cst))
+				break;
+		}
+#ifdef __linux__
+		syscall(SYS_futex, epoch_word(), FUTEX_WAKE_PRIVATE, INT32_MAX,
+				NULL, NULL, 0);
+#else
+		std::lock_guard<std::mutex> locker(mutex_);
+		cond_.notify_all();
+#endif
+	}
+
+private:
+	static const uint32_t EPOCH_SHIFT = 32;
+	static const uint64_t WAITERS_MASK = 0xffffffffULL;
+
+	static inline uint32_t epoch_of(uint64_t s) {
+		return static_cast<uint32_t>(s >> EPOCH_SHIFT);
+	}
+
+#ifdef __linux__
+	// futex word: high 32 bits of 'state_'
+	uint32_t* epoch_word() {
+		uint32_t* p = reinterpret_cast<uint32_t*>(&state_);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		return p + 1;
+#else
+		return p;
+#endif
+	}
+#endif
+
+private:
+	static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+			"futex on half of the atomic state");
+	std::atomic<uint64_t> state_;
+#ifndef __linux__
+	std::mutex mutex_;
+	std::condition_variable cond_;
+#endif
+}; // class EventCount
+
+// 有界多生产者多消费者无锁队列 (Dmitry Vyukov)
+// 每个槽位以序号标记可写/可读, 生产者与消费者各自CAS推进位置
+// 容量向上取整为2的幂
+template <typename T>
+class MpmcQueue {
+public:
+	explicit MpmcQueue(uint32_t capacity) : enqueue_pos_(0),
+			dequeue_pos_(0) {
+		uint32_t n = 2;
+		while (n < capacity)
+			n <<= 1;
+		mask_ = n - 1;
+		cells_ = new Cell[n];
+		for (uint32_t i = 0; i < n; ++i)
+			cells_[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	~MpmcQueue() {
+		delete[] cells_;
+	}
+
+	uint32_t capacity() const {
+		return mask_ + 1;
+	}
+
+	// return false if full
+	bool try_push(const T& data) {
+		Cell* cell;
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		size_t seq;
+		intptr_t dif;
+
+		while (true) {
+			cell = cells_ + (pos & mask_);
+			seq = cell->seq.load(std::memory_order_acquire);
+			dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+			if (dif == 0) {
+				if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+							std::memory_order_relaxed))
+					break;
+			} else if (dif < 0)
+				return false;
+			else
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+		}
+		cell->data = data;
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// return false if empty
+	bool try_pop(T& data) {
+		Cell* cell;
+		size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		size_t seq;
+		intptr_t dif;
+
+		while (true) {
+			cell = cells_ + (pos & mask_);
+			seq = cell->seq.load(std::memory_order_acquire);
+			dif = static_cast<intptr_t>(seq)
+				- static_cast<intptr_t>(pos + 1);
+			if (dif == 0) {
+				if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+							std::memory_order_relaxed))
+					break;
+			} else if (dif < 0)
+				return false;
+			else
+				pos = dequeue_pos_.load(std::memory_order_relaxed);
+		}
+		data = std::move(cell->data);
+		// release reference now, not when slot reused
+		cell->data = T();
+		cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+		return true;
+	}
+
+	// approximate when other threads operating
+	uint32_t size() const {
+		size_t e = enqueue_pos_.load(std::memory_order_acquire);
+		size_t d = dequeue_pos_.load(std::memory_order_acquire);
+		return e > d ? e - d : 0;
+	}
+
+private:
+	class Cell {
+	public:
+		std::atomic<size_t> seq;
+		T data;
+	};
+
+	// producers and consumers positions on different cache lines
+	char pad0_[CACHE_LINE_SIZE];
+	Cell* cells_;
+	size_t mask_;
+	char pad1_[CACHE_LINE_SIZE];
+	std::atomic<size_t> enqueue_pos_;
+	char pad2_[CACHE_LINE_SIZE];
+	std::atomic<size_t> dequeue_pos_;
+	char pad3_[CACHE_LINE_SIZE];
+}; // class MpmcQueue
+
+} // namespace speech
+} // namespace rokid
@@ -36,12 +36,32 @@ bool NanoPBDecoder::decode_string(pb_istream_t *stream,
   return true;
 }
 
+bool NanoPBDecoder::decode_bytes_ref(pb_istream_t *stream,
+    const pb_field_t *field, void **arg) {
+  BytesRef* ref = (BytesRef*)(*arg);
+  if (ref == NULL)
+    return false;
+  if (stream->bytes_left == 0)
+    return true;
+  // ParseFromArray always decode from memory buffer,
+  // 'stream->state' point to current read position
+  ref->data = (const char*)stream->state;
+  ref->length = stream->bytes_left;
+  // skip bytes
+  return pb_read(stream, NULL, stream->bytes_left);
+}
+
 void NanoPBDecoder::init_string_field(pb_callback_t* cb,
     shared_ptr<string>* strp) {
   cb->funcs.decode = decode_string;
   cb->arg = strp;
 }
 
+void NanoPBDecoder::init_bytes_ref_field(pb_callback_t* cb, BytesRef* ref) {
+  cb->funcs.decode = decode_bytes_ref;
+  cb->arg = ref;
+}
+
 AuthResponse::AuthResponse() {
   nanopbStruct = rokid_open_speech_AuthResponse_init_default;
   nanopbStructPointer = &nanopbStruct;
@@ -53,14 +73,17 @@ TtsResponse::TtsResponse() {
   nanopbStructPointer = &nanopbStruct;
   nanopbFields = rokid_open_speech_v1_TtsResponse_fields;
   init_string_field(&nanopbStruct.text, &_text);
-  init_string_field(&nanopbStruct.voice, &_voice);
+  init_bytes_ref_field(&nanopbStruct.voice, &_voice);
+  _voice.data = NULL;
+  _voice.length = 0;
 }
 
 string* TtsResponse::release_voice() {
-  if (_voice.get() == NULL)
+  if (_voice.data == NULL)
     return NULL;
-  string* str = new string(*_voice);
-  _voice.reset();
+  string* str = new string(_voice.data, _voice.length);
+  _voice.data = NULL;
+  _voice.length = 0;
   return str;
 }
 
@@ -75,7 +98,8 @@ string* TtsResponse::release_text() {
 
 void TtsResponse::clear_super_data() {
   _text.reset();
-  _voice.reset();
+  _voice.data = NULL;
+  _voice.length = 0;
 }
 
 SpeechResponse::SpeechResponse() {
@@ -9,6 +9,13 @@
 namespace rokid {
 namespace speech {
 
+// reference to bytes field inside the buffer passed to 'ParseFromArray'
+// only valid while that buffer alive
+typedef struct {
+	const char* data;
+	uint32_t length;
+} BytesRef;
+
 class NanoPBDecoder {
 public:
 	bool ParseFromArray(const char* data, uint32_t length);
@@ -16,12 +23,17 @@ public:
 protected:
 	void init_string_field(pb_callback_t* cb, std::shared_ptr<std::string>* strp);
 
+	void init_bytes_ref_field(pb_callback_t* cb, BytesRef* ref);
+
 	virtual void clear_super_data() {}
 
 private:
 	static bool decode_string(pb_istream_t *stream, const pb_field_t *field,
 			void **arg);
 
+	static bool decode_bytes_ref(pb_istream_t *stream, const pb_field_t *field,
+			void **arg);
+
 protected:
 	void* nanopbStructPointer;
 	const pb_field_t* nanopbFields;
@@ -52,7 +64,16 @@ public:
 	}
 
 	inline bool has_voice() const {
-		return _voice.get() != NULL;
+		return _voice.data != NULL;
+	}
+
+	// voice data point to the buffer passed to 'ParseFromArray', no copy
+	inline const char* voice_data() const {
+		return _voice.data;
+	}
+
+	inline uint32_t voice_length() const {
+		return _voice.length;
 	}
 
 	std::string* release_voice();
@@ -68,7 +89,7 @@ protected:
 private:
 	rokid_open_speech_v1_TtsResponse nanopbStruct;
 	std::shared_ptr<std::string> _text;
-	std::shared_ptr<std::string> _voice;
+	BytesRef _voice;
 };
 
 class SpeechResponse : public NanoPBDecoder {
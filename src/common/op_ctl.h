@@ -1,17 +1,33 @@
 #pragma once
 
 #include <stdint.h>
+#include <atomic>
 #include <condition_variable>
 #include <mutex>
-#include <list>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <unordered_map>
 #include "alt_chrono.h"
 
 #define NOOP_TIMEOUT 20000
 #define NORESP_TIMEOUT 30000
+// operations not polled, oldest finished ones dropped beyond this
+#define DEFAULT_MAX_OPS 256
+// removed operations kept for reuse
+#define OP_POOL_SIZE 8
 
 namespace rokid {
 namespace speech {
 
+typedef struct {
+	// operations not removed (results not polled)
+	uint32_t depth;
+	uint32_t max_depth;
+	// dropped because of 'max_ops' limit
+	uint32_t dropped;
+} OperationStats;
+
 template <typename TStatus, typename TError>
 class OperationController {
 public:
@@ -24,13 +40,23 @@ public:
 		bool calc_op_timeout;
 	} Operation;
 
-	void new_op(int32_t id, TStatus status) {
-		std::shared_ptr<Operation> op(new Operation());
+	OperationController() : max_ops_(DEFAULT_MAX_OPS), max_depth_(0),
+			dropped_(0), sent_tp_(0) {
+	}
+
+	void new_op(int32_t id, TStatus status, TError err = TError()) {
+		std::shared_ptr<Operation> op = alloc_op();
 		op->id = id;
 		op->status = status;
+		op->error = err;
 		op->calc_op_timeout = false;
 		op->lastest_recv_timepoint = SteadyClock::now();
 		operations_.push_back(op);
+		OpIndex& idx = index_[id];
+		if (idx.count++ == 0)
+			idx.op = op.get();
+		if (operations_.size() > max_depth_)
+			max_depth_ = operations_.size();
 		if (status == TStatus::START)
 			current_op_ = op;
 	}
@@ -66,15 +92,21 @@ public:
 	// cancel op specified by 'id'
 	// if 'id' <= 0, cancel all operations
 	void cancel_op(int32_t id, std::condition_variable& cond) {
-		typename std::list<std::shared_ptr<Operation> >::iterator it;
+		typename std::deque<std::shared_ptr<Operation> >::iterator it;
+		typename std::unordered_map<int32_t, OpIndex>::iterator iit;
 		bool need_notify = false;
-		for (it = operations_.begin(); it != operations_.end(); ++it) {
-			if (id <= 0 || id == (*it)->id) {
+		if (id > 0) {
+			iit = index_.find(id);
+			if (iit != index_.end()) {
+				iit->second.op->status = TStatus::CANCELLED;
+				if (current_op_.get() == iit->second.op)
+					need_notify = true;
+			}
+		} else {
+			for (it = operations_.begin(); it != operations_.end(); ++it) {
 				(*it)->status = TStatus::CANCELLED;
-				if (current_op_.get() && current_op_->id == (*it)->id)
+				if (current_op_ == *it)
 					need_notify = true;
-				if (id > 0)
-					break;
 			}
 		}
 		if (need_notify) {
@@ -85,8 +117,52 @@ public:
 	}
 
 	void remove_front_op() {
-		if (!operations_.empty())
-			operations_.pop_front();
+		if (operations_.empty())
+			return;
+		std::shared_ptr<Operation> op = operations_.front();
+		operations_.pop_front();
+		typename std::unordered_map<int32_t, OpIndex>::iterator it
+			= index_.find(op->id);
+		if (it != index_.end()) {
+			if (--it->second.count == 0) {
+				index_.erase(it);
+			} else if (it->second.op == op.get()) {
+				// id duplicated, next oldest one takes the index
+				typename std::deque<std::shared_ptr<Operation> >::iterator oit;
+				for (oit = operations_.begin(); oit != operations_.end();
+						++oit) {
+					if ((*oit)->id == op->id) {
+						it->second.op = oit->get();
+						break;
+					}
+				}
+			}
+		}
+		if (retired_.size() < OP_POOL_SIZE)
+			retired_.push_back(op);
+	}
+
+	// 0: no limit
+	void set_max_ops(uint32_t max) {
+		max_ops_ = max;
+	}
+
+	// too many operations not polled, and front one not in progress
+	// caller should drop results of front op, then 'drop_front_op'
+	bool over_limit() {
+		return max_ops_ && operations_.size() > max_ops_
+			&& operations_.front() != current_op_;
+	}
+
+	void drop_front_op() {
+		++dropped_;
+		remove_front_op();
+	}
+
+	void get_stats(OperationStats& stats) {
+		stats.depth = operations_.size();
+		stats.max_depth = max_depth_;
+		stats.dropped = dropped_;
 	}
 
 	void refresh_op_time(bool recv) {
@@ -98,6 +174,13 @@ public:
 		}
 	}
 
+	// data of current op sent, as refresh_op_time(false)
+	// no lock needed, invoked per voice frame
+	void refresh_send_time() {
+		sent_tp_.store(SteadyClock::now().time_since_epoch().count(),
+				std::memory_order_relaxed);
+	}
+
 	uint32_t op_timeout() {
 		if (current_op_.get() == NULL)
 			return NOOP_TIMEOUT;
@@ -105,11 +188,17 @@ public:
 			return NOOP_TIMEOUT;
 		uint32_t t1, t2;
 		SteadyClock::time_point now = SteadyClock::now();
+		SteadyClock::time_point begin = current_op_->begin_timepoint;
+		// sends of previous op are all before 'begin'
+		SteadyClock::time_point sent = SteadyClock::time_point(
+				SteadyClock::duration(sent_tp_.load(std::memory_order_relaxed)));
+		if (sent > begin)
+			begin = sent;
 
 		// cacl no operation timeout
 		std::chrono::duration<uint32_t, std::milli> dur =
 			std::chrono::duration_cast<std::chrono::duration<uint32_t, std::milli> >
-			(now - current_op_->begin_timepoint);
+			(now - begin);
 		if (dur.count() > NOOP_TIMEOUT)
 			return 0;
 		t1 = NOOP_TIMEOUT - dur.count();
@@ -138,10 +227,43 @@ public:
 	}
 
 private:
+	// reuse removed operation no longer referenced by others
+	std::shared_ptr<Operation> alloc_op() {
+		std::shared_ptr<Operation> op;
+		size_t i;
+		for (i = 0; i < retired_.size(); ++i) {
+			if (retired_[i].use_count() == 1) {
+				op.swap(retired_[i]);
+				retired_[i].swap(retired_.back());
+				retired_.pop_back();
+				*op = Operation();
+				return op;
+			}
+		}
+		return std::make_shared<Operation>();
+	}
+
+private:
+	typedef struct {
+		// oldest operation of the id, which 'cancel_op' cancels
+		Operation* op;
+		// operations of the id in 'operations_'
+		uint32_t count;
+	} OpIndex;
+
 	std::condition_variable op_cond_;
-	std::list<std::shared_ptr<Operation> > operations_;
+	std::deque<std::shared_ptr<Operation> > operations_;
+	// id -> oldest operation of the id in 'operations_', as the
+	// first match 'cancel_op' used to find by scanning
+	std::unordered_map<int32_t, OpIndex> index_;
+	std::vector<std::shared_ptr<Operation> > retired_;
 	std::shared_ptr<Operation> current_op_;
 	std::shared_ptr<Operation> null_op_;
+	uint32_t max_ops_;
+	uint32_t max_depth_;
+	uint32_t dropped_;
+	// SteadyClock ticks of latest 'refresh_send_time'
+	std::atomic<SteadyClock::rep> sent_tp_;
 };
 
 } // namespace speech
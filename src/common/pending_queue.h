@@ -5,8 +5,9 @@
 #include <pthread.h>
 #include <assert.h>
 #include <list>
-#include <map>
+#include <vector>
 #include <memory>
+#include <utility>
 #include "rlog.h"
 
 using namespace std;
@@ -31,7 +32,7 @@ public:
 
 	typedef shared_ptr<QueueItem> QueueItemSp;
 
-	PendingQueue() : closed_(false) {
+	PendingQueue() : closed_(false), waiters_(0) {
 		pthread_mutex_init(&mutex_, NULL);
 		pthread_cond_init(&cond_, NULL);
 	}
@@ -52,7 +53,7 @@ public:
 		item->deleted = false;
 		item->data = data;
 		queue_.push_back(item);
-		pthread_cond_signal(&cond_);
+		wakeup();
 		pthread_mutex_unlock(&mutex_);
 		return true;
 	}
@@ -119,8 +120,11 @@ public:
 		QueueItemSp item;
 
 		pthread_mutex_lock(&mutex_);
-		if (!closed_ && queue_.empty())
+		while (!closed_ && queue_.empty()) {
+			++waiters_;
 			pthread_cond_wait(&cond_, &mutex_);
+			--waiters_;
+		}
 		if (!queue_.empty()) {
 			item = queue_.front();
 			id = item->id;
@@ -137,50 +141,98 @@ public:
 		return r;
 	}
 
+protected:
+	// must lock 'mutex_' before invoke
+	// consumer busy if no waiter, no need to signal
+	inline void wakeup() {
+		if (waiters_)
+			pthread_cond_signal(&cond_);
+	}
+
 protected:
 	list<QueueItemSp> queue_;
 	pthread_mutex_t mutex_;
 	pthread_cond_t cond_;
 	bool closed_;
+	// threads waiting in 'poll', protected by 'mutex_'
+	uint32_t waiters_;
 }; // class PendingQueue
 
 #define STREAM_QUEUE_TAG "speech.StreamQueue"
+// data items per segment
+#define STREAM_SEGMENT_ITEMS 16
+// objects allocated by SlabPool a time
+#define SLAB_OBJECTS 32
+// stream id index initial size: 1 << STREAM_INDEX_MIN_BITS slots
+#define STREAM_INDEX_MIN_BITS 4
+
+// 定长对象池, 按块(SLAB_OBJECTS个)分配, 空闲对象以'next'链接复用
+// 对象类型须有成员'next'
+// 非线程安全, 由使用者加锁
+template <typename O>
+class SlabPool {
+public:
+	SlabPool() : free_(NULL) {
+	}
 
+	~SlabPool() {
+		release();
+	}
+
+	O* get() {
+		O* o;
+		if (free_ == NULL)
+			grow();
+		o = free_;
+		free_ = o->next;
+		o->next = NULL;
+		return o;
+	}
+
+	void put(O* o) {
+		o->next = free_;
+		free_ = o;
+	}
+
+	// free all slabs, all objects must be put back
+	void release() {
+		typename vector<O*>::iterator it;
+		for (it = slabs_.begin(); it != slabs_.end(); ++it)
+			delete[] *it;
+		slabs_.clear();
+		free_ = NULL;
+	}
+
+private:
+	void grow() {
+		O* slab = new O[SLAB_OBJECTS];
+		uint32_t i;
+		slabs_.push_back(slab);
+		for (i = 0; i < SLAB_OBJECTS; ++i)
+			put(slab + i);
+	}
+
+private:
+	O* free_;
+	vector<O*> slabs_;
+}; // class SlabPool
+
+// 按流(id)组织的队列, 流之间按start顺序排列, 只从队首流取数据
+//   流: 对象池分配, 单链表按start顺序链接
+//   流数据: 对象池分配的定长段(STREAM_SEGMENT_ITEMS项)链, 先进先出
+//   id索引: 开放寻址哈希表, O(1)查找
+// 非线程安全, 由使用者加锁
 template <typename T, typename A>
 class StreamQueue {
 public:
 	typedef shared_ptr<T> T_sp;
 	typedef shared_ptr<A> A_sp;
 
-	class QueueItem {
-	public:
-		enum ItemType {
-			data,
-			uncompleted,
-			completed,
-			deleted,
-			error,
-		};
-
-		QueueItem() : type(0), polling(0), err(0), id(0) {
-		}
-
-		// 0: data
-		// 1: tag (stream uncompleted)
-		// 2: tag (stream completed)
-		// 3: tag (stream deleted)
-		// 4: tag (stream error)
-		uint32_t type:15;
-		// stream uncompleted and is polling
-		uint32_t polling:1;
-		uint32_t err:16;
-		// only meaningful when 'type' not 'data'
-		int32_t id;
-		// only meaningful when 'type' is 'data' or 'completed'
-		T_sp content;
-		// only meaningful when 'type' not 'data'
-		A_sp arg;
-		uint32_t data_count;
+	enum StreamType {
+		uncompleted = 1,
+		completed,
+		deleted,
+		error,
 	};
 
 	enum PopType {
@@ -192,166 +244,173 @@ public:
 		POP_TYPE_ERROR
 	};
 
-	typedef shared_ptr<QueueItem> QueueItemSp;
-	typedef typename list<QueueItemSp>::iterator StreamingItemPos;
+	StreamQueue() : front_(NULL), back_(NULL), index_bits_(0),
+			stream_count_(0) {
+	}
+
+	~StreamQueue() {
+		close();
+	}
 
 	bool start(int32_t id) {
-		if (item_tags_.find(id) != item_tags_.end()) {
+		if (find(id)) {
 			KLOGV(STREAM_QUEUE_TAG, "add tag for %d failed, "
 					"already existed", id);
 			return false;
 		}
 
-		QueueItemSp item(new QueueItem());
-		item->type = QueueItem::uncompleted;
-		item->polling = 0;
-		item->id = id;
-		item->data_count = 0;
-		StreamingItemPos it;
-		it = queue_.insert(queue_.end(), item);
-		item_tags_.insert(pair<int, StreamingItemPos>(item->id, it));
-		tag_queue_.push_back(it);
+		Stream* s = streams_.get();
+		s->id = id;
+		s->type = uncompleted;
+		s->polling = 0;
+		s->err = 0;
+		s->data_count = 0;
+		s->head = NULL;
+		s->tail = NULL;
+		s->head_pos = 0;
+		s->tail_pos = 0;
+		if (back_)
+			back_->next = s;
+		else
+			front_ = s;
+		back_ = s;
+		index_insert(s);
 		KLOGV(STREAM_QUEUE_TAG, "add tag for id %d", id);
 		return true;
 	}
 
 	bool stream(int32_t id, T_sp data) {
-		typename map<int, StreamingItemPos>::iterator it;
-		it = item_tags_.find(id);
-		if (it == item_tags_.end()
-				|| (*it->second)->type != QueueItem::uncompleted) {
-			if (it == item_tags_.end())
+		Stream* s = find(id);
+		if (s == NULL || s->type != uncompleted) {
+			if (s == NULL)
 				KLOGV(STREAM_QUEUE_TAG, "add data for id %d failed, "
 						"the tag not existed", id);
 			else
 				KLOGV(STREAM_QUEUE_TAG, "add data for id %d failed, "
-						"the tag type is %d", id, (*it->second)->type);
+						"the tag type is %d", id, s->type);
 			return false;
 		}
 
-		QueueItemSp item(new QueueItem());
-		item->type = QueueItem::data;
-		item->content = data;
-		queue_.insert(it->second, item);
-		++(*it->second)->data_count;
+		if (s->tail == NULL || s->tail_pos == STREAM_SEGMENT_ITEMS) {
+			Segment* seg = segments_.get();
+			if (s->tail)
+				s->tail->next = seg;
+			else {
+				s->head = seg;
+				s->head_pos = 0;
+			}
+			s->tail = seg;
+			s->tail_pos = 0;
+		}
+		s->tail->items[s->tail_pos++] = data;
+		++s->data_count;
 		KLOGV(STREAM_QUEUE_TAG, "add data for id %d, "
-				"data count is %d", id,
-				(*it->second)->data_count);
+				"data count is %d", id, s->data_count);
 		return true;
 	}
 
 	bool end(int32_t id, T_sp data = NULL) {
-		typename map<int32_t, StreamingItemPos>::iterator it;
-
-		it = item_tags_.find(id);
-		if (it == item_tags_.end()) {
+		Stream* s = find(id);
+		if (s == NULL) {
 			KLOGV(STREAM_QUEUE_TAG, "complete tag for id %d failed, "
 					"tag not existed", id);
 			return false;
 		}
-		(*it->second)->type = QueueItem::completed;
+		s->type = completed;
 		if (data.get())
-			(*it->second)->content = data;
+			s->content = data;
 		KLOGV(STREAM_QUEUE_TAG, "complete tag for id %d, "
-				"data count is %d", id, (*it->second)->data_count);
+				"data count is %d", id, s->data_count);
 		return true;
 	}
 
 	void set_arg(int32_t id, A_sp& arg) {
-		typename map<int32_t, StreamingItemPos>::iterator it;
-
-		it = item_tags_.find(id);
-		if (it == item_tags_.end()) {
+		Stream* s = find(id);
+		if (s == NULL) {
 			KLOGV(STREAM_QUEUE_TAG, "set_arg for id %d failed, "
 					"tag not existed", id);
 			return;
 		}
-		(*it->second)->arg = arg;
+		s->arg = arg;
 	}
 
 	A_sp get_arg(int32_t id) {
-		typename map<int32_t, StreamingItemPos>::iterator it;
-
-		it = item_tags_.find(id);
-		if (it == item_tags_.end()) {
+		Stream* s = find(id);
+		if (s == NULL) {
 			KLOGV(STREAM_QUEUE_TAG, "get_arg for id %d failed, "
 					"tag not existed", id);
 			return NULL;
 		}
-		return (*it->second)->arg;
+		return s->arg;
 	}
 
 	uint32_t size() {
-		return item_tags_.size();
+		return stream_count_;
 	}
 
-	bool erase(int32_t id, uint32_t err = 0) {
-		typename map<int32_t, StreamingItemPos>::iterator it;
-		typename list<QueueItemSp>::iterator first_it;
-		typename list<QueueItemSp>::iterator last_it;
-		uint32_t c = 0;
-
-		it = item_tags_.find(id);
-		if (it != item_tags_.end()) {
-			assert(id == (*it->second)->id);
-			last_it = it->second;
-			first_it = last_it;
-			if (first_it != queue_.begin()) {
-				do {
-					--first_it;
-					if ((*first_it)->type != QueueItem::data) {
-						++first_it;
-						break;
-					}
-					++c;
-				} while (first_it != queue_.begin());
-			}
-			assert((*last_it)->type != QueueItem::data);
-			(*last_it)->content.reset();
-			if (err) {
-				(*last_it)->type = QueueItem::error;
-				(*last_it)->err = err;
-			} else
-				(*last_it)->type = QueueItem::deleted;
-			if (first_it != last_it) {
-				(*last_it)->data_count -= c;
-				KLOGV(STREAM_QUEUE_TAG, "erase %d data for id %d, "
-						"data count is %d, err %d", c, id,
-						(*last_it)->data_count, err);
-				queue_.erase(first_it, last_it);
+	// remove oldest data of stream 'id', not popped yet
+	// 'id' 0: oldest data of all streams
+	bool drop_data(int32_t id, T_sp& data, int32_t& data_id) {
+		Stream* s;
+
+		for (s = front_; s; s = s->next) {
+			if (s->data_count && (id == 0 || s->id == id)) {
+				data_id = s->id;
+				pop_front_data(s, data);
+				return true;
 			}
-			return true;
+			if (s->id == id)
+				return false;
 		}
 		return false;
 	}
 
+	// pop next data of stream 'id' if it is polling and data available
+	// not pop tags, return false if no data now
+	bool pop_data(int32_t id, T_sp& res) {
+		Stream* s = front_;
+		if (s == NULL || s->id != id || !s->polling || s->data_count == 0
+				|| (s->type != uncompleted && s->type != completed))
+			return false;
+		pop_front_data(s, res);
+		return true;
+	}
+
+	bool erase(int32_t id, uint32_t err = 0) {
+		Stream* s = find(id);
+		uint32_t c;
+
+		if (s == NULL)
+			return false;
+		s->content.reset();
+		if (err) {
+			s->type = error;
+			s->err = err;
+		} else
+			s->type = deleted;
+		c = clear_data(s);
+		if (c)
+			KLOGV(STREAM_QUEUE_TAG, "erase %d data for id %d, err %d",
+					c, id, err);
+		return true;
+	}
+
 	void clear(int32_t* min_id, int32_t* max_id) {
-		typename list<QueueItemSp>::iterator it;
-		typename list<QueueItemSp>::iterator tmpit;
+		Stream* s;
 		int32_t min = 0;
 		int32_t max = 0;
-		uint32_t c = 0;
+		uint32_t c;
 
-		if (tag_queue_.size()) {
-			min = (*tag_queue_.front())->id;
-			max = (*tag_queue_.back())->id;
+		if (front_) {
+			min = front_->id;
+			max = back_->id;
 		}
-		it = queue_.begin();
-		while (it != queue_.end()) {
-			if ((*it)->type == QueueItem::data) {
-				tmpit = it;
-				++it;
-				queue_.erase(tmpit);
-				++c;
-			} else {
-				(*it)->type = QueueItem::deleted;
-				(*it)->content.reset();
-				(*it)->data_count -= c;
-				KLOGV(STREAM_QUEUE_TAG, "clear queue, erase %d data "
-						"for id %d, finally count is %d", c,
-						(*it)->id, (*it)->data_count);
-				++it;
-			}
+		for (s = front_; s; s = s->next) {
+			c = clear_data(s);
+			s->type = deleted;
+			s->content.reset();
+			KLOGV(STREAM_QUEUE_TAG, "clear queue, erase %d data "
+					"for id %d", c, s->id);
 		}
 		if (min_id)
 			*min_id = min;
@@ -360,113 +419,248 @@ public:
 	}
 
 	void close() {
-		queue_.clear();
-		item_tags_.clear();
-		tag_queue_.clear();
+		Stream* s;
+		while (front_) {
+			s = front_;
+			front_ = s->next;
+			clear_data(s);
+			s->content.reset();
+			s->arg.reset();
+			streams_.put(s);
+		}
+		back_ = NULL;
+		index_.clear();
+		index_bits_ = 0;
+		stream_count_ = 0;
+		// return memory to system, pools grow again on demand
+		streams_.release();
+		segments_.release();
 	}
 
 	bool available() {
-		if (tag_queue_.empty())
+		Stream* s = front_;
+		if (s == NULL)
 			return false;
-		StreamingItemPos ip = tag_queue_.front();
-		QueueItemSp item = *ip;
-		assert(item->type != QueueItem::data);
-		if (item->type == QueueItem::uncompleted
-				&& item->polling) {
-			// if ip == queue_.begin(),
+		if (s->type == uncompleted && s->polling) {
 			// the stream no data available now,
 			// not end, wait for more data,
 			// should return false.
-			return ip != queue_.begin();
+			return s->data_count > 0;
 		}
 		return true;
 	}
 
 	int32_t pop(int32_t& id, T_sp& res, uint32_t& err) {
-		if (tag_queue_.empty()) {
+		Stream* s = front_;
+		if (s == NULL) {
 			KLOGV(STREAM_QUEUE_TAG, "pop return EMPTY");
 			return POP_TYPE_EMPTY;
 		}
-		StreamingItemPos ip = tag_queue_.front();
-		QueueItemSp item = *ip;
-		assert(item->type != QueueItem::data);
-		if (item->type == QueueItem::uncompleted
-				|| item->type == QueueItem::completed) {
-			if (!item->polling) {
-				id = item->id;
-				item->polling = 1;
+		if (s->type == uncompleted || s->type == completed) {
+			if (!s->polling) {
+				id = s->id;
+				s->polling = 1;
 				KLOGV(STREAM_QUEUE_TAG, "pop return start for id %d, "
-						"data count %d", id, item->data_count);
+						"data count %d", id, s->data_count);
 				return POP_TYPE_START;
 			}
-			if (ip == queue_.begin()) {
-				if (item->type == QueueItem::uncompleted) {
+			if (s->data_count == 0) {
+				if (s->type == uncompleted) {
 					KLOGV(STREAM_QUEUE_TAG, "pop return EMPTY, "
-							"id %d, data count = %d", item->id,
-							item->data_count);
-					// if ip == queue_.begin(),
+							"id %d, data count = %d", s->id,
+							s->data_count);
 					// the stream no data available now,
 					// not end, wait for more data.
 					return POP_TYPE_EMPTY;
 				}
-				id = item->id;
-				if (item->content.get())
-					res = item->content;
-				item_tags_.erase(item->id);
-				tag_queue_.pop_front();
-				queue_.pop_front();
+				id = s->id;
+				if (s->content.get())
+					res = s->content;
 				KLOGV(STREAM_QUEUE_TAG, "pop return complete for "
-						"id %d, data count %d", item->id,
-						item->data_count);
+						"id %d", s->id);
+				pop_front();
 				return POP_TYPE_END;
 			}
-			id = item->id;
-			--item->data_count;
+			id = s->id;
+			pop_front_data(s, res);
 			KLOGV(STREAM_QUEUE_TAG, "pop return data for id %d, "
-					"data count %d", item->id, item->data_count);
-			item = queue_.front();
-			assert(item->type == QueueItem::data);
-			queue_.pop_front();
-			res = item->content;
+					"data count %d", s->id, s->data_count);
 			return POP_TYPE_DATA;
-		} else if (item->type == QueueItem::deleted) {
-			id = item->id;
-			item_tags_.erase(item->id);
-			tag_queue_.pop_front();
-			queue_.pop_front();
-			KLOGV(STREAM_QUEUE_TAG, "pop return deleted for id %d, "
-					"data count %d", item->id, item->data_count);
+		} else if (s->type == deleted) {
+			id = s->id;
+			KLOGV(STREAM_QUEUE_TAG, "pop return deleted for id %d",
+					s->id);
+			pop_front();
 			return POP_TYPE_REMOVED;
 		}
-		id = item->id;
-		err = item->err;
-		item_tags_.erase(item->id);
-		tag_queue_.pop_front();
-		queue_.pop_front();
-		KLOGV(STREAM_QUEUE_TAG, "pop return error for id %d, "
-				"data count %d", item->id, item->data_count);
+		id = s->id;
+		err = s->err;
+		KLOGV(STREAM_QUEUE_TAG, "pop return error for id %d", s->id);
+		pop_front();
 		return POP_TYPE_ERROR;
 	}
 
+private:
+	class Segment {
+	public:
+		T_sp items[STREAM_SEGMENT_ITEMS];
+		Segment* next;
+	};
+
+	class Stream {
+	public:
+		int32_t id;
+		// StreamType
+		uint32_t type:15;
+		// stream uncompleted and is polling
+		uint32_t polling:1;
+		uint32_t err:16;
+		// only meaningful when 'type' is 'completed'
+		T_sp content;
+		A_sp arg;
+		uint32_t data_count;
+		// data from 'head->items[head_pos]' to 'tail->items[tail_pos - 1]'
+		Segment* head;
+		Segment* tail;
+		uint32_t head_pos;
+		uint32_t tail_pos;
+		Stream* next;
+	};
+
+	void pop_front_data(Stream* s, T_sp& res) {
+		Segment* seg = s->head;
+		res = std::move(seg->items[s->head_pos++]);
+		--s->data_count;
+		if (s->data_count == 0) {
+			segments_.put(seg);
+			s->head = NULL;
+			s->tail = NULL;
+		} else if (s->head_pos == STREAM_SEGMENT_ITEMS) {
+			s->head = seg->next;
+			s->head_pos = 0;
+			segments_.put(seg);
+		}
+	}
+
+	// return count of data removed
+	uint32_t clear_data(Stream* s) {
+		uint32_t c = s->data_count;
+		uint32_t end;
+		uint32_t i;
+		Segment* seg;
+
+		while (s->head) {
+			seg = s->head;
+			end = seg == s->tail ? s->tail_pos : STREAM_SEGMENT_ITEMS;
+			for (i = s->head_pos; i < end; ++i)
+				seg->items[i].reset();
+			s->head = seg == s->tail ? NULL : seg->next;
+			s->head_pos = 0;
+			segments_.put(seg);
+		}
+		s->tail = NULL;
+		s->data_count = 0;
+		return c;
+	}
+
+	// remove front stream, data already popped or cleared
+	void pop_front() {
+		Stream* s = front_;
+		index_remove(s->id);
+		front_ = s->next;
+		if (front_ == NULL)
+			back_ = NULL;
+		clear_data(s);
+		s->content.reset();
+		s->arg.reset();
+		streams_.put(s);
+	}
+
+	inline uint32_t index_home(int32_t id) const {
+		return (static_cast<uint32_t>(id) * 0x9e3779b1u)
+			>> (32 - index_bits_);
+	}
+
+	Stream* find(int32_t id) const {
+		uint32_t mask;
+		uint32_t i;
+		if (stream_count_ == 0)
+			return NULL;
+		mask = index_.size() - 1;
+		for (i = index_home(id); index_[i]; i = (i + 1) & mask) {
+			if (index_[i]->id == id)
+				return index_[i];
+		}
+		return NULL;
+	}
+
+	void index_insert(Stream* s) {
+		uint32_t mask;
+		uint32_t i;
+		// load factor not exceeds 1/2
+		if ((stream_count_ + 1) * 2 > index_.size()) {
+			vector<Stream*> old;
+			old.swap(index_);
+			index_bits_ = index_bits_ ? index_bits_ + 1 : STREAM_INDEX_MIN_BITS;
+			index_.assign(1u << index_bits_, NULL);
+			mask = index_.size() - 1;
+			for (i = 0; i < old.size(); ++i) {
+				if (old[i] == NULL)
+					continue;
+				uint32_t j = index_home(old[i]->id);
+				while (index_[j])
+					j = (j + 1) & mask;
+				index_[j] = old[i];
+			}
+		}
+		mask = index_.size() - 1;
+		for (i = index_home(s->id); index_[i]; i = (i + 1) & mask);
+		index_[i] = s;
+		++stream_count_;
+	}
+
+	// backward shift deletion, no tombstone
+	void index_remove(int32_t id) {
+		uint32_t mask = index_.size() - 1;
+		uint32_t i;
+		uint32_t j;
+		uint32_t k;
+
+		for (i = index_home(id); index_[i]->id != id; i = (i + 1) & mask);
+		j = i;
+		while (true) {
+			j = (j + 1) & mask;
+			if (index_[j] == NULL)
+				break;
+			k = index_home(index_[j]->id);
+			// move back if home of 'j' not in (i, j]
+			if (i <= j ? (k <= i || k > j) : (k <= i && k > j)) {
+				index_[i] = index_[j];
+				i = j;
+			}
+		}
+		index_[i] = NULL;
+		--stream_count_;
+	}
+
 protected:
-	list<QueueItemSp> queue_;
-	list<StreamingItemPos> tag_queue_;
-	map<int32_t, StreamingItemPos> item_tags_;
+	// streams in order of start
+	Stream* front_;
+	Stream* back_;
+	vector<Stream*> index_;
+	uint32_t index_bits_;
+	uint32_t stream_count_;
+	SlabPool<Stream> streams_;
+	SlabPool<Segment> segments_;
 }; // class StreamQueue
 
 template <typename T, typename A>
 class PendingStreamQueue : public StreamQueue<T, A> {
 public:
 	typedef StreamQueue<T, A> BaseQueue;
-	using typename BaseQueue::QueueItem;
-	using BaseQueue::queue_;
-	using BaseQueue::tag_queue_;
-	using BaseQueue::item_tags_;
 	typedef shared_ptr<T> T_sp;
-	typedef shared_ptr<QueueItem> QueueItemSp;
-	typedef typename list<QueueItemSp>::iterator StreamingItemPos;
 
-	PendingStreamQueue() : closed_(false) {
+	PendingStreamQueue() : closed_(false), waiters_(0) {
 		pthread_mutex_init(&mutex_, NULL);
 		pthread_cond_init(&cond_, NULL);
 	}
@@ -483,7 +677,7 @@ public:
 			return false;
 		}
 		if (BaseQueue::start(id)) {
-			pthread_cond_signal(&cond_);
+			wakeup();
 		}
 		pthread_mutex_unlock(&mutex_);
 		return true;
@@ -496,7 +690,7 @@ public:
 			return;
 		}
 		if (BaseQueue::stream(id, data)) {
-			pthread_cond_signal(&cond_);
+			wakeup();
 		}
 		pthread_mutex_unlock(&mutex_);
 	}
@@ -508,7 +702,7 @@ public:
 			return;
 		}
 		if (BaseQueue::end(id)) {
-			pthread_cond_signal(&cond_);
+			wakeup();
 		}
 		pthread_mutex_unlock(&mutex_);
 	}
@@ -522,7 +716,7 @@ public:
 		}
 		if (BaseQueue::erase(id, err)) {
 			r = true;
-			pthread_cond_signal(&cond_);
+			wakeup();
 		}
 		pthread_mutex_unlock(&mutex_);
 		return r;
@@ -534,7 +728,7 @@ public:
 		pthread_mutex_lock(&mutex_);
 		BaseQueue::clear(&min, &max);
 		if (min > 0)
-			pthread_cond_signal(&cond_);
+			wakeup();
 		pthread_mutex_unlock(&mutex_);
 		if (min_id)
 			*min_id = min;
@@ -578,7 +772,9 @@ public:
 		do {
 			r = this->pop(id, item, err);
 			if (r < 0) {
+				++waiters_;
 				pthread_cond_wait(&cond_, &mutex_);
+				--waiters_;
 				if (closed_) {
 					pthread_mutex_unlock(&mutex_);
 					return false;
@@ -590,10 +786,20 @@ public:
 		return true;
 	}
 
+private:
+	// must lock 'mutex_' before invoke
+	// consumer busy if no waiter, no need to signal
+	inline void wakeup() {
+		if (waiters_)
+			pthread_cond_signal(&cond_);
+	}
+
 private:
 	pthread_mutex_t mutex_;
 	pthread_cond_t cond_;
 	bool closed_;
+	// threads waiting in 'poll', protected by 'mutex_'
+	uint32_t waiters_;
 }; // class PendingStreamQueue
 
 } // namespace speech
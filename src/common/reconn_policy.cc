@@ -0,0 +1,79 @@
+#include "reconn_policy.h"
+
+// base wait time of each failure cause (milliseconds)
+#define LOST_BASE_INTERVAL 1000
+#define NET_BASE_INTERVAL 500
+#define TLS_BASE_INTERVAL 2000
+// connection ready longer than this, failures reset (milliseconds)
+#define STABLE_DURATION 30000
+#define MAX_BACKOFF_SHIFT 16
+
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+
+namespace rokid {
+namespace speech {
+
+ReconnPolicy::ReconnPolicy() : max_interval_(0), failures_(0),
+    ready_(false) {
+  // different seed per device and per connection
+  rand_.seed(static_cast<uint32_t>(
+        SteadyClock::now().time_since_epoch().count())
+      ^ static_cast<uint32_t>(reinterpret_cast<uintptr_t>(this)));
+}
+
+void ReconnPolicy::initialize(uint32_t max_interval) {
+  max_interval_ = max_interval;
+  failures_ = 0;
+  ready_ = false;
+}
+
+uint32_t ReconnPolicy::next_delay(ConnectFailure cause) {
+  uint64_t base;
+
+  if (ready_) {
+    ready_ = false;
+    // connection broken soon after ready, maybe server reject us
+    // continue backoff, not retry fast again
+    if (SteadyClock::now() - ready_tp_ >= milliseconds(STABLE_DURATION))
+      failures_ = 0;
+  }
+  switch (cause) {
+    case ConnectFailure::LOST:
+    case ConnectFailure::NO_RESPONSE:
+      base = LOST_BASE_INTERVAL;
+      break;
+    case ConnectFailure::DNS:
+    case ConnectFailure::TCP:
+      base = NET_BASE_INTERVAL;
+      break;
+    case ConnectFailure::TLS:
+      base = TLS_BASE_INTERVAL;
+      break;
+    default:
+      base = max_interval_;
+      break;
+  }
+  base <<= failures_ < MAX_BACKOFF_SHIFT ? failures_ : MAX_BACKOFF_SHIFT;
+  if (base > max_interval_)
+    base = max_interval_;
+  ++failures_;
+  // auth failure: wait at least half of max
+  if (cause == ConnectFailure::AUTH)
+    return base / 2 + random(base / 2);
+  return random(base);
+}
+
+void ReconnPolicy::on_ready() {
+  ready_ = true;
+  ready_tp_ = SteadyClock::now();
+}
+
+uint32_t ReconnPolicy::random(uint32_t max) {
+  if (max == 0)
+    return 0;
+  return rand_() % (max + 1);
+}
+
+} // namespace speech
+} // namespace rokid
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <random>
+#include "speech_common.h"
+#include "alt_chrono.h"
+
+namespace rokid {
+namespace speech {
+
+// 断线重连等待时间策略
+//   指数退避: 连续失败次数n, 等待上限 min(max, base(cause) * 2^n)
+//   full jitter: 实际等待时间在[0, 上限]内随机, 避免大量设备同时重连
+//   按失败原因区分基准时间:
+//     LOST/NO_RESPONSE  已就绪的连接断开, 快速重连(仍随机打散)
+//     DNS/TCP           网络问题, 较短基准
+//     TLS               握手失败, 较长基准
+//     AUTH              认证失败, 重试多半无效, 直接使用上限
+//   连接就绪并稳定一段时间后, 连续失败次数清零
+class ReconnPolicy {
+public:
+  ReconnPolicy();
+
+  // 'max_interval' max wait time (milliseconds)
+  void initialize(uint32_t max_interval);
+
+  // milliseconds to wait before next connect
+  uint32_t next_delay(ConnectFailure cause);
+
+  // connection ready
+  void on_ready();
+
+  uint32_t failures() const { return failures_; }
+
+private:
+  uint32_t random(uint32_t max);
+
+private:
+  std::minstd_rand rand_;
+  uint32_t max_interval_;
+  // continuous failures
+  uint32_t failures_;
+  SteadyClock::time_point ready_tp_;
+  bool ready_;
+};
+
+} // namespace speech
+} // namespace rokid
@@ -1,18 +1,48 @@
 #include <inttypes.h>
+#include <string.h>
+#include <errno.h>
 #include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include "openssl/md5.h"
 #include "speech_connection.h"
 #include "nanopb_encoder.h"
 #include "nanopb_decoder.h"
-#if defined(__GNU_LIBRARY__) || defined(__GLIBC__)
-#include <netinet/in.h>
-#include <arpa/nameser.h>
-#include <resolv.h>
-#endif
+#include "connect_addr.h"
+
+// max response buffers cached for reuse
+#define MAX_FREE_RESP_BUFFERS 8
+// responses queued without lock, more go to the overflow list
+#define RESP_QUEUE_SIZE 64
+// response buffer capacity alignment
+#define RESP_BUFFER_ALIGN 4096
+
+// max connect attempts of one connect round
+#define MAX_RACE_ATTEMPTS 4
+// session regard as active if data sent in this duration (milliseconds)
+#define SESSION_ACTIVE_WINDOW 10000
+// ping interval range when session active (milliseconds)
+#define MIN_ACTIVE_PING_INTERVAL 200
+#define MAX_ACTIVE_PING_INTERVAL 1000
+// dead peer detect timeout: DEAD_RTO_FACTOR * (srtt + 4 * rttvar)
+// and not less than MIN_DEAD_TIMEOUT (milliseconds)
+#define DEAD_RTO_FACTOR 3
+#define MIN_DEAD_TIMEOUT 2000
+// peer dead after this many consecutive pings not ponged in time
+#define DEAD_PROBES 2
+// tcp keepalive when no data transfer (seconds)
+#define TCP_KEEPALIVE_IDLE 15
+#define TCP_KEEPALIVE_INTERVAL 5
+#define TCP_KEEPALIVE_COUNT 3
+// max bytes of requests queued before connection ready (optimistic auth)
+#define MAX_EARLY_BYTES 65536
+// min interval of send throughput sample (milliseconds)
+#define MIN_THROUGHPUT_SAMPLE 100
 
 #ifdef SPEECH_STATISTIC
 #define MAX_PENDING_TRACE_INFOS 128
-#define SEND_TRACE_INFO_INTERVAL 1000
 #endif
 
 static const char* api_version_ = "2";
@@ -23,6 +53,7 @@ using std::unique_lock;
 using std::lock_guard;
 using std::defer_lock;
 using std::string;
+using std::list;
 using std::thread;
 using std::shared_ptr;
 using std::make_shared;
@@ -31,6 +62,7 @@ using std::chrono::system_clock;
 using std::chrono::duration_cast;
 using std::chrono::milliseconds;
 using std::chrono::seconds;
+using std::chrono::minutes;
 using uWS::Hub;
 using uWS::WebSocket;
 using uWS::OpCode;
@@ -51,12 +83,57 @@ const char *stage_to_string(ConnectStage stage) {
   return stage_strings[static_cast<int>(stage)];
 }
 
-SpeechConnection::SpeechConnection() : work_thread_(NULL),
-    keepalive_thread_(NULL), ws_(NULL), stage_(ConnectStage::INIT),
+// uWS loop thread locks 'stage_mutex_' by LoopStageLocker
+// uWS invokes onError/onDisconnection synchronously in hub_.connect,
+// close and terminate, the lock is already held by loop thread then
+class LoopStageLocker {
+public:
+  LoopStageLocker(mutex& m, uint32_t& depth) : mutex_(m), depth_(depth),
+      owned_(depth == 0) {
+    if (owned_)
+      mutex_.lock();
+    ++depth_;
+  }
+
+  ~LoopStageLocker() {
+    --depth_;
+    if (owned_)
+      mutex_.unlock();
+  }
+
+private:
+  mutex& mutex_;
+  uint32_t& depth_;
+  bool owned_;
+};
+
+SpeechConnection::SpeechConnection() : resps_(RESP_QUEUE_SIZE),
+    overflow_head_(NULL), overflow_tail_(NULL), overflow_count_(0),
+    free_resps_(MAX_FREE_RESP_BUFFERS), last_resp_(NULL),
+    stage_(ConnectStage::INIT), work_thread_(NULL), keepalive_timer_(NULL),
+    ws_(NULL), ws_fd_(-1), race_round_(0), race_next_(0), race_pending_(0),
+    race_won_(false), race_timer_(NULL), race_failure_(ConnectFailure::NONE),
+    close_reason_(ConnectFailure::LOST), loop_lock_depth_(0),
+    srtt_(0), rttvar_(0), ping_outstanding_(false), missed_probes_(0),
+    ready_id_(0), ready_conn_(0),
+    early_bytes_(0), early_ws_(NULL), early_gen_(0),
+    first_req_pending_(false), close_posted_(false), send_async_(NULL),
+    send_batches_(0), send_frames_(0), send_posted_bytes_(0),
+    max_send_backlog_(0), sent_bytes_(0), sample_acked_(0), sample_id_(0),
+    throughput_(0), min_rtt_(0), wakeups_(0), minute_wakeups_(0),
+    last_minute_wakeups_(0),
     CONN_TAG("speech.Connection") {
   prepare_hub();
 }
 
+SpeechConnection::~SpeechConnection() {
+  clear_resps();
+  if (last_resp_) {
+    free(last_resp_);
+    last_resp_ = NULL;
+  }
+}
+
 void SpeechConnection::initialize(int32_t ws_buf_size,
     const PrepareOptions& options, const char* svc) {
   snprintf(CONN_TAG_BUF, sizeof(CONN_TAG_BUF), "rokid.Connection.%s", svc);
@@ -65,12 +142,23 @@ void SpeechConnection::initialize(int32_t ws_buf_size,
   KLOGD(CONN_TAG, "reconn interval = %u, ping interval = %u, no resp timeout = %u",
       options_.reconn_interval, options_.ping_interval, options_.no_resp_timeout);
   service_type_ = svc;
-  stage_ = ConnectStage::PAUSED;
+  reconn_policy_.initialize(options_.reconn_interval);
+  if (options_.warm_standby) {
+    set_stage(ConnectStage::DISCONN);
+    update_reconn_tp(0);
+  } else
+    set_stage(ConnectStage::PAUSED);
 #ifdef ROKID_UPLOAD_TRACE
   trace_uploader_ = new TraceUploader(options.device_id, options.device_type_id);
 #endif
+  string primary_name = options_.host;
+  if (primary_name.length() > 2 && primary_name[0] == '[')
+    primary_name = primary_name.substr(1, primary_name.length() - 2);
+  tls_cache_.attach(hub_.getDefaultGroup<uWS::CLIENT>().clientContext,
+      options_.tls_session_file, primary_name);
+  endpoints_.initialize(options_, [this] { this->on_dns_resolved(); });
+  wakeup_minute_tp_ = SteadyClock::now();
   work_thread_ = new thread([this] { this->run(); });
-  keepalive_thread_ = new thread([this] { this->keepalive_run(); });
 }
 
 void SpeechConnection::release() {
@@ -79,26 +167,24 @@ void SpeechConnection::release() {
 
   KLOGD(CONN_TAG, "release, notify work thread");
   stage_mutex_.lock();
-  stage_ = ConnectStage::CLOSED;
+  set_stage(ConnectStage::CLOSED);
   stage_changed_.notify_all();
-  hub_.getDefaultGroup<uWS::CLIENT>().close();
+  post_send(SendItemType::CLOSE_ALL, 0, NULL, 0, OpCode::BINARY);
   stage_mutex_.unlock();
 
   KLOGD(CONN_TAG, "join work thread");
   work_thread_->join();
   delete work_thread_;
   work_thread_ = NULL;
-  keepalive_thread_->join();
-  delete keepalive_thread_;
-  keepalive_thread_ = NULL;
   KLOGD(CONN_TAG, "work thread exited");
-  hub_.getDefaultGroup<uWS::CLIENT>().clearTimer();
+  endpoints_.stop();
+  send_mutex_.lock();
+  send_queue_.clear();
+  send_posted_bytes_ = 0;
+  send_mutex_.unlock();
 
-  // awake all threads of invoking SpeechConnection::recv
-  resp_mutex_.lock();
-  responses_.clear();
-  resp_cond_.notify_all();
-  resp_mutex_.unlock();
+  // awake thread of invoking SpeechConnection::recv
+  clear_resps();
   push_status_resp(BinRespType::CLOSED);
 #ifdef ROKID_UPLOAD_TRACE
   if (trace_uploader_) {
@@ -110,14 +196,17 @@ void SpeechConnection::release() {
 
 #ifdef SPEECH_STATISTIC
 void SpeechConnection::add_trace_info(const TraceInfo& info) {
+  bool first;
   req_mutex_.lock();
+  first = _trace_infos.empty();
   _trace_infos.push_back(info);
   if (_trace_infos.size() > MAX_PENDING_TRACE_INFOS)
     _trace_infos.pop_front();
   req_mutex_.unlock();
 
-  // notify keepalive thread?
-  // stage_changed.notify_all();
+  // keepalive flush trace infos
+  if (first)
+    post_send(SendItemType::KEEPALIVE, 0, NULL, 0, OpCode::BINARY);
 }
 
 void SpeechConnection::ping(string* payload) {
@@ -128,34 +217,169 @@ void SpeechConnection::ping(string* payload) {
     len = payload->length();
   }
   KLOGV(CONN_TAG, "send ping frame, payload %lu bytes", len);
-  ws_send(data, len, OpCode::PING);
+  if (ws_)
+    ws_->send(data, len, OpCode::PING);
   lastest_ping_tp_ = SteadyClock::now();
+  if (!ping_outstanding_) {
+    ping_outstanding_ = true;
+    ping_sent_tp_ = lastest_ping_tp_;
+  }
 }
 #else
 void SpeechConnection::ping() {
   KLOGV(CONN_TAG, "send ping frame");
-  ws_send(NULL, 0, OpCode::PING);
+  if (ws_)
+    ws_->send(NULL, 0, OpCode::PING);
   lastest_ping_tp_ = SteadyClock::now();
+  if (!ping_outstanding_) {
+    ping_outstanding_ = true;
+    ping_sent_tp_ = lastest_ping_tp_;
+  }
 }
 #endif
 
 void SpeechConnection::reconn() {
   lock_guard<mutex> locker(stage_mutex_);
   update_reconn_tp(0);
-  if (ws_)
-    ws_->close();
+  close_reason_ = ConnectFailure::NONE;
+  post_close(SendItemType::CLOSE);
+}
+
+void SpeechConnection::prewarm() {
+  lock_guard<mutex> locker(stage_mutex_);
+  KLOGD(CONN_TAG, "prewarm, stage %s", stage_to_string(stage_));
+  if (stage_ == ConnectStage::PAUSED) {
+    set_stage(ConnectStage::DISCONN);
+    update_reconn_tp(0);
+    stage_changed_.notify_all();
+  } else if (stage_ == ConnectStage::READY) {
+    // voice request coming soon, keep connection
+    update_voice_tp();
+  }
+}
+
+void SpeechConnection::get_stats(ConnectionStats& stats) {
+  lock_guard<mutex> locker(stage_mutex_);
+  stats = stats_;
+  stats.last_dns_ms = endpoints_.last_resolve_ms();
+  stats.send_backlog_bytes = send_backlog_locked();
+  lock_guard<mutex> send_locker(send_mutex_);
+  stats.max_send_backlog_bytes = max_send_backlog_;
+  stats.send_batch_count = send_batches_;
+  stats.send_frame_count = send_frames_;
+  stats.wakeup_count = wakeups_;
+  SteadyClock::time_point now = SteadyClock::now();
+  if (now - wakeup_minute_tp_ >= minutes(2))
+    stats.wakeups_per_minute = 0;
+  else if (now - wakeup_minute_tp_ >= minutes(1))
+    stats.wakeups_per_minute = minute_wakeups_;
+  else
+    stats.wakeups_per_minute = last_minute_wakeups_;
+}
+
+uint32_t SpeechConnection::ready_id() {
+  uint32_t r = ready_conn_.load(std::memory_order_acquire);
+  if (r)
+    return r;
+  lock_guard<mutex> locker(stage_mutex_);
+  if (stage_ == ConnectStage::READY)
+    return ready_id_;
+  // queued requests will be sent on next ready connection
+  if (!early_reqs_.empty())
+    return ready_id_ + 1 ? ready_id_ + 1 : 1;
+  return 0;
+}
+
+uint32_t SpeechConnection::send_backlog() {
+  lock_guard<mutex> locker(stage_mutex_);
+  return send_backlog_locked();
+}
+
+uint32_t SpeechConnection::send_backlog_locked() {
+  uint32_t outq;
+  uint32_t r;
+
+  if (stage_ != ConnectStage::READY || ws_fd_ < 0)
+    return 0;
+  outq = socket_outq();
+  lock_guard<mutex> locker(send_mutex_);
+  r = send_posted_bytes_ + outq;
+  if (r > max_send_backlog_)
+    max_send_backlog_ = r;
+  return r;
+}
+
+uint32_t SpeechConnection::socket_outq() {
+  int outq = 0;
+#ifdef TIOCOUTQ
+  // socket send buffer, not sent or not acked by peer
+  // 'ws_fd_' cleared in onDisconnection with 'stage_mutex_' locked,
+  // before uWS closes the socket
+  if (ioctl(ws_fd_, TIOCOUTQ, &outq) < 0)
+    outq = 0;
+#endif
+  return outq;
+}
+
+bool SpeechConnection::estimate_link(LinkEstimate& est) {
+  SteadyClock::time_point now = SteadyClock::now();
+  uint64_t acked;
+  uint32_t outq;
+  uint32_t ms;
+  uint32_t rate;
+
+  lock_guard<mutex> locker(stage_mutex_);
+  if (stage_ != ConnectStage::READY || ws_fd_ < 0)
+    return false;
+  outq = socket_outq();
+  send_mutex_.lock();
+  // bytes left socket send buffer
+  // (uWS queue not visible, frames queued in uWS regarded as sent)
+  acked = sent_bytes_ > outq ? sent_bytes_ - outq : 0;
+  est.backlog = send_posted_bytes_ + outq;
+  if (est.backlog > max_send_backlog_)
+    max_send_backlog_ = est.backlog;
+  send_mutex_.unlock();
+  if (sample_id_ != ready_id_) {
+    // new connection, start sampling
+    sample_id_ = ready_id_;
+    sample_acked_ = acked;
+    sample_tp_ = now;
+    throughput_ = 0;
+  } else {
+    ms = duration_cast<milliseconds>(now - sample_tp_).count();
+    if (ms >= MIN_THROUGHPUT_SAMPLE) {
+      rate = acked > sample_acked_ ? (acked - sample_acked_) * 1000 / ms : 0;
+      throughput_ = throughput_ ? (throughput_ * 3 + rate) / 4 : rate;
+      sample_acked_ = acked;
+      sample_tp_ = now;
+    }
+  }
+  stats_.send_throughput = throughput_;
+  est.throughput = throughput_;
+  est.srtt = srtt_;
+  est.min_rtt = min_rtt_;
+  return true;
+}
+
+void SpeechConnection::on_dns_resolved() {
+  lock_guard<mutex> locker(stage_mutex_);
+  // connect was postponed because no address available
+  if (stage_ == ConnectStage::DISCONN) {
+    KLOGD(CONN_TAG, "host address available, connect now");
+    update_reconn_tp(0);
+    stage_changed_.notify_all();
+  }
 }
 
 void SpeechConnection::run() {
   KLOGV(CONN_TAG, "work thread runing");
 
-  // workaround for Hub loop nerver return when server no response
-  // set a timer, epoll_wait will awake periodic
-  hub_.getDefaultGroup<uWS::CLIENT>().setTimer(4000);
-
   unique_lock<mutex> locker(stage_mutex_);
   SteadyClock::time_point now;
 
+  // uWS callbacks invoked in connect() know the lock held
+  ++loop_lock_depth_;
   while (true) {
     if (stage_ == ConnectStage::CLOSED)
       break;
@@ -164,12 +388,16 @@ void SpeechConnection::run() {
         now = SteadyClock::now();
         if (now >= reconn_timepoint_) {
           KLOGD(CONN_TAG, "connecting");
-          stage_ = ConnectStage::CONNECTING;
+          set_stage(ConnectStage::CONNECTING);
           connect();
+          // optimistic auth, senders may queue requests now
+          if (stage_ == ConnectStage::CONNECTING)
+            stage_changed_.notify_all();
         } else {
           KLOGD(CONN_TAG, "wait %lld ms for reconnect",
                 duration_cast<milliseconds>(reconn_timepoint_ - now).count());
           stage_changed_.wait_for(locker, reconn_timepoint_ - now);
+          count_wakeup();
         }
         break;
       case ConnectStage::PAUSED:
@@ -182,14 +410,21 @@ void SpeechConnection::run() {
         //   connection lose
         //   socket error
         //   SpeechConnection release
+        // hub_.run() return when connection lost, no periodic timer
+        // needed, other threads wake it up by 'send_async_'
+        start_send_async();
+        --loop_lock_depth_;
         locker.unlock();
         KLOGD(CONN_TAG, "uWS run, stage %s", stage_to_string(stage_));
         hub_.run();
         KLOGD(CONN_TAG, "uWS stop run, stage %s", stage_to_string(stage_));
         locker.lock();
+        ++loop_lock_depth_;
         break;
     }
   }
+  stop_race_timer();
+  --loop_lock_depth_;
 
   KLOGV(CONN_TAG, "work thread quit");
 }
@@ -198,83 +433,240 @@ void SpeechConnection::update_reconn_tp(uint32_t ms) {
   reconn_timepoint_ = SteadyClock::now() + milliseconds(ms);
 }
 
+void SpeechConnection::schedule_reconn(ConnectFailure cause) {
+  uint32_t ms = reconn_policy_.next_delay(cause);
+  KLOGI(CONN_TAG, "reconnect after %u ms, failure %d, continuous %u",
+      ms, static_cast<int>(cause), reconn_policy_.failures());
+  update_reconn_tp(ms);
+  ++stats_.failure_count;
+  stats_.last_failure = cause;
+  stats_.last_reconn_delay_ms = ms;
+}
+
 void SpeechConnection::update_ping_tp() {
   lastest_ping_tp_ = SteadyClock::now();
 }
 
 void SpeechConnection::update_recv_tp() {
   lastest_recv_tp_ = SteadyClock::now();
+  missed_probes_ = 0;
 }
 
 void SpeechConnection::update_voice_tp() {
-  lastest_voice_tp_ = SteadyClock::now();
+  SteadyClock::time_point now = SteadyClock::now();
+  bool was_idle = !session_active(now);
+  lastest_voice_tp_ = now;
+  // keepalive switch to active ping interval
+  if (was_idle && stage_ == ConnectStage::READY)
+    post_send(SendItemType::KEEPALIVE, 0, NULL, 0, OpCode::BINARY);
 }
 
-void SpeechConnection::keepalive_run() {
-  SteadyClock::time_point now;
-  unique_lock<mutex> locker(stage_mutex_);
-  milliseconds timeout;
-  milliseconds ping_interval = milliseconds(options_.ping_interval);
+bool SpeechConnection::session_active(SteadyClock::time_point now) {
+  return now - lastest_voice_tp_ < milliseconds(SESSION_ACTIVE_WINDOW);
+}
+
+milliseconds SpeechConnection::active_ping_interval() {
+  uint32_t ms = srtt_ * 2;
+  if (ms < MIN_ACTIVE_PING_INTERVAL)
+    ms = MIN_ACTIVE_PING_INTERVAL;
+  if (ms > MAX_ACTIVE_PING_INTERVAL)
+    ms = MAX_ACTIVE_PING_INTERVAL;
+  if (ms > options_.ping_interval)
+    ms = options_.ping_interval;
+  return milliseconds(ms);
+}
+
+milliseconds SpeechConnection::dead_timeout() {
+  uint32_t ms = DEAD_RTO_FACTOR * (srtt_ + 4 * rttvar_);
+  if (ms < MIN_DEAD_TIMEOUT)
+    ms = MIN_DEAD_TIMEOUT;
+  if (ms > options_.no_resp_timeout)
+    ms = options_.no_resp_timeout;
+  return milliseconds(ms);
+}
+
+void SpeechConnection::update_rtt(uint32_t ms) {
+  // RFC 6298
+  if (srtt_ == 0) {
+    srtt_ = ms ? ms : 1;
+    rttvar_ = ms / 2;
+  } else {
+    uint32_t delta = srtt_ > ms ? srtt_ - ms : ms - srtt_;
+    rttvar_ = (rttvar_ * 3 + delta) / 4;
+    srtt_ = (srtt_ * 7 + ms) / 8;
+    if (srtt_ == 0)
+      srtt_ = 1;
+  }
+  stats_.srtt_ms = srtt_;
+  stats_.rttvar_ms = rttvar_;
+}
+
+void SpeechConnection::config_socket(WebSocket<uWS::CLIENT>* ws) {
+  int fd = ws->getFd();
+  int v = 1;
+  if (setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &v, sizeof(v)))
+    KLOGW(CONN_TAG, "set SO_KEEPALIVE failed: %s", strerror(errno));
+#ifdef TCP_KEEPIDLE
+  v = TCP_KEEPALIVE_IDLE;
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &v, sizeof(v));
+  v = TCP_KEEPALIVE_INTERVAL;
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &v, sizeof(v));
+  v = TCP_KEEPALIVE_COUNT;
+  setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &v, sizeof(v));
+#endif
+#ifdef TCP_USER_TIMEOUT
+  // unacknowledged data (voice) longer than this, kernel close the socket
+  if (options_.tcp_user_timeout) {
+    unsigned int t = options_.tcp_user_timeout;
+    if (setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &t, sizeof(t)))
+      KLOGW(CONN_TAG, "set TCP_USER_TIMEOUT failed: %s", strerror(errno));
+  }
+#endif
+}
+
+uint32_t SpeechConnection::keepalive() {
+  SteadyClock::time_point now = SteadyClock::now();
+  milliseconds ping_interval;
+  milliseconds dead_to;
   milliseconds no_resp_timeout = milliseconds(options_.no_resp_timeout);
   seconds conn_duration = seconds(options_.conn_duration);
-#ifdef SPEECH_STATISTIC
-  bool has_trace_info;
-#endif
+  milliseconds timeout;
+  SteadyClock::time_point dead_from;
+  bool active;
 
-  KLOGV(CONN_TAG, "keepalive thread run");
-  KLOGI(CONN_TAG, "connection duration is %u", options_.conn_duration);
-  while (true) {
-    if (stage_ == ConnectStage::CLOSED)
-      break;
-    if (stage_ == ConnectStage::READY) {
-      now = SteadyClock::now();
+  if (stage_ != ConnectStage::READY || ws_ == NULL)
+    return 0;
 #ifdef SPEECH_STATISTIC
-      has_trace_info = send_trace_info();
+  // flush all pending trace infos in one wakeup
+  while (send_trace_info());
 #endif
-      if (now - lastest_ping_tp_ >= ping_interval) {
-        KLOGD(CONN_TAG, "ping");
-        ping();
-        update_ping_tp();
-      }
-      if (now - lastest_recv_tp_ >= no_resp_timeout) {
-        KLOGW(CONN_TAG, "server may no response, try reconnect");
+  // session active: ping frequently, detect dead peer in a few rtt
+  active = session_active(now);
+  ping_interval = active ? active_ping_interval()
+    : milliseconds(options_.ping_interval);
+  if (now - lastest_ping_tp_ >= ping_interval) {
+    KLOGD(CONN_TAG, "ping");
+    ping();
+    update_ping_tp();
+  }
+  dead_to = dead_timeout();
+  // ping queued behind voice, dead timer not counted while
+  // send backlog draining (slow uplink, not dead peer)
+  if (send_backlog_locked())
+    backlog_tp_ = now;
+  dead_from = ping_sent_tp_ > backlog_tp_ ? ping_sent_tp_ : backlog_tp_;
+  if (active && ping_outstanding_ && now - dead_from >= dead_to
+      && now - lastest_recv_tp_ >= dead_to
+      && ++missed_probes_ < DEAD_PROBES) {
+    // a single late pong is common on cellular links, probe again
+    KLOGI(CONN_TAG, "no pong in %lld ms (srtt %u, rttvar %u), probe again",
+        (long long)dead_to.count(), srtt_, rttvar_);
+    ping_outstanding_ = false;
+    ping();
+    update_ping_tp();
+    dead_from = ping_sent_tp_ > backlog_tp_ ? ping_sent_tp_ : backlog_tp_;
+  }
+  if (active && ping_outstanding_ && now - dead_from >= dead_to
+      && now - lastest_recv_tp_ >= dead_to) {
+    KLOGW(CONN_TAG, "no pong of %u pings in %lld ms (srtt %u, rttvar %u), "
+        "peer dead, reconnect", missed_probes_, (long long)dead_to.count(),
+        srtt_, rttvar_);
+    ++stats_.dead_peer_count;
+    close_reason_ = ConnectFailure::NO_RESPONSE;
+    // connection dead, not wait close handshake
+    ws_->terminate();
+    return 0;
+  }
+  if (now - lastest_recv_tp_ >= no_resp_timeout) {
+    KLOGW(CONN_TAG, "server may no response, try reconnect");
 #ifdef ROKID_UPLOAD_TRACE
-        shared_ptr<TraceEvent> ev = make_shared<TraceEvent>();
-        ev->type = TRACE_EVENT_TYPE_SYS;
-        ev->id = "system.speech.timeout";
-        ev->name = "服务器超时未响应";
-        ev->add_key_value("service", service_type_);
-        trace_uploader_->put(ev);
-#endif
-        update_reconn_tp(0);
-        if (ws_)
-          ws_->close();
-        continue;
-      }
-      if (now - lastest_voice_tp_ >= conn_duration) {
-        KLOGI(CONN_TAG, "no voice data long time, close connection");
-        stage_ = ConnectStage::PAUSED;
-        stage_changed_.notify_all();
-        hub_.getDefaultGroup<uWS::CLIENT>().close();
-        continue;
-      }
-      auto d1 = ping_interval - duration_cast<milliseconds>(now - lastest_ping_tp_);
-      auto d2 = no_resp_timeout - duration_cast<milliseconds>(now - lastest_recv_tp_);
-      timeout = duration_cast<milliseconds>(d1 < d2 ? d1 : d2);
-      if (timeout.count() < 0)
-        timeout = milliseconds(0);
-#ifdef SPEECH_STATISTIC
-      if (has_trace_info && timeout.count() > SEND_TRACE_INFO_INTERVAL)
-        timeout = milliseconds(SEND_TRACE_INFO_INTERVAL);
+    shared_ptr<TraceEvent> ev = make_shared<TraceEvent>();
+    ev->type = TRACE_EVENT_TYPE_SYS;
+    ev->id = "system.speech.timeout";
+    ev->name = "服务器超时未响应";
+    ev->add_key_value("service", service_type_);
+    trace_uploader_->put(ev);
 #endif
-      stage_changed_.wait_for(locker, timeout);
-    } else {
-      KLOGD(CONN_TAG, "wait because stage is %s", stage_to_string(stage_));
-      stage_changed_.wait(locker);
-      KLOGD(CONN_TAG, "stage change to %s", stage_to_string(stage_));
+    close_reason_ = ConnectFailure::NO_RESPONSE;
+    ws_->terminate();
+    return 0;
+  }
+  if (now - lastest_voice_tp_ >= conn_duration) {
+    if (options_.warm_standby) {
+      KLOGI(CONN_TAG, "no voice data long time, re-establish connection");
+      lastest_voice_tp_ = now;
+      update_reconn_tp(0);
+      close_reason_ = ConnectFailure::NONE;
+      ws_->close();
+      return 0;
     }
+    KLOGI(CONN_TAG, "no voice data long time, close connection");
+    set_stage(ConnectStage::PAUSED);
+    stage_changed_.notify_all();
+    hub_.getDefaultGroup<uWS::CLIENT>().close();
+    stop_send_async();
+    return 0;
   }
-  KLOGV(CONN_TAG, "keepalive thread quit");
+  // one deadline for all timers
+  timeout = ping_interval - duration_cast<milliseconds>(now - lastest_ping_tp_);
+  auto d = no_resp_timeout - duration_cast<milliseconds>(now - lastest_recv_tp_);
+  if (d < timeout)
+    timeout = d;
+  if (active && ping_outstanding_) {
+    d = dead_to - duration_cast<milliseconds>(now - dead_from);
+    if (d < timeout)
+      timeout = d;
+  }
+  d = duration_cast<milliseconds>(conn_duration - (now - lastest_voice_tp_));
+  if (d < timeout)
+    timeout = d;
+  if (timeout.count() < 1)
+    timeout = milliseconds(1);
+  return timeout.count();
+}
+
+void SpeechConnection::run_keepalive() {
+  uint32_t ms = keepalive();
+  if (ms == 0 || ws_ == NULL) {
+    stop_keepalive();
+    return;
+  }
+  if (keepalive_timer_ == NULL) {
+    keepalive_timer_ = new uS::Timer(hub_.getLoop());
+    keepalive_timer_->setData(this);
+  } else {
+    keepalive_timer_->stop();
+  }
+  keepalive_timer_->start(on_keepalive_timer, ms, ms);
+}
+
+void SpeechConnection::stop_keepalive() {
+  if (keepalive_timer_) {
+    keepalive_timer_->stop();
+    keepalive_timer_->close();
+    keepalive_timer_ = NULL;
+  }
+}
+
+void SpeechConnection::on_keepalive_timer(uS::Timer* timer) {
+  SpeechConnection* self = reinterpret_cast<SpeechConnection*>(
+      timer->getData());
+  self->count_wakeup();
+  LoopStageLocker locker(self->stage_mutex_, self->loop_lock_depth_);
+  self->run_keepalive();
+}
+
+void SpeechConnection::count_wakeup() {
+  SteadyClock::time_point now = SteadyClock::now();
+  lock_guard<mutex> locker(send_mutex_);
+  ++wakeups_;
+  if (now - wakeup_minute_tp_ >= minutes(1)) {
+    last_minute_wakeups_ = now - wakeup_minute_tp_ >= minutes(2)
+      ? 0 : minute_wakeups_;
+    minute_wakeups_ = 0;
+    wakeup_minute_tp_ = now;
+  }
+  ++minute_wakeups_;
 }
 
 #ifdef SPEECH_STATISTIC
@@ -329,17 +721,14 @@ void SpeechConnection::prepare_hub() {
 }
 
 void SpeechConnection::connect() {
-  string uri = get_server_uri();
-  KLOGI(CONN_TAG, "connect to server %s", uri.c_str());
-// glibc bug: gethostbyname not reread resolv.conf if the file changed
-// glibc 2.26 fix the bug
-#if defined(__GLIBC__)
-  if (__GLIBC__ <= 2 && __GLIBC_MINOR__ <= 26)
-    res_init();
-// old version glibc not defined __GLIBC__, but defined __GNU_LIBRARY__ and __GNU_LIBRARY_MINOR__
-#elif defined(__GNU_LIBRARY__)
-  res_init();
-#endif
+  // never block on dns, use cached addresses
+  if (!endpoints_.select(race_cands_, MAX_RACE_ATTEMPTS)) {
+    KLOGI(CONN_TAG, "address of %s not resolved yet, wait",
+        options_.host.c_str());
+    set_stage(ConnectStage::DISCONN);
+    schedule_reconn(ConnectFailure::DNS);
+    return;
+  }
 #ifdef ROKID_UPLOAD_TRACE
   shared_ptr<TraceEvent> ev = make_shared<TraceEvent>();
   ev->type = TRACE_EVENT_TYPE_SYS;
@@ -348,23 +737,210 @@ void SpeechConnection::connect() {
   ev->add_key_value("service", service_type_);
   trace_uploader_->put(ev);
 #endif
-  hub_.connect(uri);
+  stop_race_timer();
+  ++race_round_;
+  race_attempts_.clear();
+  race_next_ = 0;
+  race_pending_ = 0;
+  race_won_ = false;
+  race_failure_ = ConnectFailure::NONE;
+  connect_tp_ = SteadyClock::now();
+  first_req_pending_ = true;
+  ++stats_.connect_count;
+  launch_attempt();
+  // happy eyeballs: connect to next candidate if no connection
+  // established after 'race_delay'
+  if (race_next_ < race_cands_.size() && options_.race_delay > 0
+      && stage_ == ConnectStage::CONNECTING) {
+    race_timer_ = new uS::Timer(hub_.getLoop());
+    race_timer_->setData(this);
+    race_timer_->start(on_race_timer, options_.race_delay,
+        options_.race_delay);
+  }
+}
+
+void SpeechConnection::launch_attempt() {
+  ConnectAttempt* attempt = new ConnectAttempt();
+  attempt->cand = race_cands_[race_next_++];
+  attempt->round = race_round_;
+  attempt->start_tp = SteadyClock::now();
+  attempt->ws = NULL;
+  attempt->tls_ms = 0;
+  attempt->tls_resumed = false;
+  attempt->has_tls_result = false;
+  attempt->failure = ConnectFailure::NONE;
+  race_attempts_.push_back(attempt);
+  ++race_pending_;
+  if (race_next_ == 2)
+    ++stats_.race_count;
+  // uri keeps the host name for Host header and SNI
+  string uri = get_server_uri(attempt->cand);
+  KLOGI(CONN_TAG, "connect to server %s (%s), attempt %u/%lu", uri.c_str(),
+      attempt->cand.addr.c_str(), race_next_, race_cands_.size());
+  if (attempt->cand.addr != attempt->cand.host
+      && ConnectAddrScope::available()) {
+    // uWS resolves the host to the cached address, no dns query
+    ConnectAddrScope scope(attempt->cand.host, attempt->cand.addr);
+    hub_.connect(uri, attempt);
+  } else {
+    hub_.connect(uri, attempt);
+  }
+}
+
+void SpeechConnection::attempt_failed(ConnectAttempt* attempt) {
+  endpoints_.on_failure(attempt->cand);
+  // attempt of old round, or lost the race
+  if (attempt->round != race_round_ || race_won_)
+    return;
+  --race_pending_;
+  if (attempt->failure > race_failure_)
+    race_failure_ = attempt->failure;
+  if (stage_ != ConnectStage::CONNECTING
+      && stage_ != ConnectStage::AUTHORIZING)
+    return;
+  // try next candidate immediately, not wait race timer
+  if (race_next_ < race_cands_.size()) {
+    launch_attempt();
+    return;
+  }
+  if (race_pending_ > 0)
+    return;
+  KLOGI(CONN_TAG, "all %lu connect attempts failed", race_cands_.size());
+  stop_race_timer();
+  // requests of optimistic auth fail with the round
+  clear_early_reqs();
+  stop_send_async();
+  push_status_resp(BinRespType::ERROR);
+  schedule_reconn(race_failure_);
+  set_stage(ConnectStage::DISCONN);
+  stage_changed_.notify_all();
+}
+
+void SpeechConnection::attempt_won(ConnectAttempt* attempt) {
+  SteadyClock::time_point now = SteadyClock::now();
+  // early frames posted but not written yet
+  drain_send_queue();
+  race_won_ = true;
+  stop_race_timer();
+  ws_ = attempt->ws;
+  ws_fd_ = ws_->getFd();
+  close_reason_ = ConnectFailure::LOST;
+  reconn_policy_.on_ready();
+  ping_outstanding_ = false;
+  missed_probes_ = 0;
+  close_posted_ = false;
+  if (++ready_id_ == 0)
+    ready_id_ = 1;
+  stats_.last_connect_ms = duration_cast<milliseconds>(
+      attempt->connected_tp - attempt->start_tp).count();
+  stats_.last_auth_ms = duration_cast<milliseconds>(
+      now - attempt->auth_tp).count();
+  if (attempt->has_tls_result) {
+    stats_.last_tls_handshake_ms = attempt->tls_ms;
+    stats_.last_tls_resumed = attempt->tls_resumed;
+    if (attempt->tls_resumed)
+      ++stats_.tls_resumed_count;
+  }
+  stats_.last_endpoint = attempt->cand.endpoint;
+  ++stats_.auth_count;
+  // initial rtt estimate, auth round trip
+  srtt_ = 0;
+  min_rtt_ = 0;
+  stats_.min_rtt_ms = 0;
+  update_rtt(stats_.last_auth_ms);
+  endpoints_.on_success(attempt->cand, duration_cast<milliseconds>(
+        now - attempt->start_tp).count());
+  if (!early_reqs_.empty()) {
+    // auth of connection carried early requests failed,
+    // or another connection won, resend on winner
+    if (attempt->ws != early_ws_) {
+      KLOGI(CONN_TAG, "replay %lu early requests", early_reqs_.size());
+      flush_early_reqs(attempt->ws);
+      ++stats_.early_replay_count;
+    }
+    clear_early_reqs();
+  }
+  KLOGI(CONN_TAG, "connection ready: %s, connect %u ms (tls %u ms, "
+      "resumed %d), auth %u ms, total %lld ms",
+      attempt->cand.addr.c_str(), stats_.last_connect_ms,
+      stats_.last_tls_handshake_ms, stats_.last_tls_resumed,
+      stats_.last_auth_ms,
+      duration_cast<milliseconds>(now - connect_tp_).count());
+  // close other connections of this round
+  // close() calls onDisconnection synchronously, which removes the
+  // attempt from race_attempts_ and deletes it, so walk a copy
+  std::vector<ConnectAttempt*> losers(race_attempts_);
+  for (size_t i = 0; i < losers.size(); ++i) {
+    ConnectAttempt* it = losers[i];
+    if (it != attempt && it->ws) {
+      KLOGD(CONN_TAG, "close connection to %s, lost the race",
+          it->cand.addr.c_str());
+      it->ws->close();
+    }
+  }
+}
+
+void SpeechConnection::remove_attempt(ConnectAttempt* attempt) {
+  std::vector<ConnectAttempt*>::iterator it;
+  for (it = race_attempts_.begin(); it != race_attempts_.end(); ++it) {
+    if (*it == attempt) {
+      race_attempts_.erase(it);
+      break;
+    }
+  }
+}
+
+void SpeechConnection::stop_race_timer() {
+  if (race_timer_) {
+    race_timer_->stop();
+    race_timer_->close();
+    race_timer_ = NULL;
+  }
+}
+
+void SpeechConnection::on_race_timer(uS::Timer* timer) {
+  SpeechConnection* self = reinterpret_cast<SpeechConnection*>(
+      timer->getData());
+  LoopStageLocker locker(self->stage_mutex_, self->loop_lock_depth_);
+  if (self->race_won_ || self->race_next_ >= self->race_cands_.size()
+      || (self->stage_ != ConnectStage::CONNECTING
+        && self->stage_ != ConnectStage::AUTHORIZING)) {
+    self->stop_race_timer();
+    return;
+  }
+  KLOGD(self->CONN_TAG, "no connection ready in %u ms, race next",
+      self->options_.race_delay);
+  self->launch_attempt();
+  if (self->race_next_ >= self->race_cands_.size())
+    self->stop_race_timer();
 }
 
-string SpeechConnection::get_server_uri() {
-  char tmp[64];
+string SpeechConnection::get_server_uri(const ConnectCandidate& cand) {
+  char tmp[256];
   snprintf(tmp, sizeof(tmp), "wss://%s:%u%s",
-      options_.host.c_str(), options_.port, options_.branch.c_str());
+      cand.host.c_str(), cand.port, options_.branch.c_str());
   return string(tmp);
 }
 
 void SpeechConnection::onConnection(WebSocket<uWS::CLIENT> *ws) {
-  KLOGI(CONN_TAG, "uws connected, %p", ws);
-  lock_guard<mutex> locker(stage_mutex_);
-  if (stage_ == ConnectStage::CLOSED || stage_ == ConnectStage::PAUSED)
+  ConnectAttempt* attempt = reinterpret_cast<ConnectAttempt*>(
+      ws->getUserData());
+  KLOGI(CONN_TAG, "uws connected, %p, %s", ws, attempt->cand.addr.c_str());
+  LoopStageLocker locker(stage_mutex_, loop_lock_depth_);
+  attempt->ws = ws;
+  attempt->connected_tp = SteadyClock::now();
+  attempt->has_tls_result = tls_cache_.take_handshake_result(ws->getFd(),
+      attempt->tls_ms, attempt->tls_resumed);
+  tls_cache_.take_handshake_started(attempt->cand.addr, attempt->cand.port);
+  if (stage_ == ConnectStage::CLOSED || stage_ == ConnectStage::PAUSED
+      || attempt->round != race_round_ || race_won_) {
+    KLOGD(CONN_TAG, "connection not needed, close it");
+    ws->close();
     return;
+  }
   KLOGD(CONN_TAG, "authorizing");
-  stage_ = ConnectStage::AUTHORIZING;
+  set_stage(ConnectStage::AUTHORIZING);
+  config_socket(ws);
 #ifdef ROKID_UPLOAD_TRACE
   shared_ptr<TraceEvent> ev = make_shared<TraceEvent>();
   ev->type = TRACE_EVENT_TYPE_SYS;
@@ -373,45 +949,83 @@ void SpeechConnection::onConnection(WebSocket<uWS::CLIENT> *ws) {
   ev->add_key_value("service", service_type_);
   trace_uploader_->put(ev);
 #endif
-  ws_ = ws;
-  auth();
+  attempt->auth_tp = SteadyClock::now();
+  if (auth(ws) && options_.optimistic_auth && early_ws_ == NULL) {
+    // not wait auth result, requests follow auth request
+    early_ws_ = ws;
+    ++early_gen_;
+    flush_early_reqs(ws);
+    stage_changed_.notify_all();
+  }
 }
 
 void SpeechConnection::onDisconnection(uWS::WebSocket<uWS::CLIENT> *ws,
     int code, char* message, size_t length) {
+  ConnectAttempt* attempt = reinterpret_cast<ConnectAttempt*>(
+      ws->getUserData());
   KLOGI(CONN_TAG, "uws disconnected, code %d, msg length %d, stage %d",
       code, length, static_cast<int>(stage_));
+  // peer closed or socket error: not locked
+  // close/terminate by ourself: locked
+  LoopStageLocker locker(stage_mutex_, loop_lock_depth_);
+  remove_attempt(attempt);
+  if (ws == early_ws_)
+    early_ws_ = NULL;
+  if (ws != ws_) {
+    // connection not won the race: lost, or broken before authorized
+    if (attempt->round == race_round_ && !race_won_) {
+      if (attempt->failure == ConnectFailure::NONE)
+        attempt->failure = ConnectFailure::TLS;
+      attempt_failed(attempt);
+    }
+    delete attempt;
+    return;
+  }
+  delete attempt;
   ws_ = NULL;
+  ws_fd_ = -1;
+  stop_send_async();
+  stop_keepalive();
   if (stage_ == ConnectStage::PAUSED || stage_ == ConnectStage::CLOSED)
     return;
   push_status_resp(BinRespType::ERROR);
-  if (stage_ == ConnectStage::READY)
+  // closed by ourself for reconnect immediately
+  if (close_reason_ == ConnectFailure::NONE)
     update_reconn_tp(0);
   else
-    update_reconn_tp(options_.reconn_interval);
-  stage_ = ConnectStage::DISCONN;
+    schedule_reconn(close_reason_);
+  close_reason_ = ConnectFailure::LOST;
+  set_stage(ConnectStage::DISCONN);
   stage_changed_.notify_all();
 }
 
 void SpeechConnection::onMessage(uWS::WebSocket<uWS::CLIENT> *ws,
     char* message, size_t length, uWS::OpCode opcode) {
   KLOGD(CONN_TAG, "uws recv message, length %d, opcode 0x%x", length, opcode);
+  ConnectAttempt* attempt;
   switch (stage_) {
-    case ConnectStage::AUTHORIZING:
-      stage_mutex_.lock();
+    case ConnectStage::AUTHORIZING: {
+      LoopStageLocker locker(stage_mutex_, loop_lock_depth_);
+      attempt = reinterpret_cast<ConnectAttempt*>(ws->getUserData());
+      if (attempt->round != race_round_ || race_won_)
+        break;
       if (handle_auth_result(message, length, opcode)) {
+        attempt_won(attempt);
         update_recv_tp();
         update_voice_tp();
-        stage_ = ConnectStage::READY;
+        set_stage(ConnectStage::READY);
         stage_changed_.notify_all();
+        run_keepalive();
       } else {
-        update_reconn_tp(options_.reconn_interval);
-        if (ws_)
-          ws_->close();
+        // onDisconnection will handle the failure
+        attempt->failure = ConnectFailure::AUTH;
+        ws->close();
       }
-      stage_mutex_.unlock();
       break;
+    }
     case ConnectStage::READY:
+      if (ws != ws_)
+        break;
       update_recv_tp();
       push_resp_data(message, length);
       break;
@@ -422,8 +1036,9 @@ void SpeechConnection::onMessage(uWS::WebSocket<uWS::CLIENT> *ws,
 }
 
 void SpeechConnection::onError(void* userdata) {
-  KLOGI(CONN_TAG, "uws error: userdata %p, stage %d", userdata, static_cast<int>(stage_));
-  // notify_initialize();
+  ConnectAttempt* attempt = reinterpret_cast<ConnectAttempt*>(userdata);
+  KLOGI(CONN_TAG, "uws error: connect to %s failed, stage %d",
+      attempt->cand.addr.c_str(), static_cast<int>(stage_));
 #ifdef ROKID_UPLOAD_TRACE
   shared_ptr<TraceEvent> ev = make_shared<TraceEvent>();
   ev->type = TRACE_EVENT_TYPE_SYS;
@@ -432,29 +1047,41 @@ void SpeechConnection::onError(void* userdata) {
   ev->add_key_value("service", service_type_);
   trace_uploader_->put(ev);
 #endif
-  if (ws_) {
-    // lock stage_mutex_ for onDisconnection
-    lock_guard<mutex> locker(stage_mutex_);
-    ws_->close();
-  } else {
-    // ws_ == nullptr, stage_ must be CONNECTING|CLOSED
-    // stage_mutex_ is already locked
-    push_status_resp(BinRespType::ERROR);
-    update_reconn_tp(options_.reconn_interval);
-    if (stage_ != ConnectStage::CLOSED) {
-      stage_ = ConnectStage::DISCONN;
-      stage_changed_.notify_all();
-    }
-  }
+  // stage_mutex_ is already locked if invoked in hub_.connect
+  LoopStageLocker locker(stage_mutex_, loop_lock_depth_);
+  // tls or websocket upgrade failed if handshake started
+  attempt->failure = tls_cache_.take_handshake_started(attempt->cand.addr,
+      attempt->cand.port) ? ConnectFailure::TLS : ConnectFailure::TCP;
+  remove_attempt(attempt);
+  attempt_failed(attempt);
+  delete attempt;
 }
 
 void SpeechConnection::onPong(uWS::WebSocket<uWS::CLIENT> *ws,
     char* message, size_t length) {
   KLOGV(CONN_TAG, "uws recv pong: stage %d", static_cast<int>(stage_));
+  if (ws != ws_)
+    return;
+  LoopStageLocker locker(stage_mutex_, loop_lock_depth_);
+  // pong may answer an earlier ping, no rtt sample then
+  bool probed_again = missed_probes_ > 0;
   update_recv_tp();
+  if (ping_outstanding_) {
+    ping_outstanding_ = false;
+    if (probed_again)
+      return;
+    uint32_t ms = duration_cast<milliseconds>(
+        SteadyClock::now() - ping_sent_tp_).count();
+    update_rtt(ms);
+    // path rtt without queueing, auth rtt includes server processing
+    if (min_rtt_ == 0 || ms < min_rtt_) {
+      min_rtt_ = ms ? ms : 1;
+      stats_.min_rtt_ms = min_rtt_;
+    }
+  }
 }
 
-bool SpeechConnection::auth() {
+bool SpeechConnection::auth(WebSocket<uWS::CLIENT>* ws) {
   AuthRequest req;
   const char* svc = service_type_.c_str();
   string ts = timestamp();
@@ -512,7 +1139,7 @@ bool SpeechConnection::auth() {
   ev->add_key_value("key", options_.key);
   trace_uploader_->put(ev);
 #endif
-  ws_->send(buf.data(), buf.length(), OpCode::BINARY);
+  ws->send(buf.data(), buf.length(), OpCode::BINARY);
   return true;
 }
 
@@ -603,15 +1230,31 @@ bool SpeechConnection::handle_auth_result(char* message, size_t length,
   return false;
 }
 
-bool SpeechConnection::ensure_connection_available(uint32_t timeout) {
+void SpeechConnection::set_stage(ConnectStage stage) {
+  stage_ = stage;
+  ready_conn_.store(stage == ConnectStage::READY ? ready_id_ : 0,
+      std::memory_order_release);
+}
+
+bool SpeechConnection::post_req(const string& buf, uint32_t timeout) {
+  return post_reqs(&buf, 1, timeout);
+}
+
+bool SpeechConnection::post_reqs(const string* bufs, uint32_t count,
+    uint32_t timeout) {
+  uint32_t i;
   unique_lock<mutex> locker(stage_mutex_);
   if (stage_ == ConnectStage::PAUSED) {
-    stage_ = ConnectStage::DISCONN;
+    set_stage(ConnectStage::DISCONN);
     update_reconn_tp(0);
     stage_changed_.notify_all();
   }
   auto tp = SteadyClock::now() + milliseconds(timeout);
   while (stage_ != ConnectStage::READY) {
+    if (queue_early_reqs(bufs, count)) {
+      update_voice_tp();
+      return true;
+    }
     if (timeout == 0)
       stage_changed_.wait(locker);
     else {
@@ -619,35 +1262,307 @@ bool SpeechConnection::ensure_connection_available(uint32_t timeout) {
         return false;
     }
   }
+  first_req_sent();
+  update_voice_tp();
+  for (i = 0; i < count; ++i)
+    ws_send(bufs[i].data(), bufs[i].length(), OpCode::BINARY);
+  return true;
+}
+
+bool SpeechConnection::queue_early_reqs(const string* bufs,
+    uint32_t count) {
+  uint32_t bytes = 0;
+  uint32_t i;
+
+  if (!options_.optimistic_auth)
+    return false;
+  if (stage_ != ConnectStage::CONNECTING
+      && stage_ != ConnectStage::AUTHORIZING)
+    return false;
+  for (i = 0; i < count; ++i)
+    bytes += bufs[i].length();
+  if (early_bytes_ + bytes > MAX_EARLY_BYTES)
+    return false;
+  for (i = 0; i < count; ++i) {
+    early_reqs_.push_back(bufs[i]);
+    ++stats_.early_req_count;
+    if (early_ws_) {
+      post_send(SendItemType::EARLY_FRAME, early_gen_, bufs[i].data(),
+          bufs[i].length(), OpCode::BINARY);
+      first_req_sent();
+    }
+  }
+  early_bytes_ += bytes;
   return true;
 }
 
+void SpeechConnection::flush_early_reqs(WebSocket<uWS::CLIENT>* ws) {
+  list<string>::iterator it;
+  if (early_reqs_.empty())
+    return;
+  for (it = early_reqs_.begin(); it != early_reqs_.end(); ++it)
+    ws->send(it->data(), it->length(), OpCode::BINARY);
+  first_req_sent();
+}
+
+void SpeechConnection::clear_early_reqs() {
+  early_reqs_.clear();
+  early_bytes_ = 0;
+  early_ws_ = NULL;
+}
+
+void SpeechConnection::first_req_sent() {
+  if (first_req_pending_) {
+    first_req_pending_ = false;
+    stats_.last_first_req_ms = duration_cast<milliseconds>(
+        SteadyClock::now() - connect_tp_).count();
+    KLOGI(CONN_TAG, "first request sent %u ms after connect start",
+        stats_.last_first_req_ms);
+  }
+}
+
 void SpeechConnection::push_status_resp(BinRespType tp) {
   SpeechBinaryResp* bin_resp;
   KLOGV(CONN_TAG, "push status response to list: %d", static_cast<int>(tp));
-  bin_resp = (SpeechBinaryResp*)malloc(sizeof(SpeechBinaryResp));
-  bin_resp->length = 0;
+  bin_resp = alloc_resp(0);
   bin_resp->type = tp;
-  lock_guard<mutex> locker(resp_mutex_);
-  responses_.push_back(bin_resp);
-  resp_cond_.notify_one();
+  append_resp(bin_resp);
 }
 
 void SpeechConnection::push_resp_data(char* msg, size_t length) {
   SpeechBinaryResp* bin_resp;
-  bin_resp = (SpeechBinaryResp*)malloc(length + sizeof(SpeechBinaryResp));
-  bin_resp->length = length;
+  bin_resp = alloc_resp(length);
   bin_resp->type = BinRespType::DATA;
   memcpy(bin_resp->data, msg, length);
-  lock_guard<mutex> locker(resp_mutex_);
-  responses_.push_back(bin_resp);
-  resp_cond_.notify_one();
+  append_resp(bin_resp);
+}
+
+SpeechBinaryResp* SpeechConnection::alloc_resp(uint32_t length) {
+  SpeechBinaryResp* resp = NULL;
+  uint32_t cap = (length + RESP_BUFFER_ALIGN - 1) & ~(RESP_BUFFER_ALIGN - 1);
+  if (free_resps_.try_pop(resp)) {
+    if (resp->capacity < length) {
+      resp = (SpeechBinaryResp*)realloc(resp, cap + sizeof(SpeechBinaryResp));
+      resp->capacity = cap;
+    }
+  } else {
+    resp = (SpeechBinaryResp*)malloc(cap + sizeof(SpeechBinaryResp));
+    resp->capacity = cap;
+  }
+  resp->next = NULL;
+  resp->length = length;
+  return resp;
+}
+
+void SpeechConnection::append_resp(SpeechBinaryResp* resp) {
+  resp->next = NULL;
+  if (overflow_count_.load(std::memory_order_acquire) > 0
+      || !resps_.try_push(resp)) {
+    // recv thread not keep up, rare
+    lock_guard<mutex> locker(overflow_mutex_);
+    if (overflow_tail_)
+      overflow_tail_->next = resp;
+    else
+      overflow_head_ = resp;
+    overflow_tail_ = resp;
+    overflow_count_.fetch_add(1, std::memory_order_release);
+  }
+  resp_event_.notify();
+}
+
+SpeechBinaryResp* SpeechConnection::pop_resp() {
+  SpeechBinaryResp* resp;
+  if (resps_.try_pop(resp))
+    return resp;
+  if (overflow_count_.load(std::memory_order_acquire) == 0)
+    return NULL;
+  lock_guard<mutex> locker(overflow_mutex_);
+  // responses pushed to 'resps_' before the overflow ones
+  if (resps_.try_pop(resp))
+    return resp;
+  resp = overflow_head_;
+  if (resp == NULL)
+    return NULL;
+  overflow_head_ = resp->next;
+  if (overflow_head_ == NULL)
+    overflow_tail_ = NULL;
+  overflow_count_.fetch_sub(1, std::memory_order_release);
+  return resp;
+}
+
+SpeechBinaryResp* SpeechConnection::wait_resp(uint32_t timeout) {
+  SteadyClock::time_point deadline = SteadyClock::now()
+    + milliseconds(timeout);
+  SteadyClock::time_point now;
+  SpeechBinaryResp* resp;
+  uint32_t key;
+
+  while ((resp = pop_resp()) == NULL) {
+    key = resp_event_.prepare_wait();
+    resp = pop_resp();
+    if (resp) {
+      resp_event_.cancel_wait(key);
+      break;
+    }
+    if (timeout == 0) {
+      resp_event_.wait(key);
+      continue;
+    }
+    now = SteadyClock::now();
+    if (now >= deadline) {
+      resp_event_.cancel_wait(key);
+      break;
+    }
+    resp_event_.wait_for(key,
+        duration_cast<milliseconds>(deadline - now).count() + 1);
+  }
+  return resp;
+}
+
+void SpeechConnection::recycle_resp(SpeechBinaryResp* resp) {
+  if (!free_resps_.try_push(resp))
+    free(resp);
+}
+
+void SpeechConnection::clear_resps() {
+  SpeechBinaryResp* it;
+  while ((it = pop_resp()) != NULL)
+    free(it);
+  while (free_resps_.try_pop(it))
+    free(it);
+  // 'last_resp_' maybe still referenced by recv thread,
+  // recycled at next 'recv' or freed in destructor
 }
 
 void SpeechConnection::ws_send(const char* msg, size_t length, uWS::OpCode op) {
-  if (ws_) {
-    KLOGV(CONN_TAG, "SpeechConnection.ws_send: %lu bytes", length);
-    ws_->send(msg, length, op);
+  if (stage_ != ConnectStage::READY)
+    return;
+  KLOGV(CONN_TAG, "SpeechConnection.ws_send: %lu bytes", length);
+  post_send(SendItemType::FRAME, ready_id_, msg, length, op);
+}
+
+void SpeechConnection::post_send(SendItemType type, uint32_t target,
+    const char* msg, size_t length, OpCode op) {
+  lock_guard<mutex> locker(send_mutex_);
+  send_queue_.resize(send_queue_.size() + 1);
+  SendItem& item = send_queue_.back();
+  item.type = type;
+  item.op = op;
+  item.target = target;
+  if (length)
+    item.data.assign(msg, length);
+  if (type == SendItemType::FRAME)
+    send_posted_bytes_ += length;
+  // wake up loop thread only once for a batch
+  if (send_queue_.size() == 1 && send_async_)
+    send_async_->send();
+}
+
+void SpeechConnection::post_close(SendItemType type) {
+  if (stage_ != ConnectStage::READY || close_posted_)
+    return;
+  close_posted_ = true;
+  post_send(type, ready_id_, NULL, 0, OpCode::BINARY);
+}
+
+bool SpeechConnection::drain_send_queue() {
+  WebSocket<uWS::CLIENT>* corked = NULL;
+  bool keepalive = false;
+  uint32_t frames = 0;
+  uint64_t bytes = 0;
+  size_t i;
+  int v;
+
+  send_mutex_.lock();
+  send_batch_.swap(send_queue_);
+  send_posted_bytes_ = 0;
+  send_mutex_.unlock();
+  for (i = 0; i < send_batch_.size(); ++i) {
+    SendItem& item = send_batch_[i];
+    switch (item.type) {
+      case SendItemType::FRAME:
+        if (ws_ == NULL || item.target != ready_id_)
+          break;
+#ifdef TCP_CORK
+        // coalesce frames of the batch into less tcp segments
+        if (corked == NULL && i + 1 < send_batch_.size()) {
+          corked = ws_;
+          v = 1;
+          setsockopt(corked->getFd(), IPPROTO_TCP, TCP_CORK, &v, sizeof(v));
+        }
+#endif
+        ws_->send(item.data.data(), item.data.length(), item.op);
+        ++frames;
+        bytes += item.data.length();
+        break;
+      case SendItemType::EARLY_FRAME:
+        if (early_ws_ == NULL || item.target != early_gen_)
+          break;
+        early_ws_->send(item.data.data(), item.data.length(), item.op);
+        ++frames;
+        bytes += item.data.length();
+        break;
+      case SendItemType::CLOSE:
+        if (ws_ && item.target == ready_id_)
+          ws_->close();
+        break;
+      case SendItemType::TERMINATE:
+        if (ws_ && item.target == ready_id_)
+          ws_->terminate();
+        break;
+      case SendItemType::CLOSE_ALL:
+        hub_.getDefaultGroup<uWS::CLIENT>().close();
+        stop_send_async();
+        break;
+      case SendItemType::KEEPALIVE:
+        keepalive = true;
+        break;
+    }
+  }
+#ifdef TCP_CORK
+  if (corked && corked == ws_) {
+    v = 0;
+    setsockopt(corked->getFd(), IPPROTO_TCP, TCP_CORK, &v, sizeof(v));
+  }
+#endif
+  send_batch_.clear();
+  if (frames) {
+    lock_guard<mutex> locker(send_mutex_);
+    ++send_batches_;
+    send_frames_ += frames;
+    sent_bytes_ += bytes;
+  }
+  return keepalive;
+}
+
+void SpeechConnection::on_send_async(uS::Async* async) {
+  SpeechConnection* self = reinterpret_cast<SpeechConnection*>(
+      async->getData());
+  self->count_wakeup();
+  if (self->drain_send_queue()) {
+    // keepalive deadline changed
+    LoopStageLocker locker(self->stage_mutex_, self->loop_lock_depth_);
+    self->run_keepalive();
+  }
+}
+
+void SpeechConnection::start_send_async() {
+  // items posted to previous connections
+  drain_send_queue();
+  lock_guard<mutex> locker(send_mutex_);
+  if (send_async_)
+    return;
+  send_async_ = new uS::Async(hub_.getLoop());
+  send_async_->setData(this);
+  send_async_->start(on_send_async);
+}
+
+void SpeechConnection::stop_send_async() {
+  lock_guard<mutex> locker(send_mutex_);
+  if (send_async_) {
+    // uS::Async deleted by uWS after closed
+    send_async_->close();
+    send_async_ = NULL;
   }
 }
 
@@ -659,6 +1574,11 @@ PrepareOptions::PrepareOptions() {
   ping_interval = 30000;
   no_resp_timeout = 45000;
   conn_duration = 7200;
+  warm_standby = false;
+  dns_ttl = 300;
+  race_delay = 250;
+  tcp_user_timeout = 10000;
+  optimistic_auth = false;
 }
 
 PrepareOptions& PrepareOptions::operator = (const PrepareOptions& options) {
@@ -673,6 +1593,14 @@ PrepareOptions& PrepareOptions::operator = (const PrepareOptions& options) {
   this->ping_interval = options.ping_interval;
   this->no_resp_timeout = options.no_resp_timeout;
   this->conn_duration = options.conn_duration;
+  this->warm_standby = options.warm_standby;
+  this->tls_session_file = options.tls_session_file;
+  this->dns_ttl = options.dns_ttl;
+  this->host_addrs = options.host_addrs;
+  this->backup_endpoints = options.backup_endpoints;
+  this->race_delay = options.race_delay;
+  this->tcp_user_timeout = options.tcp_user_timeout;
+  this->optimistic_auth = options.optimistic_auth;
   return *this;
 }
 
@@ -1,14 +1,20 @@
 #pragma once
 
 #include <assert.h>
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
 #include <list>
+#include <vector>
 #include "speech_common.h"
 #include "Hub.h"
 #include "rlog.h"
 #include "alt_chrono.h"
+#include "tls_session_cache.h"
+#include "endpoint_selector.h"
+#include "reconn_policy.h"
+#include "lockfree_queue.h"
 #ifdef ROKID_UPLOAD_TRACE
 #include "trace-uploader.h"
 #endif
@@ -46,12 +52,54 @@ enum class BinRespType {
   CLOSED
 };
 
+// operations posted to uWS loop thread
+enum class SendItemType {
+  FRAME = 0,
+  // frame to connection authorizing, optimistic auth
+  EARLY_FRAME,
+  CLOSE,
+  TERMINATE,
+  // close all connections
+  CLOSE_ALL,
+  // keepalive deadline changed
+  KEEPALIVE
+};
+
 typedef struct {
+  SendItemType type;
+  uWS::OpCode op;
+  // FRAME, CLOSE, TERMINATE: 'ready_id_' of target connection
+  // EARLY_FRAME: 'early_gen_' of target connection
+  // discarded if target connection gone
+  uint32_t target;
+  std::string data;
+} SendItem;
+
+typedef struct SpeechBinaryResp {
+  struct SpeechBinaryResp* next;
   BinRespType type;
   uint32_t length;
+  // bytes of 'data' allocated
+  uint32_t capacity;
   char data[];
 } SpeechBinaryResp;
 
+// one connect attempt of connection racing
+// passed to uWS as user data of the connecting socket
+typedef struct {
+  ConnectCandidate cand;
+  // connect round this attempt belongs to
+  uint32_t round;
+  SteadyClock::time_point start_tp;
+  SteadyClock::time_point connected_tp;
+  SteadyClock::time_point auth_tp;
+  uWS::WebSocket<uWS::CLIENT>* ws;
+  uint32_t tls_ms;
+  ConnectFailure failure;
+  bool tls_resumed;
+  bool has_tls_result;
+} ConnectAttempt;
+
 #ifdef SPEECH_STATISTIC
 typedef struct {
   int32_t id;
@@ -60,10 +108,25 @@ typedef struct {
 } TraceInfo;
 #endif
 
+// 发送链路估计
+typedef struct {
+  // bytes per second left socket send buffer, smoothed, 0: unknown
+  // not more than voice sent if link not saturated
+  uint32_t throughput;
+  // rtt measured by ping/pong (milliseconds)
+  uint32_t srtt;
+  // min rtt of current connection, 0: unknown
+  uint32_t min_rtt;
+  // see 'send_backlog'
+  uint32_t backlog;
+} LinkEstimate;
+
 class SpeechConnection {
 public:
   SpeechConnection();
 
+  ~SpeechConnection();
+
   void initialize(int32_t ws_buf_size, const PrepareOptions& options, const char* svc);
 
   void release();
@@ -77,34 +140,41 @@ public:
       return ConnectionOpResult::INVALID_PB_OBJ;
     }
     KLOGV(CONN_TAG, "SpeechConnection.send: pb serialize result %lu bytes", buf.length());
-    if (!ensure_connection_available(timeout)) {
+    if (!post_req(buf, timeout)) {
       KLOGI(CONN_TAG, "send: connection not available");
       return ConnectionOpResult::CONNECTION_NOT_AVAILABLE;
     }
-    update_voice_tp();
-    ws_send(buf.data(), buf.length(), uWS::OpCode::BINARY);
     return ConnectionOpResult::SUCCESS;
   }
 
+  // requests serialized by caller, sent in order
+  // wait connection available once, posted to uWS loop thread together
+  ConnectionOpResult send_batch(const std::vector<std::string>& bufs,
+      uint32_t timeout = 0) {
+    if (!post_reqs(bufs.data(), bufs.size(), timeout)) {
+      KLOGI(CONN_TAG, "send: connection not available");
+      return ConnectionOpResult::CONNECTION_NOT_AVAILABLE;
+    }
+    return ConnectionOpResult::SUCCESS;
+  }
+
+  // 'res' may reference the received buffer (see BytesRef),
+  // the buffer keep valid until next invocation of 'recv'
+  // invoked by one thread
   template <typename PBT>
   ConnectionOpResult recv(PBT& res, uint32_t timeout) {
     SpeechBinaryResp* resp_data;
-    std::unique_lock<std::mutex> locker(resp_mutex_);
 
-    if (responses_.empty()) {
-      if (timeout == 0)
-        resp_cond_.wait(locker);
-      else
-        resp_cond_.wait_for(locker, std::chrono::milliseconds(timeout));
+    if (last_resp_) {
+      recycle_resp(last_resp_);
+      last_resp_ = NULL;
     }
-    if (!responses_.empty()) {
-      resp_data = responses_.front();
-      assert(resp_data);
-      responses_.pop_front();
+    resp_data = wait_resp(timeout);
+    if (resp_data) {
       if (resp_data->type == BinRespType::DATA) {
         bool r = res.ParseFromArray(resp_data->data,
             resp_data->length);
-        free(resp_data);
+        last_resp_ = resp_data;
         if (!r) {
           KLOGW(CONN_TAG, "recv: protobuf parse failed");
           return ConnectionOpResult::INVALID_PB_DATA;
@@ -112,10 +182,11 @@ public:
         return ConnectionOpResult::SUCCESS;
       } else if (resp_data->type == BinRespType::ERROR) {
         KLOGI(CONN_TAG, "recv: failed, connection broken");
-        free(resp_data);
+        recycle_resp(resp_data);
         return ConnectionOpResult::CONNECTION_BROKEN;
       }
       KLOGD(CONN_TAG, "recv return, connection closed");
+      recycle_resp(resp_data);
       return ConnectionOpResult::NOT_READY;
     }
     KLOGD(CONN_TAG, "recv return, timeout");
@@ -129,18 +200,68 @@ public:
   // 立即尝试重连
   void reconn();
 
+  // 如连接已暂停(PAUSED), 立即在后台开始重连, 不等待连接就绪
+  void prewarm();
+
+  void get_stats(ConnectionStats& stats);
+
+  // 当前就绪连接的标识, 每次连接就绪时变化
+  // 0: 连接未就绪
+  // 连接就绪时不加锁
+  uint32_t ready_id();
+
+  // 就绪连接上尚未发送到网络的字节数
+  // 已提交未被网络线程写入, 及socket发送缓冲区中未发送/未确认的数据
+  // 0: 连接未就绪
+  uint32_t send_backlog();
+
+  // 采样发送吞吐量(距上次调用), 应由一个线程周期调用
+  // return false if connection not ready
+  bool estimate_link(LinkEstimate& est);
+
 private:
   void run();
 
-  void keepalive_run();
+  // uWS loop thread, ping, dead peer detect, idle close
+  // must lock 'stage_mutex_' before invoke
+  // return milliseconds to next keepalive, 0 if connection closed
+  uint32_t keepalive();
+
+  // keepalive and arm 'keepalive_timer_' to next deadline
+  // must lock 'stage_mutex_' before invoke
+  void run_keepalive();
+
+  void stop_keepalive();
+
+  static void on_keepalive_timer(uS::Timer* timer);
+
+  void count_wakeup();
 
   void prepare_hub();
 
   void connect();
 
-  bool auth();
+  // start connect to next candidate of current round
+  // must lock 'stage_mutex_' before invoke
+  void launch_attempt();
+
+  // must lock 'stage_mutex_' before invoke
+  void attempt_failed(ConnectAttempt* attempt);
+
+  // must lock 'stage_mutex_' before invoke
+  void attempt_won(ConnectAttempt* attempt);
+
+  void remove_attempt(ConnectAttempt* attempt);
+
+  void stop_race_timer();
+
+  static void on_race_timer(uS::Timer* timer);
+
+  void on_dns_resolved();
 
-  std::string get_server_uri();
+  bool auth(uWS::WebSocket<uWS::CLIENT>* ws);
+
+  std::string get_server_uri(const ConnectCandidate& cand);
 
   void onConnection(uWS::WebSocket<uWS::CLIENT> *ws);
 
@@ -163,14 +284,76 @@ private:
 
   bool handle_auth_result(char* message, size_t length, uWS::OpCode opcode);
 
-  bool ensure_connection_available(uint32_t timeout);
+  // wait connection available, post 'buf' to uWS loop thread
+  // or queue it behind auth request (optimistic auth)
+  bool post_req(const std::string& buf, uint32_t timeout);
+
+  // as 'post_req', 'count' requests, all or none queued
+  bool post_reqs(const std::string* bufs, uint32_t count, uint32_t timeout);
+
+  // optimistic auth, queue requests before connection ready
+  // must lock 'stage_mutex_' before invoke
+  bool queue_early_reqs(const std::string* bufs, uint32_t count);
+
+  // 'ready_conn_' follows 'stage_'
+  // must lock 'stage_mutex_' before invoke
+  void set_stage(ConnectStage stage);
+
+  // write queued requests behind auth request
+  // must lock 'stage_mutex_' before invoke
+  void flush_early_reqs(uWS::WebSocket<uWS::CLIENT>* ws);
+
+  // work thread, sender threads may be appending to 'early_reqs_'
+  // must lock 'stage_mutex_' before invoke
+  void clear_early_reqs();
+
+  // must lock 'stage_mutex_' before invoke
+  void first_req_sent();
 
   void push_status_resp(BinRespType tp);
 
   void push_resp_data(char* msg, size_t length);
 
+  // producer (uWS loop thread) side
+  SpeechBinaryResp* alloc_resp(uint32_t length);
+
+  void append_resp(SpeechBinaryResp* resp);
+
+  // recv thread side
+  // 0: wait without timeout, return NULL if timeout
+  SpeechBinaryResp* wait_resp(uint32_t timeout);
+
+  SpeechBinaryResp* pop_resp();
+
+  void recycle_resp(SpeechBinaryResp* resp);
+
+  // free queued and reusable responses
+  // no responses appended concurrently
+  void clear_resps();
+
+  // post frame to ready connection
+  // must lock 'stage_mutex_' before invoke
   void ws_send(const char* msg, size_t length, uWS::OpCode op);
 
+  void post_send(SendItemType type, uint32_t target, const char* msg,
+      size_t length, uWS::OpCode op);
+
+  // close or terminate ready connection in uWS loop thread
+  // must lock 'stage_mutex_' before invoke
+  void post_close(SendItemType type);
+
+  // uWS loop thread, write posted frames in one batch
+  // return true if keepalive requested
+  bool drain_send_queue();
+
+  static void on_send_async(uS::Async* async);
+
+  // uWS loop thread, before hub_.run()
+  void start_send_async();
+
+  // uWS loop thread, no connection needed, let hub_.run() return
+  void stop_send_async();
+
 #ifdef SPEECH_STATISTIC
   bool send_trace_info();
 
@@ -181,31 +364,157 @@ private:
 
   void update_reconn_tp(uint32_t ms);
 
+  // wait time decided by 'reconn_policy_'
+  void schedule_reconn(ConnectFailure cause);
+
   void update_ping_tp();
 
   void update_recv_tp();
 
   void update_voice_tp();
 
+  bool session_active(SteadyClock::time_point now);
+
+  std::chrono::milliseconds active_ping_interval();
+
+  // no pong longer than this, regard peer as dead
+  std::chrono::milliseconds dead_timeout();
+
+  void update_rtt(uint32_t ms);
+
+  // tcp keepalive, TCP_USER_TIMEOUT
+  void config_socket(uWS::WebSocket<uWS::CLIENT>* ws);
+
+  // must lock 'stage_mutex_' before invoke
+  uint32_t send_backlog_locked();
+
+  // bytes in socket send buffer of 'ws_fd_'
+  // must lock 'stage_mutex_' before invoke
+  uint32_t socket_outq();
+
 private:
   std::mutex req_mutex_;
-  std::mutex resp_mutex_;
-  std::condition_variable resp_cond_;
-  std::list<SpeechBinaryResp*> responses_;
+  // responses fifo, uWS loop thread --> recv thread, no lock
+  MpmcQueue<SpeechBinaryResp*> resps_;
+  // responses appended while 'resps_' full, or while this list not
+  // empty, so order kept: 'resps_' drained before this list
+  // linked by 'SpeechBinaryResp.next'
+  std::mutex overflow_mutex_;
+  SpeechBinaryResp* overflow_head_;
+  SpeechBinaryResp* overflow_tail_;
+  std::atomic<uint32_t> overflow_count_;
+  // response buffers returned by recv thread, reused by loop thread
+  // avoid malloc per message
+  MpmcQueue<SpeechBinaryResp*> free_resps_;
+  EventCount resp_event_;
+  // last DATA response returned by 'recv', recv thread only
+  SpeechBinaryResp* last_resp_;
   std::mutex stage_mutex_;
   std::condition_variable stage_changed_;
   ConnectStage stage_;
 
   std::thread* work_thread_;
-  std::thread* keepalive_thread_;
+  // uWS loop thread only, armed to the nearest keepalive deadline
+  // (ping, dead peer, no response, conn_duration, trace flush)
+  uS::Timer* keepalive_timer_;
   uWS::Hub hub_;
+  // ready connection, work thread only
   uWS::WebSocket<uWS::CLIENT>* ws_;
+  // socket fd of 'ws_', -1 if none
+  // set/cleared by work thread with 'stage_mutex_' locked,
+  // other threads read it with lock, never dereference 'ws_'
+  int ws_fd_;
   PrepareOptions options_;
   std::string service_type_;
   SteadyClock::time_point reconn_timepoint_;
   SteadyClock::time_point lastest_ping_tp_;
   SteadyClock::time_point lastest_recv_tp_;
   SteadyClock::time_point lastest_voice_tp_;
+  // connection timeline
+  SteadyClock::time_point connect_tp_;
+  // protected by 'stage_mutex_'
+  ConnectionStats stats_;
+  TlsSessionCache tls_cache_;
+  EndpointSelector endpoints_;
+  // connection racing, accessed in work thread (uWS loop)
+  std::vector<ConnectCandidate> race_cands_;
+  // attempts of current round, not finished yet
+  std::vector<ConnectAttempt*> race_attempts_;
+  uint32_t race_round_;
+  // index of next candidate to connect
+  uint32_t race_next_;
+  // attempts of current round, not failed yet
+  uint32_t race_pending_;
+  bool race_won_;
+  uS::Timer* race_timer_;
+  // most serious failure of current round
+  ConnectFailure race_failure_;
+  ReconnPolicy reconn_policy_;
+  // reason of closing ready connection by ourself
+  // NONE: reconnect immediately
+  ConnectFailure close_reason_;
+  // > 0 if 'stage_mutex_' locked by work thread (uWS loop)
+  // uWS invokes onError/onDisconnection synchronously in hub_.connect,
+  // close and terminate, they not lock again then
+  // work thread only
+  uint32_t loop_lock_depth_;
+  // rtt measured by ping/pong (milliseconds)
+  // protected by 'stage_mutex_'
+  uint32_t srtt_;
+  uint32_t rttvar_;
+  SteadyClock::time_point ping_sent_tp_;
+  // ping sent, pong not received
+  bool ping_outstanding_;
+  // pings expired without pong in a row, reset by any received frame
+  uint32_t missed_probes_;
+  // lastest time send backlog observed by keepalive
+  // dead peer timer starts after it
+  SteadyClock::time_point backlog_tp_;
+  // protected by 'stage_mutex_'
+  uint32_t ready_id_;
+  // 'ready_id_' if stage READY, else 0, read without lock
+  std::atomic<uint32_t> ready_conn_;
+  // optimistic auth, requests queued before connection ready
+  // protected by 'stage_mutex_', sender threads append,
+  // work thread flushes and clears (onDisconnection locks too)
+  std::list<std::string> early_reqs_;
+  uint32_t early_bytes_;
+  // connection 'early_reqs_' written to, behind auth request
+  // changed by work thread with 'stage_mutex_' locked,
+  // read by sender threads with lock, by 'drain_send_queue' without
+  uWS::WebSocket<uWS::CLIENT>* early_ws_;
+  // changed when 'early_ws_' assigned
+  uint32_t early_gen_;
+  // no request sent since connect started
+  bool first_req_pending_;
+  // close of ready connection posted, not disconnected yet
+  bool close_posted_;
+  // frames from other threads, drained by uWS loop thread
+  std::mutex send_mutex_;
+  std::vector<SendItem> send_queue_;
+  // NULL if hub_ not running
+  uS::Async* send_async_;
+  uint32_t send_batches_;
+  uint32_t send_frames_;
+  // bytes of FRAME items in 'send_queue_'
+  uint32_t send_posted_bytes_;
+  uint32_t max_send_backlog_;
+  // bytes written to sockets
+  uint64_t sent_bytes_;
+  // throughput sample, protected by 'stage_mutex_'
+  uint64_t sample_acked_;
+  SteadyClock::time_point sample_tp_;
+  // 'ready_id_' of connection sampled
+  uint32_t sample_id_;
+  uint32_t throughput_;
+  uint32_t min_rtt_;
+  // wakeups of work thread and uWS loop, protected by 'send_mutex_'
+  uint32_t wakeups_;
+  uint32_t minute_wakeups_;
+  uint32_t last_minute_wakeups_;
+  SteadyClock::time_point wakeup_minute_tp_;
+  // uWS loop thread only, swapped with 'send_queue_'
+  std::vector<SendItem> send_batch_;
 #ifdef SPEECH_STATISTIC
   std::list<TraceInfo> _trace_infos;
 #endif
@@ -0,0 +1,241 @@
+#include "timer_wheel.h"
+
+#define NIL_NODE 0xffffffff
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+// max ticks of a timer, covered by all levels
+#define MAX_TIMER_TICKS ((1ULL << (TIMER_WHEEL_SLOT_BITS \
+        * TIMER_WHEEL_LEVELS)) - 1)
+
+using std::mutex;
+using std::lock_guard;
+using std::unique_lock;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+
+namespace rokid {
+namespace speech {
+
+TimerWheel* TimerWheel::instance() {
+  // never destroyed, timer thread may run till process exit
+  static TimerWheel* wheel = new TimerWheel();
+  return wheel;
+}
+
+TimerWheel::TimerWheel() : free_(NIL_NODE), cur_tick_(0), active_(0),
+    running_(0) {
+  uint32_t i;
+  for (i = 0; i < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS; ++i)
+    slots_[i] = NIL_NODE;
+  for (i = 0; i < TIMER_WHEEL_LEVELS; ++i)
+    counts_[i] = 0;
+  base_tp_ = SteadyClock::now();
+  std::thread th([this] { run(); });
+  thread_id_ = th.get_id();
+  th.detach();
+}
+
+uint64_t TimerWheel::now_tick() {
+  return duration_cast<milliseconds>(SteadyClock::now() - base_tp_).count()
+    / TIMER_WHEEL_TICK;
+}
+
+TimerWheel::TimerId TimerWheel::schedule(uint32_t delay, Callback cb) {
+  uint64_t now;
+  uint64_t ticks;
+  uint32_t idx;
+
+  lock_guard<mutex> locker(mutex_);
+  now = now_tick();
+  // all slots empty, catch up with clock
+  if (active_ == 0 && now > cur_tick_)
+    cur_tick_ = now;
+  // one more tick, not fire earlier than 'delay'
+  ticks = (delay + TIMER_WHEEL_TICK - 1) / TIMER_WHEEL_TICK + 1;
+  if (now + ticks <= cur_tick_)
+    ticks = cur_tick_ - now + 1;
+  if (now + ticks - cur_tick_ > MAX_TIMER_TICKS)
+    ticks = MAX_TIMER_TICKS + cur_tick_ - now;
+  if (free_ == NIL_NODE) {
+    nodes_.emplace_back();
+    idx = nodes_.size() - 1;
+    nodes_[idx].gen = 0;
+  } else {
+    idx = free_;
+    free_ = nodes_[idx].next;
+  }
+  Node& node = nodes_[idx];
+  node.cb = std::move(cb);
+  node.expire = now + ticks;
+  link(idx);
+  ++active_;
+  // may expire before the tick timer thread waiting for
+  cond_.notify_one();
+  return (static_cast<uint64_t>(node.gen) << 32) | (idx + 1);
+}
+
+bool TimerWheel::cancel(TimerId id, bool wait) {
+  uint32_t idx = static_cast<uint32_t>(id) - 1;
+  uint32_t gen = static_cast<uint32_t>(id >> 32);
+  Callback cb;
+
+  if (id == 0)
+    return false;
+  unique_lock<mutex> locker(mutex_);
+  if (idx < nodes_.size() && nodes_[idx].gen == gen
+      && nodes_[idx].slot != NIL_NODE) {
+    unlink(idx);
+    // destroy outside lock
+    cb.swap(nodes_[idx].cb);
+    release_node(idx);
+    return true;
+  }
+  if (wait && std::this_thread::get_id() != thread_id_) {
+    while (running_ == id)
+      running_cond_.wait(locker);
+  }
+  return false;
+}
+
+uint32_t TimerWheel::size() {
+  lock_guard<mutex> locker(mutex_);
+  return active_;
+}
+
+void TimerWheel::link(uint32_t idx) {
+  Node& node = nodes_[idx];
+  uint64_t diff = node.expire - cur_tick_;
+  uint32_t level = 0;
+  uint32_t slot;
+
+  while (level < TIMER_WHEEL_LEVELS - 1
+      && diff >= (1ULL << (TIMER_WHEEL_SLOT_BITS * (level + 1))))
+    ++level;
+  slot = level * TIMER_WHEEL_SLOTS + ((node.expire
+        >> (TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK);
+  node.slot = slot;
+  node.prev = NIL_NODE;
+  node.next = slots_[slot];
+  if (node.next != NIL_NODE)
+    nodes_[node.next].prev = idx;
+  slots_[slot] = idx;
+  ++counts_[level];
+}
+
+void TimerWheel::unlink(uint32_t idx) {
+  Node& node = nodes_[idx];
+  if (node.prev != NIL_NODE)
+    nodes_[node.prev].next = node.next;
+  else
+    slots_[node.slot] = node.next;
+  if (node.next != NIL_NODE)
+    nodes_[node.next].prev = node.prev;
+  --counts_[node.slot / TIMER_WHEEL_SLOTS];
+}
+
+void TimerWheel::release_node(uint32_t idx) {
+  Node& node = nodes_[idx];
+  node.slot = NIL_NODE;
+  // id of this node invalid
+  ++node.gen;
+  node.next = free_;
+  free_ = idx;
+  --active_;
+}
+
+void TimerWheel::cascade(uint32_t level, uint32_t slot) {
+  uint32_t idx = slots_[level * TIMER_WHEEL_SLOTS + slot];
+  uint32_t next;
+
+  slots_[level * TIMER_WHEEL_SLOTS + slot] = NIL_NODE;
+  while (idx != NIL_NODE) {
+    next = nodes_[idx].next;
+    --counts_[level];
+    link(idx);
+    idx = next;
+  }
+}
+
+uint64_t TimerWheel::next_wakeup() {
+  uint64_t best = MAX_TIMER_TICKS;
+  uint64_t base;
+  uint32_t shift;
+  uint32_t level;
+  uint32_t k;
+
+  if (counts_[0]) {
+    for (k = 1; k < TIMER_WHEEL_SLOTS; ++k) {
+      if (slots_[(cur_tick_ + k) & SLOT_MASK] != NIL_NODE) {
+        best = k;
+        break;
+      }
+    }
+  }
+  // next non-empty slot of upper levels cascades at its block start
+  for (level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+    if (counts_[level] == 0)
+      continue;
+    shift = TIMER_WHEEL_SLOT_BITS * level;
+    base = cur_tick_ >> shift;
+    for (k = 1; k <= TIMER_WHEEL_SLOTS; ++k) {
+      if (slots_[level * TIMER_WHEEL_SLOTS + ((base + k) & SLOT_MASK)]
+          != NIL_NODE) {
+        if (((base + k) << shift) - cur_tick_ < best)
+          best = ((base + k) << shift) - cur_tick_;
+        break;
+      }
+    }
+  }
+  return best;
+}
+
+void TimerWheel::run() {
+  uint64_t now;
+  uint64_t target;
+  uint32_t level;
+  uint32_t idx;
+  uint32_t* head;
+  Callback cb;
+
+  unique_lock<mutex> locker(mutex_);
+  while (true) {
+    if (active_ == 0) {
+      cond_.wait(locker);
+      continue;
+    }
+    now = now_tick();
+    target = cur_tick_ + next_wakeup();
+    if (target > now) {
+      // ticks before 'target' have nothing to do
+      if (now > cur_tick_)
+        cur_tick_ = now;
+      cond_.wait_until(locker, base_tp_
+          + milliseconds(target * TIMER_WHEEL_TICK));
+      continue;
+    }
+    cur_tick_ = target;
+    for (level = TIMER_WHEEL_LEVELS - 1; level > 0; --level) {
+      if ((target & ((1ULL << (TIMER_WHEEL_SLOT_BITS * level)) - 1)) == 0)
+        cascade(level, (target >> (TIMER_WHEEL_SLOT_BITS * level))
+            & SLOT_MASK);
+    }
+    // slot may be changed by 'cancel' while callback running,
+    // reload head each time
+    head = slots_ + (target & SLOT_MASK);
+    while (*head != NIL_NODE) {
+      idx = *head;
+      unlink(idx);
+      cb.swap(nodes_[idx].cb);
+      running_ = (static_cast<uint64_t>(nodes_[idx].gen) << 32) | (idx + 1);
+      release_node(idx);
+      locker.unlock();
+      cb();
+      cb = nullptr;
+      locker.lock();
+      running_ = 0;
+      running_cond_.notify_all();
+    }
+  }
+}
+
+} // namespace speech
+} // namespace rokid
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include "alt_chrono.h"
+
+// milliseconds per tick
+#define TIMER_WHEEL_TICK 10
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+
+namespace rokid {
+namespace speech {
+
+// 分层时间轮, 进程内所有定时共享一个实例及一个线程
+//   4层, 每层64槽, 精度10ms, 最长约46小时(超出按最长计)
+//   添加/取消O(1), 到期时整槽取出; 低层槽轮转一周时下一层对应槽下沉
+//   线程只在最近非空槽或下沉时刻醒来, 无定时器时不醒
+//   回调在定时器线程执行, 不持有内部锁, 应尽快返回
+class TimerWheel {
+public:
+	typedef std::function<void()> Callback;
+	// 0 is invalid
+	typedef uint64_t TimerId;
+
+	static TimerWheel* instance();
+
+	// invoke 'cb' after 'delay' milliseconds
+	TimerId schedule(uint32_t delay, Callback cb);
+
+	// return false if timer already fired or cancelled
+	// 'wait': callback of 'id' running, wait it return,
+	//         caller must not hold locks acquired by the callback
+	bool cancel(TimerId id, bool wait = true);
+
+	// timers not fired
+	uint32_t size();
+
+private:
+	class Node {
+	public:
+		Callback cb;
+		uint64_t expire;
+		uint32_t prev;
+		uint32_t next;
+		uint32_t slot;
+		uint32_t gen;
+	};
+
+	TimerWheel();
+
+	void run();
+
+	uint64_t now_tick();
+
+	// must lock 'mutex_' before invoke
+	void link(uint32_t idx);
+
+	// must lock 'mutex_' before invoke
+	void unlink(uint32_t idx);
+
+	// must lock 'mutex_' before invoke
+	void release_node(uint32_t idx);
+
+	// move timers of 'slot' at 'level' to lower levels
+	// must lock 'mutex_' before invoke
+	void cascade(uint32_t level, uint32_t slot);
+
+	// ticks to wait from 'cur_tick_', timer may expire or cascade then
+	// must lock 'mutex_' before invoke
+	uint64_t next_wakeup();
+
+private:
+	std::mutex mutex_;
+	std::condition_variable cond_;
+	// 'running_' changed
+	std::condition_variable running_cond_;
+	std::vector<Node> nodes_;
+	// free nodes, linked by 'next'
+	uint32_t free_;
+	// heads of slots
+	uint32_t slots_[TIMER_WHEEL_LEVELS * TIMER_WHEEL_SLOTS];
+	// timers of each level
+	uint32_t counts_[TIMER_WHEEL_LEVELS];
+	SteadyClock::time_point base_tp_;
+	// ticks processed
+	uint64_t cur_tick_;
+	uint32_t active_;
+	// timer of callback running
+	TimerId running_;
+	std::thread::id thread_id_;
+};
+
+} // namespace speech
+} // namespace rokid
@@ -0,0 +1,301 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "tls_session_cache.h"
+#include "rlog.h"
+
+#define TLS_TAG "speech.TlsSessionCache"
+// max bytes of serialized session
+#define MAX_SESSION_DATA_SIZE 8192
+// max records of peers handshake started
+#define MAX_STARTED_PEERS 32
+
+using std::mutex;
+using std::lock_guard;
+using std::string;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
+
+namespace rokid {
+namespace speech {
+
+// SSL_CTX ex data: TlsSessionCache attached to the ctx
+static int ctx_ex_index() {
+  static int idx = SSL_CTX_get_ex_new_index(0, NULL, NULL, NULL, NULL);
+  return idx;
+}
+
+// handshake state of one SSL, race attempts handshake concurrently
+typedef struct {
+  SteadyClock::time_point start_tp;
+  // handshake done, later HANDSHAKE_START/DONE are post handshake messages
+  bool done;
+  // session of the SSL already persisted
+  bool saved;
+} SslState;
+
+static void free_ssl_state(void* parent, void* ptr, CRYPTO_EX_DATA* ad,
+    int idx, long argl, void* argp) {
+  delete reinterpret_cast<SslState*>(ptr);
+}
+
+// SSL ex data: SslState, freed with the SSL
+static int ssl_ex_index() {
+  static int idx = SSL_get_ex_new_index(0, NULL, NULL, NULL, free_ssl_state);
+  return idx;
+}
+
+static SslState* ssl_state(const SSL* ssl) {
+  return reinterpret_cast<SslState*>(SSL_get_ex_data(ssl, ssl_ex_index()));
+}
+
+TlsSessionCache::TlsSessionCache() : ctx_(NULL) {
+}
+
+TlsSessionCache::~TlsSessionCache() {
+  if (ctx_) {
+    SSL_CTX_set_ex_data(ctx_, ctx_ex_index(), NULL);
+    SSL_CTX_sess_set_new_cb(ctx_, NULL);
+    SSL_CTX_set_info_callback(ctx_, NULL);
+  }
+  clear();
+}
+
+void TlsSessionCache::attach(SSL_CTX* ctx, const string& persist_file,
+    const string& primary_name) {
+  if (ctx == NULL) {
+    KLOGW(TLS_TAG, "attach failed: SSL_CTX is null");
+    return;
+  }
+  ctx_ = ctx;
+  persist_file_ = persist_file;
+  primary_name_ = primary_name;
+  SSL_CTX_set_ex_data(ctx, ctx_ex_index(), this);
+  // sessions stored by ourself, not by openssl internal cache
+  SSL_CTX_set_session_cache_mode(ctx,
+      SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(ctx, on_new_session);
+  SSL_CTX_set_info_callback(ctx, on_info);
+  load_session();
+}
+
+void TlsSessionCache::clear() {
+  lock_guard<mutex> locker(mutex_);
+  std::map<string, SSL_SESSION*>::iterator it;
+  for (it = sessions_.begin(); it != sessions_.end(); ++it)
+    SSL_SESSION_free(it->second);
+  sessions_.clear();
+}
+
+bool TlsSessionCache::take_handshake_started(const string& addr,
+    uint32_t port) {
+  char key[80];
+  snprintf(key, sizeof(key), "%s:%u", addr.c_str(), port);
+  lock_guard<mutex> locker(mutex_);
+  return started_peers_.erase(key) > 0;
+}
+
+bool TlsSessionCache::take_handshake_result(int fd, uint32_t& handshake_ms,
+    bool& resumed) {
+  lock_guard<mutex> locker(mutex_);
+  std::map<int, HandshakeResult>::iterator it = results_.find(fd);
+  if (it == results_.end())
+    return false;
+  handshake_ms = it->second.ms;
+  resumed = it->second.resumed;
+  results_.erase(it);
+  return true;
+}
+
+TlsSessionCache* TlsSessionCache::from_ssl(const SSL* ssl) {
+  SSL_CTX* ctx = SSL_get_SSL_CTX(ssl);
+  if (ctx == NULL)
+    return NULL;
+  return reinterpret_cast<TlsSessionCache*>(
+      SSL_CTX_get_ex_data(ctx, ctx_ex_index()));
+}
+
+int TlsSessionCache::on_new_session(SSL* ssl, SSL_SESSION* sess) {
+  TlsSessionCache* self = from_ssl(ssl);
+  if (self == NULL)
+    return 0;
+  const char* name = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+  KLOGV(TLS_TAG, "new session of %s available, cache it", name ? name : "");
+  self->set_session(name ? name : "", sess);
+  // tls1.3 server sends several tickets per handshake,
+  // persist the first one only, avoid disk io for each ticket
+  SslState* state = ssl_state(ssl);
+  if (self->primary_name_ == (name ? name : "")
+      && (state == NULL || !state->saved)) {
+    if (state)
+      state->saved = true;
+    self->save_session();
+  }
+  // take ownership of 'sess'
+  return 1;
+}
+
+void TlsSessionCache::on_info(const SSL* ssl, int where, int ret) {
+  TlsSessionCache* self = from_ssl(ssl);
+  if (self == NULL)
+    return;
+  // tls1.3 post handshake messages (NewSessionTicket) also trigger
+  // HANDSHAKE_START/HANDSHAKE_DONE, ignore them
+  SslState* state = ssl_state(ssl);
+  if (state && state->done)
+    return;
+  SSL* s = const_cast<SSL*>(ssl);
+  lock_guard<mutex> locker(self->mutex_);
+  if (where & SSL_CB_HANDSHAKE_START) {
+    if (state == NULL) {
+      state = new SslState();
+      state->saved = false;
+      SSL_set_ex_data(s, ssl_ex_index(), state);
+    }
+    state->start_tp = SteadyClock::now();
+    state->done = false;
+    // result of closed socket with same fd
+    self->results_.erase(SSL_get_fd(ssl));
+    if (self->results_.size() >= MAX_STARTED_PEERS)
+      self->results_.clear();
+    char key[80];
+    if (peer_key(ssl, key, sizeof(key))) {
+      if (self->started_peers_.size() >= MAX_STARTED_PEERS)
+        self->started_peers_.clear();
+      self->started_peers_[key] = true;
+    }
+    const char* sni = SSL_get_servername(s, TLSEXT_NAMETYPE_host_name);
+    std::map<string, SSL_SESSION*>::iterator it =
+      self->sessions_.find(sni ? sni : "");
+    if (it != self->sessions_.end() && SSL_get_session(s) == NULL) {
+      if (!SSL_set_session(s, it->second))
+        KLOGW(TLS_TAG, "set cached session failed");
+    }
+  } else if ((where & SSL_CB_HANDSHAKE_DONE) && state) {
+    state->done = true;
+    HandshakeResult& r = self->results_[SSL_get_fd(ssl)];
+    r.ms = duration_cast<milliseconds>(
+        SteadyClock::now() - state->start_tp).count();
+    r.resumed = SSL_session_reused(s);
+    KLOGD(TLS_TAG, "tls handshake done, fd %d, %u ms, resumed %d",
+        SSL_get_fd(ssl), r.ms, r.resumed);
+  }
+}
+
+bool TlsSessionCache::peer_key(const SSL* ssl, char* key, size_t size) {
+  int fd = SSL_get_fd(ssl);
+  struct sockaddr_storage sa;
+  socklen_t len = sizeof(sa);
+  if (fd < 0 || getpeername(fd, (struct sockaddr*)&sa, &len) != 0)
+    return false;
+  char addr[INET6_ADDRSTRLEN];
+  if (sa.ss_family == AF_INET) {
+    struct sockaddr_in* sin = (struct sockaddr_in*)&sa;
+    inet_ntop(AF_INET, &sin->sin_addr, addr, sizeof(addr));
+    snprintf(key, size, "%s:%u", addr, ntohs(sin->sin_port));
+  } else if (sa.ss_family == AF_INET6) {
+    struct sockaddr_in6* sin6 = (struct sockaddr_in6*)&sa;
+    inet_ntop(AF_INET6, &sin6->sin6_addr, addr, sizeof(addr));
+    snprintf(key, size, "[%s]:%u", addr, ntohs(sin6->sin6_port));
+  } else
+    return false;
+  return true;
+}
+
+void TlsSessionCache::set_session(const string& name, SSL_SESSION* sess) {
+  lock_guard<mutex> locker(mutex_);
+  std::map<string, SSL_SESSION*>::iterator it = sessions_.find(name);
+  if (it != sessions_.end()) {
+    SSL_SESSION_free(it->second);
+    it->second = sess;
+  } else
+    sessions_[name] = sess;
+}
+
+void TlsSessionCache::load_session() {
+  if (persist_file_.empty())
+    return;
+  FILE* fp = fopen(persist_file_.c_str(), "rb");
+  if (fp == NULL)
+    return;
+  unsigned char buf[MAX_SESSION_DATA_SIZE];
+  size_t len = fread(buf, 1, sizeof(buf), fp);
+  fclose(fp);
+  if (len == 0 || len == sizeof(buf))
+    return;
+  const unsigned char* p = buf;
+  SSL_SESSION* sess = d2i_SSL_SESSION(NULL, &p, len);
+  if (sess == NULL) {
+    KLOGW(TLS_TAG, "load session from %s failed", persist_file_.c_str());
+    return;
+  }
+  if ((long)SSL_SESSION_get_time(sess) + (long)SSL_SESSION_get_timeout(sess)
+      < (long)time(NULL)) {
+    KLOGI(TLS_TAG, "session in %s expired", persist_file_.c_str());
+    SSL_SESSION_free(sess);
+    return;
+  }
+  KLOGI(TLS_TAG, "session loaded from %s", persist_file_.c_str());
+  set_session(primary_name_, sess);
+  lock_guard<mutex> locker(mutex_);
+  saved_data_.assign(reinterpret_cast<char*>(buf), len);
+}
+
+void TlsSessionCache::save_session() {
+  if (persist_file_.empty())
+    return;
+  unsigned char buf[MAX_SESSION_DATA_SIZE];
+  unsigned char* p = buf;
+  int len;
+  {
+    lock_guard<mutex> locker(mutex_);
+    std::map<string, SSL_SESSION*>::iterator it = sessions_.find(primary_name_);
+    if (it == sessions_.end())
+      return;
+    len = i2d_SSL_SESSION(it->second, NULL);
+    if (len <= 0 || len >= (int)sizeof(buf))
+      return;
+    i2d_SSL_SESSION(it->second, &p);
+    // session not changed, already in file
+    if (saved_data_.length() == (size_t)len
+        && memcmp(saved_data_.data(), buf, len) == 0)
+      return;
+  }
+  // session contains resumption secret, readable by owner only
+  string tmp = persist_file_ + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+      S_IRUSR | S_IWUSR);
+  FILE* fp = NULL;
+  if (fd >= 0) {
+    // tmp file left by older version may have wider mode
+    fchmod(fd, S_IRUSR | S_IWUSR);
+    fp = fdopen(fd, "wb");
+    if (fp == NULL)
+      close(fd);
+  }
+  if (fp == NULL) {
+    KLOGW(TLS_TAG, "save session to %s failed", tmp.c_str());
+    return;
+  }
+  bool ok = fwrite(buf, 1, len, fp) == (size_t)len;
+  // data on disk before rename, file not empty after power loss
+  if (ok)
+    ok = fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+  fclose(fp);
+  if (!ok || rename(tmp.c_str(), persist_file_.c_str()) != 0) {
+    KLOGW(TLS_TAG, "save session to %s failed", persist_file_.c_str());
+    remove(tmp.c_str());
+    return;
+  }
+  lock_guard<mutex> locker(mutex_);
+  saved_data_.assign(reinterpret_cast<char*>(buf), len);
+}
+
+} // namespace speech
+} // namespace rokid
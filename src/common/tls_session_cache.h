@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <map>
+#include "openssl/ssl.h"
+#include "alt_chrono.h"
+
+namespace rokid {
+namespace speech {
+
+// client side TLS session cache of one SpeechConnection
+// hook into the SSL_CTX of uWS client:
+//   save the session after handshake (session id or session ticket),
+//   set it to the next SSL before handshake start, so reconnect resume
+//   the session instead of full handshake
+// sessions cached per server name (SNI)
+// optional persist the session of primary server to file,
+// reused after process restart
+class TlsSessionCache {
+public:
+  TlsSessionCache();
+
+  ~TlsSessionCache();
+
+  // 'persist_file' empty: not persist session
+  // 'primary_name' server name of primary server, session of it persisted
+  void attach(SSL_CTX* ctx, const std::string& persist_file,
+      const std::string& primary_name);
+
+  // drop cached session, next handshake will be full handshake
+  void clear();
+
+  // whether tls handshake to 'addr':'port' started after last invocation
+  // used to tell tls failure from tcp failure
+  bool take_handshake_started(const std::string& addr, uint32_t port);
+
+  // result of handshake completed on socket 'fd'
+  // timing kept per SSL, concurrent handshakes not mixed up
+  // return false if no handshake completed since last invocation
+  bool take_handshake_result(int fd, uint32_t& handshake_ms, bool& resumed);
+
+private:
+  typedef struct {
+    uint32_t ms;
+    bool resumed;
+  } HandshakeResult;
+
+  static int on_new_session(SSL* ssl, SSL_SESSION* sess);
+
+  static void on_info(const SSL* ssl, int where, int ret);
+
+  static TlsSessionCache* from_ssl(const SSL* ssl);
+
+  // "addr:port" of peer
+  static bool peer_key(const SSL* ssl, char* key, size_t size);
+
+  void set_session(const std::string& name, SSL_SESSION* sess);
+
+  void load_session();
+
+  void save_session();
+
+private:
+  std::mutex mutex_;
+  SSL_CTX* ctx_;
+  // server name --> session
+  std::map<std::string, SSL_SESSION*> sessions_;
+  // "addr:port" of peers handshake started
+  std::map<std::string, bool> started_peers_;
+  std::string primary_name_;
+  std::string persist_file_;
+  // serialized session in 'persist_file_'
+  std::string saved_data_;
+  // socket fd --> result of handshake completed on it, not taken yet
+  std::map<int, HandshakeResult> results_;
+};
+
+} // namespace speech
+} // namespace rokid
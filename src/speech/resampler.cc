@@ -0,0 +1,146 @@
+#include <math.h>
+#include "resampler.h"
+#include "voice_simd.h"
+#include "rlog.h"
+
+#define RESAMPLER_TAG "speech.Resampler"
+// zero crossings of sinc each side, at lower rate
+#define HALF_ZERO_CROSSINGS 32
+#define MAX_PHASES 1024
+#define MAX_TAPS 256
+#define ROLLOFF 0.91
+#define KAISER_BETA 8.6
+
+using std::vector;
+
+namespace rokid {
+namespace speech {
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+  uint32_t t;
+  while (b) {
+    t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+// modified bessel function of the first kind, order 0
+static double bessel_i0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  double q = x * x / 4.0;
+  for (int k = 1; k < 50; ++k) {
+    term *= q / (k * k);
+    sum += term;
+    if (term < sum * 1e-12)
+      break;
+  }
+  return sum;
+}
+
+Resampler::Resampler() : phases_(1), step_(1), taps_(0), pos_(0),
+    phase_(0) {
+}
+
+bool Resampler::init(uint32_t in_rate, uint32_t out_rate) {
+  uint32_t g;
+  uint32_t len;
+  uint32_t p, k;
+  double fc;
+  double c;
+  double x;
+  double w;
+  double h;
+  double i0b;
+
+  if (in_rate == 0 || out_rate == 0)
+    return false;
+  g = gcd(in_rate, out_rate);
+  phases_ = out_rate / g;
+  step_ = in_rate / g;
+  if (phases_ > MAX_PHASES) {
+    KLOGW(RESAMPLER_TAG, "resample %u -> %u not supported", in_rate,
+        out_rate);
+    phases_ = 1;
+    step_ = 1;
+    return false;
+  }
+  coeffs_.clear();
+  if (passthrough()) {
+    taps_ = 0;
+    reset();
+    return true;
+  }
+  // more taps when decimating, transition band relative to output rate
+  taps_ = HALF_ZERO_CROSSINGS * 2;
+  if (step_ > phases_)
+    taps_ = (taps_ * step_ + phases_ - 1) / phases_;
+  taps_ = (taps_ + 7) & ~7;
+  if (taps_ > MAX_TAPS)
+    taps_ = MAX_TAPS;
+  len = taps_ * phases_;
+  // cutoff normalized to upsampled rate (in_rate * phases_)
+  fc = 0.5 * ROLLOFF / (phases_ > step_ ? phases_ : step_);
+  c = (len - 1) / 2.0;
+  i0b = bessel_i0(KAISER_BETA);
+  coeffs_.resize(len);
+  for (p = 0; p < phases_; ++p) {
+    for (k = 0; k < taps_; ++k) {
+      x = p + k * phases_ - c;
+      h = x == 0 ? 2 * fc : sin(2 * M_PI * fc * x) / (M_PI * x);
+      w = 2.0 * x / (len - 1);
+      w = bessel_i0(KAISER_BETA * sqrt(1.0 - w * w)) / i0b;
+      // gain 'phases_' compensates zeros inserted by upsampling
+      coeffs_[p * taps_ + taps_ - 1 - k] = h * w * phases_;
+    }
+  }
+  KLOGI(RESAMPLER_TAG, "resample %u -> %u, %u phases, %u taps", in_rate,
+      out_rate, phases_, taps_);
+  reset();
+  return true;
+}
+
+void Resampler::reset() {
+  buf_.assign(taps_ ? taps_ - 1 : 0, 0.0f);
+  pos_ = 0;
+  phase_ = 0;
+}
+
+uint32_t Resampler::max_output(uint32_t n) const {
+  return (static_cast<uint64_t>(buf_.size() + n) * phases_) / step_ + 1;
+}
+
+uint32_t Resampler::process(const float* in, uint32_t n, float* out) {
+  uint32_t r = 0;
+  uint32_t len;
+
+  if (passthrough()) {
+    for (r = 0; r < n; ++r)
+      out[r] = in[r];
+    return n;
+  }
+  buf_.insert(buf_.end(), in, in + n);
+  len = buf_.size();
+  const float* data = buf_.data();
+  while (pos_ + taps_ <= len) {
+    out[r++] = dot_product(coeffs_.data() + phase_ * taps_, data + pos_,
+        taps_);
+    phase_ += step_;
+    pos_ += phase_ / phases_;
+    phase_ %= phases_;
+  }
+  // keep samples of next window
+  if (pos_ >= len) {
+    pos_ -= len;
+    buf_.clear();
+  } else {
+    buf_.erase(buf_.begin(), buf_.begin() + pos_);
+    pos_ = 0;
+  }
+  return r;
+}
+
+} // namespace speech
+} // namespace rokid
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+namespace rokid {
+namespace speech {
+
+// 多相FIR重采样, 任意整数采样率转换 (in_rate * L / M)
+//   原型低通: kaiser窗sinc, 截止频率为较低奈奎斯特频率的0.91倍
+//   每相位抽头数随降采样比例增加, 保证阻带衰减
+//   内积运算见voice_simd.h
+class Resampler {
+public:
+	Resampler();
+
+	// return false if rate not supported
+	bool init(uint32_t in_rate, uint32_t out_rate);
+
+	// clear history samples, next input regarded as a new stream
+	void reset();
+
+	bool passthrough() const {
+		return phases_ == 1 && step_ == 1;
+	}
+
+	// max output samples of 'n' input samples
+	uint32_t max_output(uint32_t n) const;
+
+	// return output samples written to 'out'
+	uint32_t process(const float* in, uint32_t n, float* out);
+
+private:
+	// L
+	uint32_t phases_;
+	// M
+	uint32_t step_;
+	uint32_t taps_;
+	// 'phases_' * 'taps_' coefficients, taps of each phase reversed
+	std::vector<float> coeffs_;
+	// history samples and input not consumed yet
+	std::vector<float> buf_;
+	// start of next window in 'buf_'
+	uint32_t pos_;
+	// phase of next output
+	uint32_t phase_;
+};
+
+} // namespace speech
+} // namespace rokid
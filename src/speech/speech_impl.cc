@@ -1,13 +1,41 @@
 #include "speech_impl.h"
+#include "voice_simd.h"
 
 #define WS_SEND_TIMEOUT 5000
-
+// 16k 16bit mono pcm
+#define PCM_BYTE_RATE 32000
+// bitrate assumed of opus voice from caller
+#define DEFAULT_OPUS_BITRATE 27800
+// send backlog thresholds, in milliseconds of voice
+//   above HOLD: stop writing voice to connection, wait backlog drain,
+//               voice accumulates in 'voice_reqs_' within voice budget
+//   above COALESCE: merge queued voice into one request
+// bitrate control, backlog beyond one rtt of voice (in flight):
+//   above COALESCE: lower bitrate, to measured throughput if lower
+//   below RAISE: raise bitrate
+#define BACKLOG_HOLD_MS 500
+#define BACKLOG_COALESCE_MS 100
+#define BACKLOG_RAISE_MS 20
+#define MAX_COALESCE_BYTES 32768
+// check backlog interval while holding voice (milliseconds)
+#define BACKLOG_WAIT_INTERVAL 20
+// max voice frames dequeued and sent in one round of locks
+#define MAX_VOICE_BATCH 16
+// min interval of bitrate change (milliseconds)
+#define BITRATE_ADAPT_INTERVAL 500
+#define BITRATE_RAISE_STEP 2000
+// rtt above min rtt more than this, regard as queueing in network
+#define RTT_QUEUE_DELAY 100
+
+using std::vector;
 using std::shared_ptr;
 using std::mutex;
 using std::lock_guard;
 using std::unique_lock;
 using std::make_shared;
 using std::chrono::system_clock;
+using std::chrono::duration_cast;
+using std::chrono::milliseconds;
 
 namespace rokid {
 namespace speech {
@@ -20,6 +48,14 @@ static const uint32_t MODIFY_NO_INTERMEDIATE_ASR = 0x10;
 static const uint32_t MODIFY_VAD_BEGIN = 0x20;
 static const uint32_t MODIFY_VOICE_FRAGMENT = 0x40;
 static const uint32_t MODIFY_LOG_SERVER = 0x80;
+static const uint32_t MODIFY_VOICE_REPLAY = 0x100;
+static const uint32_t MODIFY_VOICE_BUDGET = 0x200;
+static const uint32_t MODIFY_OPUS_BITRATE = 0x400;
+static const uint32_t MODIFY_OPUS_PROFILE = 0x800;
+static const uint32_t MODIFY_INPUT_SAMPLE_RATE = 0x1000;
+static const uint32_t MODIFY_INPUT_FORMAT = 0x2000;
+static const uint32_t MODIFY_VOICE_STAGES = 0x4000;
+static const uint32_t MODIFY_MAX_PENDING_OPS = 0x8000;
 
 class SpeechOptionsModifier : public SpeechOptionsHolder, public SpeechOptions {
 public:
@@ -70,6 +106,64 @@ public:
     _mask |= MODIFY_VOICE_FRAGMENT;
   }
 
+  void set_voice_replay(uint32_t max_bytes, uint32_t timeout) {
+    this->replay_max_bytes = max_bytes;
+    this->replay_timeout = timeout;
+    _mask |= MODIFY_VOICE_REPLAY;
+  }
+
+  void set_voice_budget(uint32_t session_bytes, uint32_t instance_bytes,
+      VoiceDropPolicy policy) {
+    this->voice_session_budget = session_bytes;
+    this->voice_instance_budget = instance_bytes;
+    this->voice_drop_policy = policy;
+    _mask |= MODIFY_VOICE_BUDGET;
+  }
+
+  void set_opus_bitrate(uint32_t min, uint32_t max) {
+    this->opus_min_bitrate = min < max ? min : max;
+    this->opus_max_bitrate = max;
+    _mask |= MODIFY_OPUS_BITRATE;
+  }
+
+  void set_opus_profile(const OpusProfile& profile) {
+    this->opus_profile = profile;
+    if (profile.frame_duration != 10 && profile.frame_duration != 20
+        && profile.frame_duration != 40 && profile.frame_duration != 60) {
+      KLOGW(tag__, "invalid opus frame duration %u, use 20",
+          profile.frame_duration);
+      this->opus_profile.frame_duration = 20;
+    }
+    if (profile.complexity > 10)
+      this->opus_profile.complexity = 10;
+    if (profile.packet_loss > 100)
+      this->opus_profile.packet_loss = 100;
+    _mask |= MODIFY_OPUS_PROFILE;
+  }
+
+  void set_input_sample_rate(uint32_t rate) {
+    this->input_sample_rate = rate;
+    _mask |= MODIFY_INPUT_SAMPLE_RATE;
+  }
+
+  void set_input_format(SampleFormat format, uint32_t channels,
+      uint32_t channel_mask) {
+    this->input_format = format;
+    this->input_channels = channels;
+    this->input_channel_mask = channel_mask;
+    _mask |= MODIFY_INPUT_FORMAT;
+  }
+
+  void set_voice_stages(const vector<shared_ptr<VoiceStage> >& stages) {
+    this->voice_stages = stages;
+    _mask |= MODIFY_VOICE_STAGES;
+  }
+
+  void set_max_pending_ops(uint32_t max) {
+    this->max_pending_ops = max;
+    _mask |= MODIFY_MAX_PENDING_OPS;
+  }
+
   void modify(SpeechOptionsHolder& options) {
     if (_mask & MODIFY_LANG)
       options.lang = lang;
@@ -91,9 +185,39 @@ public:
     }
     if (_mask & MODIFY_VOICE_FRAGMENT)
       options.voice_fragment = voice_fragment;
+    if (_mask & MODIFY_VOICE_REPLAY) {
+      options.replay_max_bytes = replay_max_bytes;
+      options.replay_timeout = replay_timeout;
+    }
+    if (_mask & MODIFY_VOICE_BUDGET) {
+      options.voice_session_budget = voice_session_budget;
+      options.voice_instance_budget = voice_instance_budget;
+      options.voice_drop_policy = voice_drop_policy;
+    }
+    if (_mask & MODIFY_OPUS_BITRATE) {
+      options.opus_min_bitrate = opus_min_bitrate;
+      options.opus_max_bitrate = opus_max_bitrate;
+    }
+    if (_mask & MODIFY_OPUS_PROFILE)
+      options.opus_profile = opus_profile;
+    if (_mask & MODIFY_INPUT_SAMPLE_RATE)
+      options.input_sample_rate = input_sample_rate;
+    if (_mask & MODIFY_INPUT_FORMAT) {
+      options.input_format = input_format;
+      options.input_channels = input_channels;
+      options.input_channel_mask = input_channel_mask;
+    }
+    if (_mask & MODIFY_VOICE_STAGES)
+      options.voice_stages = voice_stages;
+    if (_mask & MODIFY_MAX_PENDING_OPS)
+      options.max_pending_ops = max_pending_ops;
     KLOGD(tag__, "SpeechOptions modified to: vad(%s:%u), codec(%s), "
         "lang(%s), no_nlp(%d), no_intermediate_asr(%d), "
-        "vad_begin(%u), log server(%s:%d), voice_fragment(%u)",
+        "vad_begin(%u), log server(%s:%d), voice_fragment(%u), "
+        "voice replay(%u bytes, %u ms), voice budget(%u/%u, %s), "
+        "opus bitrate(%u-%u), opus profile(%ums, app %d, complexity %u, "
+        "vbr %d, fec %d/%u%%, dtx %d), input(%u Hz, format %d, "
+        "%u channels, mask 0x%x), %u voice stages, max pending ops %u",
         options.vad_mode == VadMode::CLOUD ? "cloud" : "local",
         options.vend_timeout,
         options.codec == Codec::OPU ? "opu" : "pcm",
@@ -103,14 +227,42 @@ public:
         options.vad_begin,
         options.log_host.c_str(),
         options.log_port,
-        options.voice_fragment);
+        options.voice_fragment,
+        options.replay_max_bytes,
+        options.replay_timeout,
+        options.voice_session_budget,
+        options.voice_instance_budget,
+        options.voice_drop_policy == VoiceDropPolicy::REJECT_NEW
+          ? "reject new" : "drop oldest",
+        options.opus_min_bitrate,
+        options.opus_max_bitrate,
+        options.opus_profile.frame_duration,
+        static_cast<int>(options.opus_profile.application),
+        options.opus_profile.complexity,
+        options.opus_profile.vbr,
+        options.opus_profile.fec,
+        options.opus_profile.packet_loss,
+        options.opus_profile.dtx,
+        options.input_sample_rate,
+        static_cast<int>(options.input_format),
+        options.input_channels,
+        options.input_channel_mask,
+        static_cast<uint32_t>(options.voice_stages.size()),
+        options.max_pending_ops);
   }
 
 private:
   uint32_t _mask;
 };
 
-SpeechImpl::SpeechImpl() : initialized_(false) {
+SpeechImpl::SpeechImpl() : next_id_(0),
+    options_(make_shared<SpeechOptionsHolder>()), initialized_(false),
+    frontend_id_(0) {
+  retention_.id = 0;
+  retention_.bytes = 0;
+  retention_.conn_id = 0;
+  retention_.ended = false;
+  retention_.broken = false;
 #ifdef SPEECH_STATISTIC
   cur_trace_info_.id = 0;
 #endif
@@ -126,10 +278,20 @@ bool SpeechImpl::prepare(const PrepareOptions& options) {
   lock_guard<mutex> locker(req_mutex_);
   if (initialized_)
     return true;
+  shared_ptr<const SpeechOptionsHolder> opts = options_snapshot();
 #ifdef HAS_OPUS_CODEC
-  opus_encoder_.init(16000, 27800, 20);
+  config_encoder(*opts);
+  stats_.voice_bitrate = opus_encoder_.bitrate();
 #endif
-  next_id_ = 0;
+  frontend_.init(opts->input_sample_rate, opts->input_format,
+      opts->input_channels, opts->input_channel_mask);
+  frontend_.set_stages(opts->voice_stages);
+  resp_mutex_.lock();
+  controller_.set_max_ops(opts->max_pending_ops);
+  resp_mutex_.unlock();
+  frontend_id_ = 0;
+  voice_options_ = opts;
+  next_id_.store(0, std::memory_order_relaxed);
   connection_.initialize(SOCKET_BUF_SIZE, options, "speech");
   initialized_ = true;
   req_thread_ = new thread([=] { send_reqs(); });
@@ -146,6 +308,9 @@ void SpeechImpl::release() {
     initialized_ = false;
     connection_.release();
     voice_reqs_.close();
+    queued_voice_.clear();
+    stats_.queued_voice_bytes = 0;
+    stats_.queued_voice_frames = 0;
     text_reqs_.clear();
     req_cond_.notify_one();
     req_locker.unlock();
@@ -163,6 +328,18 @@ void SpeechImpl::release() {
     resp_thread_->join();
     delete resp_thread_;
 
+    // callbacks access 'this', wait running one return
+    map<int32_t, TimerWheel::TimerId> timers;
+    map<int32_t, TimerWheel::TimerId>::iterator it;
+    deadline_mutex_.lock();
+    timers.swap(deadlines_);
+    deadline_mutex_.unlock();
+    for (it = timers.begin(); it != timers.end(); ++it)
+      TimerWheel::instance()->cancel(it->second);
+    resp_locker.lock();
+    expired_ids_.clear();
+    resp_locker.unlock();
+
 #ifdef HAS_OPUS_CODEC
     opus_encoder_.close();
 #endif
@@ -182,8 +359,11 @@ int32_t SpeechImpl::put_text(const char* text, const VoiceOptions* options) {
     p->options = make_shared<VoiceOptions>();
     *p->options = *options;
   }
+  p->speech_options = options_snapshot();
   text_reqs_.push_back(p);
   KLOGV(tag__, "put text %d, %s", id, text);
+  if (options && options->deadline)
+    arm_deadline(id, options->deadline);
   req_cond_.notify_one();
   return id;
 }
@@ -195,13 +375,17 @@ int32_t SpeechImpl::start_voice(const VoiceOptions* options) {
   int32_t id = next_id();
   if (!voice_reqs_.start(id))
     return -1;
-  shared_ptr<VoiceOptions> arg;
+  queued_voice_[id] = QueuedVoice();
+  shared_ptr<VoiceReqArg> arg = make_shared<VoiceReqArg>();
   if (options) {
-    arg = make_shared<VoiceOptions>();
-    *arg = *options;
+    arg->voice = make_shared<VoiceOptions>();
+    *arg->voice = *options;
   }
+  arg->speech = options_snapshot();
   voice_reqs_.set_arg(id, arg);
   KLOGV(tag__, "start voice %d", id);
+  if (options && options->deadline)
+    arm_deadline(id, options->deadline);
   req_cond_.notify_one();
   return id;
 }
@@ -210,48 +394,300 @@ static bool is_stream_codec(Codec codec) {
   return codec == Codec::PCM;
 }
 
-void SpeechImpl::put_voice(int32_t id, const uint8_t* voice, uint32_t length) {
+int32_t SpeechImpl::put_voice(int32_t id, const uint8_t* voice, uint32_t length) {
   if (!initialized_)
-    return;
+    return PUT_VOICE_INVALID;
   if (id <= 0 || voice == NULL || length == 0)
-    return;
+    return PUT_VOICE_INVALID;
+  if (id != frontend_id_ && !switch_voice(id))
+    return PUT_VOICE_INVALID;
+  const SpeechOptionsHolder& opts = *voice_options_;
+  if (opts.codec == Codec::PCM && !frontend_.passthrough()) {
+    uint32_t samples;
+    voice = reinterpret_cast<const uint8_t*>(
+        frontend_.process(voice, length, samples));
+    length = samples * sizeof(int16_t);
+    if (length == 0)
+      return PUT_VOICE_SUCCESS;
+  }
+  // 16k mono int16 here, still in cache
+  VoiceSignalAcc signal;
+  if (opts.codec == Codec::PCM) {
+    signal.id = id;
+    signal.samples = length / sizeof(int16_t);
+    signal_stats_s16(reinterpret_cast<const int16_t*>(voice), signal.samples,
+        signal.sum_sq, signal.peak, signal.clipped);
+  }
 #ifdef HAS_OPUS_CODEC
-  if (options_.codec == Codec::PCM) {
+  if (opts.codec == Codec::PCM) {
     uint32_t enc_size;
+    adapt_bitrate();
     const uint8_t* opu = opus_encoder_.encode(
         reinterpret_cast<const uint16_t*>(voice),
         length / sizeof(uint16_t), enc_size);
     KLOGD(tag__, "put voice %u bytes, encoded to %u bytes", length, enc_size);
     if (enc_size == 0)
-      return;
+      return PUT_VOICE_SUCCESS;
     voice = opu;
     length = enc_size;
   }
 #endif
   lock_guard<mutex> locker(req_mutex_);
+  if (signal.samples)
+    add_signal_stats(signal);
   shared_ptr<string> spv;
   const char* strp = reinterpret_cast<const char*>(voice);
   uint32_t off = 0;
   uint32_t sz;
+  int32_t r;
+  int32_t result = PUT_VOICE_SUCCESS;
   bool need_notify = false;
   while (off < length) {
     sz = length - off;
-    if (is_stream_codec(options_.codec) && options_.voice_fragment < sz)
-      sz = options_.voice_fragment;
+    if (is_stream_codec(opts.codec) && opts.voice_fragment < sz)
+      sz = opts.voice_fragment;
     spv = make_shared<string>(strp + off, sz);
     off += sz;
-    if (voice_reqs_.stream(id, spv)) {
+    r = queue_voice(id, spv, opts);
+    if (r >= 0)
       need_notify = true;
-    } else {
+    else if (r == PUT_VOICE_INVALID)
       KLOGI(tag__, "put voice failed, maybe id %d is invalid", id);
-    }
+    // report the worst of fragments
+    if (result == PUT_VOICE_SUCCESS || (r < 0 && r < result))
+      result = r;
   }
   if (need_notify) {
     KLOGV(tag__, "put voice %d, len %u", id, length);
     req_cond_.notify_one();
   }
+  return result;
+}
+
+bool SpeechImpl::switch_voice(int32_t id) {
+  shared_ptr<VoiceReqArg> arg;
+
+  req_mutex_.lock();
+  arg = voice_reqs_.get_arg(id);
+  req_mutex_.unlock();
+  if (arg.get() == NULL)
+    return false;
+  frontend_id_ = id;
+  if (arg->speech != voice_options_) {
+    // config changed, apply between voices, not in the middle of one
+    const SpeechOptionsHolder& opts = *arg->speech;
+    frontend_.init(opts.input_sample_rate, opts.input_format,
+        opts.input_channels, opts.input_channel_mask);
+    frontend_.set_stages(opts.voice_stages);
+#ifdef HAS_OPUS_CODEC
+    config_encoder(opts);
+    req_mutex_.lock();
+    stats_.voice_bitrate = opus_encoder_.bitrate();
+    req_mutex_.unlock();
+#endif
+    voice_options_ = arg->speech;
+  }
+  frontend_.reset();
+  return true;
+}
+
+int32_t SpeechImpl::queue_voice(int32_t id, shared_ptr<string>& data,
+    const SpeechOptionsHolder& opts) {
+  uint32_t sz = data->length();
+  uint32_t session_budget = opts.voice_session_budget;
+  uint32_t instance_budget = opts.voice_instance_budget;
+  map<int32_t, QueuedVoice>::iterator it = queued_voice_.find(id);
+  shared_ptr<string> dropped;
+  int32_t dropped_id;
+  int32_t r = PUT_VOICE_SUCCESS;
+  bool session_over;
+  bool instance_over;
+
+  if (it == queued_voice_.end())
+    return PUT_VOICE_INVALID;
+  while (true) {
+    session_over = session_budget && it->second.bytes + sz > session_budget;
+    instance_over = instance_budget
+      && stats_.queued_voice_bytes + sz > instance_budget;
+    if (!session_over && !instance_over)
+      break;
+    // drop oldest of this session first, then oldest of all sessions
+    if (opts.voice_drop_policy == VoiceDropPolicy::REJECT_NEW
+        || !voice_reqs_.drop_data(session_over ? id : 0, dropped,
+          dropped_id)) {
+      KLOGI(tag__, "voice %d queued %u bytes, total %u bytes, "
+          "reject %u bytes", id, it->second.bytes, stats_.queued_voice_bytes,
+          sz);
+      ++stats_.rejected_voice_frames;
+      stats_.rejected_voice_bytes += sz;
+      return PUT_VOICE_REJECTED;
+    }
+    voice_dequeued(dropped_id, dropped->length());
+    ++stats_.dropped_voice_frames;
+    stats_.dropped_voice_bytes += dropped->length();
+    r = PUT_VOICE_DROPPED;
+  }
+  if (!voice_reqs_.stream(id, data))
+    return PUT_VOICE_INVALID;
+  it->second.bytes += sz;
+  ++it->second.frames;
+  stats_.queued_voice_bytes += sz;
+  ++stats_.queued_voice_frames;
+  if (stats_.queued_voice_bytes > stats_.max_queued_voice_bytes)
+    stats_.max_queued_voice_bytes = stats_.queued_voice_bytes;
+  return r;
 }
 
+void SpeechImpl::voice_dequeued(int32_t id, uint32_t length) {
+  map<int32_t, QueuedVoice>::iterator it = queued_voice_.find(id);
+  if (it == queued_voice_.end())
+    return;
+  if (length == 0) {
+    // data erased (cancel, error) never popped
+    stats_.queued_voice_bytes -= it->second.bytes;
+    stats_.queued_voice_frames -= it->second.frames;
+    queued_voice_.erase(it);
+    return;
+  }
+  it->second.bytes -= length;
+  --it->second.frames;
+  stats_.queued_voice_bytes -= length;
+  --stats_.queued_voice_frames;
+}
+
+void SpeechImpl::add_signal_stats(const VoiceSignalAcc& acc) {
+  VoiceSignalAcc& cur = signal_stats_[0];
+  if (cur.id != acc.id) {
+    signal_stats_[1] = cur;
+    cur = VoiceSignalAcc();
+    cur.id = acc.id;
+  }
+  cur.samples += acc.samples;
+  cur.sum_sq += acc.sum_sq;
+  cur.clipped += acc.clipped;
+  if (acc.peak > cur.peak)
+    cur.peak = acc.peak;
+}
+
+uint32_t SpeechImpl::voice_byte_rate(Codec codec) {
+#ifdef HAS_OPUS_CODEC
+  if (codec == Codec::PCM && opus_encoder_.bitrate())
+    return opus_encoder_.bitrate() / 8;
+#endif
+  return codec == Codec::PCM ? PCM_BYTE_RATE
+    : DEFAULT_OPUS_BITRATE / 8;
+}
+
+void SpeechImpl::pace_voice(int32_t id, Codec codec,
+    shared_ptr<string>& voice, unique_lock<mutex>& locker) {
+  uint32_t rate = voice_byte_rate(codec);
+  uint32_t backlog;
+  uint32_t limit;
+  shared_ptr<string> more;
+
+  while (true) {
+    locker.unlock();
+    backlog = connection_.send_backlog();
+    locker.lock();
+    // uplink slower than voice, not pile up frames in socket
+    if (!initialized_ || backlog <= rate * BACKLOG_HOLD_MS / 1000)
+      break;
+    req_cond_.wait_for(locker, milliseconds(BACKLOG_WAIT_INTERVAL));
+  }
+  if (backlog <= rate * BACKLOG_COALESCE_MS / 1000)
+    return;
+  // larger backlog, larger request, less per frame overhead
+  limit = backlog < MAX_COALESCE_BYTES ? backlog : MAX_COALESCE_BYTES;
+  while (voice->length() < limit && voice_reqs_.pop_data(id, more)) {
+    voice_dequeued(id, more->length());
+    voice->append(*more);
+    ++stats_.coalesced_voice_frames;
+  }
+}
+
+#ifdef HAS_OPUS_CODEC
+void SpeechImpl::adapt_bitrate() {
+  SteadyClock::time_point now = SteadyClock::now();
+  uint32_t bitrate = opus_encoder_.bitrate();
+  uint32_t min = voice_options_->opus_min_bitrate;
+  uint32_t max = voice_options_->opus_max_bitrate;
+  uint32_t target = bitrate;
+  uint32_t inflight;
+  uint32_t queued;
+  LinkEstimate est;
+
+  if (bitrate == 0 || min >= max
+      || now - bitrate_tp_ < milliseconds(BITRATE_ADAPT_INTERVAL))
+    return;
+  bitrate_tp_ = now;
+  if (!connection_.estimate_link(est))
+    return;
+  inflight = bitrate / 8 * est.srtt / 1000;
+  queued = est.backlog > inflight ? est.backlog - inflight : 0;
+  if (queued > bitrate / 8 * BACKLOG_COALESCE_MS / 1000) {
+    // uplink saturated, throughput is link capacity, keep 20% headroom
+    target = bitrate * 3 / 4;
+    if (est.throughput && est.throughput * 8 / 5 * 4 < target)
+      target = est.throughput * 8 / 5 * 4;
+  } else if (est.min_rtt && est.srtt > est.min_rtt + RTT_QUEUE_DELAY) {
+    // socket not backlogged, but queue building in network
+    target = bitrate * 7 / 8;
+  } else if (queued < bitrate / 8 * BACKLOG_RAISE_MS / 1000) {
+    target = bitrate + BITRATE_RAISE_STEP;
+  }
+  if (target < min)
+    target = min;
+  if (target > max)
+    target = max;
+  if (target == bitrate || !opus_encoder_.set_bitrate(target))
+    return;
+  KLOGI(tag__, "opus bitrate %u -> %u, backlog %u, throughput %u, "
+      "rtt %u/%u", bitrate, target, est.backlog, est.throughput,
+      est.srtt, est.min_rtt);
+  lock_guard<mutex> locker(req_mutex_);
+  stats_.voice_bitrate = target;
+}
+
+static void opus_params(const OpusProfile& profile,
+    RKOpusEncoderParams& params) {
+  static const int _apps[] = {
+    OPUS_APPLICATION_VOIP,
+    OPUS_APPLICATION_AUDIO,
+    OPUS_APPLICATION_RESTRICTED_LOWDELAY
+  };
+  params.application = _apps[static_cast<int>(profile.application)];
+  params.complexity = profile.complexity;
+  params.vbr = profile.vbr;
+  params.fec = profile.fec;
+  params.packet_loss = profile.packet_loss;
+  params.dtx = profile.dtx;
+}
+
+void SpeechImpl::config_encoder(const SpeechOptionsHolder& opts) {
+  const OpusProfile& profile = opts.opus_profile;
+  RKOpusEncoderParams params;
+  uint32_t bitrate;
+
+  if (opts.codec == Codec::PCM) {
+    opus_params(profile, params);
+    // profile changed, recreate encoder
+    if (opus_encoder_.bitrate()
+        && (opus_encoder_.duration() != profile.frame_duration
+          || !(opus_encoder_.params() == params)))
+      opus_encoder_.close();
+    opus_encoder_.init(16000, opts.opus_max_bitrate,
+        profile.frame_duration, params);
+    bitrate = opus_encoder_.bitrate();
+    if (bitrate > opts.opus_max_bitrate)
+      opus_encoder_.set_bitrate(opts.opus_max_bitrate);
+    else if (bitrate < opts.opus_min_bitrate)
+      opus_encoder_.set_bitrate(opts.opus_min_bitrate);
+  } else {
+    opus_encoder_.close();
+  }
+}
+#endif
+
 void SpeechImpl::end_voice(int32_t id) {
   if (!initialized_)
     return;
@@ -306,22 +742,225 @@ void SpeechImpl::erase_req(int32_t id) {
   }
 }
 
+void SpeechImpl::arm_deadline(int32_t id, uint32_t deadline) {
+  TimerWheel::TimerId timer = TimerWheel::instance()->schedule(deadline,
+      [this, id] { on_deadline(id); });
+  lock_guard<mutex> locker(deadline_mutex_);
+  deadlines_[id] = timer;
+}
+
+void SpeechImpl::disarm_deadline(int32_t id) {
+  lock_guard<mutex> locker(deadline_mutex_);
+  map<int32_t, TimerWheel::TimerId>::iterator it = deadlines_.find(id);
+  if (it == deadlines_.end())
+    return;
+  // may be invoked with 'resp_mutex_' locked, not wait callback
+  // fired timer removed by its callback
+  if (TimerWheel::instance()->cancel(it->second, false))
+    deadlines_.erase(it);
+}
+
+void SpeechImpl::on_deadline(int32_t id) {
+  list<shared_ptr<SpeechReqInfo> >::iterator it;
+  bool sent = false;
+  bool withdrawn = false;
+
+  unique_lock<mutex> req_locker(req_mutex_);
+  unique_lock<mutex> resp_locker(resp_mutex_);
+  shared_ptr<SpeechOperationController::Operation> op =
+    controller_.current_op();
+  if (!initialized_) {
+    // 'release' cancelling timers, nothing to do
+  } else if (op.get() && op->id == id) {
+    // as op timeout of 'gen_results'
+    KLOGI(tag__, "speech %d deadline expired, set op error", id);
+    controller_.set_op_error(SPEECH_TIMEOUT);
+    resp_cond_.notify_one();
+    if (voice_reqs_.erase(id, SPEECH_TIMEOUT))
+      req_cond_.notify_one();
+    sent = true;
+  } else if (voice_reqs_.erase(id)) {
+    req_cond_.notify_one();
+    withdrawn = true;
+  } else {
+    for (it = text_reqs_.begin(); it != text_reqs_.end(); ++it) {
+      if ((*it)->id == id
+          && (*it)->type != SpeechReqType::CANCELLED) {
+        (*it)->type = SpeechReqType::CANCELLED;
+        withdrawn = true;
+        break;
+      }
+    }
+  }
+  // not sent yet, withdrawn as cancelled,
+  // 'do_ctl_change_op' generates error result
+  if (withdrawn) {
+    KLOGI(tag__, "speech %d deadline expired before sent", id);
+    expired_ids_.insert(id);
+  }
+  resp_locker.unlock();
+  req_locker.unlock();
+  if (sent)
+    drop_retention(id);
+  // last access of 'this', 'release' waits callback return
+  // only if timer still in 'deadlines_'
+  lock_guard<mutex> locker(deadline_mutex_);
+  deadlines_.erase(id);
+}
+
+void SpeechImpl::retain_req(shared_ptr<SpeechReqInfo>& req) {
+  size_t i;
+  switch (req->type) {
+    case SpeechReqType::VOICE_START:
+      retention_.frames.clear();
+      retention_.bytes = 0;
+      retention_.conn_id = 0;
+      retention_.ended = false;
+      retention_.broken = false;
+      if (req->speech_options->replay_max_bytes
+          && req->speech_options->replay_timeout) {
+        retention_.id = req->id;
+        retention_.options = req->options;
+        retention_.speech_options = req->speech_options;
+      } else {
+        retention_.id = 0;
+      }
+      break;
+    case SpeechReqType::VOICE_DATA:
+      for (i = 0; i <= req->more.size() && retention_.id == req->id; ++i) {
+        const shared_ptr<string>& data = i ? req->more[i - 1] : req->data;
+        if (retention_.bytes + data->length()
+            > retention_.speech_options->replay_max_bytes) {
+          KLOGI(tag__, "voice %d sent exceed %u bytes, can't replay "
+              "if connection broken", req->id,
+              retention_.speech_options->replay_max_bytes);
+          drop_retention_locked();
+          break;
+        }
+        // shared with req, no copy
+        retention_.frames.push_back(data);
+        retention_.bytes += data->length();
+      }
+      break;
+    case SpeechReqType::VOICE_END:
+      if (retention_.id == req->id)
+        retention_.ended = true;
+      break;
+    default:
+      // text req, or voice cancelled
+      drop_retention_locked();
+      break;
+  }
+}
+
+ConnectionOpResult SpeechImpl::replay_voice() {
+  const SpeechOptionsHolder& sopts = *retention_.speech_options;
+  SteadyClock::time_point now = SteadyClock::now();
+  ConnectionOpResult r = ConnectionOpResult::CONNECTION_NOT_AVAILABLE;
+  list<shared_ptr<string> >::iterator it;
+  uint32_t elapsed;
+
+  if (!retention_.broken) {
+    retention_.broken = true;
+    retention_.broken_tp = now;
+  }
+  while (initialized_) {
+    elapsed = duration_cast<milliseconds>(SteadyClock::now()
+        - retention_.broken_tp).count();
+    if (elapsed >= sopts.replay_timeout) {
+      r = ConnectionOpResult::CONNECTION_NOT_AVAILABLE;
+      break;
+    }
+    SpeechRequest start_req;
+    start_req.set_id(retention_.id);
+    start_req.set_type(rokid_open_speech_v1_ReqType_START);
+    req_config(start_req, retention_.options, sopts);
+    r = connection_.send(start_req, sopts.replay_timeout - elapsed);
+    for (it = retention_.frames.begin();
+        r == ConnectionOpResult::SUCCESS && it != retention_.frames.end();
+        ++it) {
+      SpeechRequest voice_req;
+      voice_req.set_id(retention_.id);
+      voice_req.set_type(rokid_open_speech_v1_ReqType_VOICE);
+      voice_req.set_voice(**it);
+      r = connection_.send(voice_req, 1);
+    }
+    if (r == ConnectionOpResult::SUCCESS && retention_.ended) {
+      SpeechRequest end_req;
+      end_req.set_id(retention_.id);
+      end_req.set_type(rokid_open_speech_v1_ReqType_END);
+      r = connection_.send(end_req, 1);
+    }
+    // broken again while replaying, retry in time bound
+    if (r != ConnectionOpResult::CONNECTION_NOT_AVAILABLE)
+      break;
+  }
+  if (r != ConnectionOpResult::SUCCESS) {
+    KLOGI(tag__, "voice %d replay failed %d", retention_.id, r);
+    drop_retention_locked();
+    lock_guard<mutex> locker(req_mutex_);
+    ++stats_.failed_voice_replays;
+    return r;
+  }
+  retention_.conn_id = connection_.ready_id();
+  retention_.broken = false;
+  elapsed = duration_cast<milliseconds>(SteadyClock::now()
+      - retention_.broken_tp).count();
+  KLOGI(tag__, "voice %d replayed, %lu frames, %u bytes, ended %d, "
+      "%u ms after connection broken", retention_.id,
+      retention_.frames.size(), retention_.bytes, retention_.ended, elapsed);
+  lock_guard<mutex> locker(req_mutex_);
+  ++stats_.replayed_voices;
+  stats_.last_replay_ms = elapsed;
+  return r;
+}
+
+bool SpeechImpl::recover_voice(int32_t id) {
+  lock_guard<mutex> locker(retention_mutex_);
+  if (id <= 0 || retention_.id != id)
+    return false;
+  // voice already on current connection, error of previous connection
+  if (retention_.conn_id && connection_.ready_id() == retention_.conn_id)
+    return true;
+  KLOGI(tag__, "connection broken, replay voice %d", id);
+  return replay_voice() == ConnectionOpResult::SUCCESS;
+}
+
+void SpeechImpl::drop_retention(int32_t id) {
+  lock_guard<mutex> locker(retention_mutex_);
+  if (retention_.id == id)
+    drop_retention_locked();
+}
+
+void SpeechImpl::drop_retention_locked() {
+  retention_.id = 0;
+  retention_.options.reset();
+  retention_.speech_options.reset();
+  retention_.frames.clear();
+  retention_.bytes = 0;
+  retention_.broken = false;
+}
+
 void SpeechImpl::config(const shared_ptr<SpeechOptions>& options) {
   if (options.get() == NULL)
     return;
   shared_ptr<SpeechOptionsModifier> mod =
     static_pointer_cast<SpeechOptionsModifier>(options);
-  mod->modify(options_);
-#ifdef HAS_OPUS_CODEC
-  if (options_.codec == Codec::PCM)
-    opus_encoder_.init(16000, 27800, 20);
-  else
-    opus_encoder_.close();
-#endif
-  if (options_.log_host.size() > 0) {
+  lock_guard<mutex> init_locker(init_mutex_);
+  shared_ptr<SpeechOptionsHolder> opts =
+    make_shared<SpeechOptionsHolder>(*options_);
+  mod->modify(*opts);
+  // requests created before keep previous snapshot,
+  // 'frontend_' and encoder follow at next voice (switch_voice)
+  std::atomic_store(&options_,
+      shared_ptr<const SpeechOptionsHolder>(opts));
+  resp_mutex_.lock();
+  controller_.set_max_ops(opts->max_pending_ops);
+  resp_mutex_.unlock();
+  if (opts->log_host.size() > 0) {
     char buf[64];
     snprintf(buf, sizeof(buf), "tcp://%s:%d/",
-             options_.log_host.c_str(), options_.log_port);
+             opts->log_host.c_str(), opts->log_port);
     if (RLog::add_endpoint("socket", ROKID_LOGWRITER_SOCKET) == 0)
       RLog::enable_endpoint("socket", buf, true);
   }
@@ -331,6 +970,62 @@ void SpeechImpl::reconn() {
   connection_.reconn();
 }
 
+void SpeechImpl::get_connection_stats(ConnectionStats& stats) {
+  connection_.get_stats(stats);
+}
+
+void SpeechImpl::get_stats(SpeechStats& stats) {
+  OperationStats ops;
+  req_mutex_.lock();
+  stats = stats_;
+  req_mutex_.unlock();
+  resp_mutex_.lock();
+  controller_.get_stats(ops);
+  resp_mutex_.unlock();
+  stats.pending_ops = ops.depth;
+  stats.max_pending_ops = ops.max_depth;
+  stats.dropped_ops = ops.dropped;
+}
+
+bool SpeechImpl::get_voice_stats(int32_t id, VoiceSignalStats& stats) {
+  VoiceSignalAcc acc;
+  double ms;
+  {
+    lock_guard<mutex> locker(req_mutex_);
+    if (id > 0 && signal_stats_[0].id == id)
+      acc = signal_stats_[0];
+    else if (id > 0 && signal_stats_[1].id == id)
+      acc = signal_stats_[1];
+    else
+      return false;
+  }
+  stats = VoiceSignalStats();
+  stats.samples = acc.samples;
+  stats.clipped = acc.clipped;
+  stats.peak = acc.peak / 32768.0f;
+  if (acc.samples) {
+    ms = static_cast<double>(acc.sum_sq) / acc.samples;
+    stats.rms = sqrt(ms) / 32768.0;
+    // full scale sine 0 dBFS, floor -96
+    if (ms > 0)
+      stats.rms_dbfs = 10.0 * log10(ms * 2.0 / (32768.0 * 32768.0));
+    if (stats.rms_dbfs < -96.0f)
+      stats.rms_dbfs = -96.0f;
+  }
+  return true;
+}
+
+void SpeechImpl::get_voice_stage_stats(vector<VoiceStageStats>& stats) {
+  frontend_.get_stage_stats(stats);
+}
+
+void SpeechImpl::prewarm() {
+  if (!initialized_)
+    return;
+  KLOGV(tag__, "prewarm");
+  connection_.prewarm();
+}
+
 static SpeechResultType poptype_to_restype(int32_t type) {
   static SpeechResultType _tps[] = {
     SPEECH_RES_INTER,
@@ -411,6 +1106,7 @@ bool SpeechImpl::poll(SpeechResult& res) {
         res.type = SPEECH_RES_CANCELLED;
         res.err = SPEECH_SUCCESS;
         controller_.remove_front_op();
+        disarm_deadline(res.id);
         KLOGV(tag__, "SpeechImpl.poll (%d) cancelled, "
             "remove front op", op->id);
         KLOGI(tag__, "voice recognize (%d) CANCELLED", res.id);
@@ -424,6 +1120,7 @@ bool SpeechImpl::poll(SpeechResult& res) {
         res.type = SPEECH_RES_ERROR;
         res.err = op->error;
         controller_.remove_front_op();
+        disarm_deadline(res.id);
         KLOGV(tag__, "SpeechImpl.poll (%d) error, "
             "remove front op", op->id);
         KLOGI(tag__, "voice recognize (%d) ERROR: %u - %s",
@@ -468,6 +1165,7 @@ bool SpeechImpl::poll(SpeechResult& res) {
           if (res.type >= SPEECH_RES_END) {
             KLOGV(tag__, "SpeechImpl.poll (%d) end", res.id);
             controller_.remove_front_op();
+            disarm_deadline(res.id);
           }
           return true;
         }
@@ -497,6 +1195,9 @@ void SpeechImpl::send_reqs() {
   int32_t r;
   int32_t id;
   shared_ptr<string> voice;
+  shared_ptr<string> frame;
+  vector<shared_ptr<string> > more;
+  shared_ptr<VoiceReqArg> arg;
   uint32_t err;
   int32_t rv;
   shared_ptr<SpeechReqInfo> info;
@@ -509,12 +1210,35 @@ void SpeechImpl::send_reqs() {
     if (!initialized_)
       break;
     r = voice_reqs_.pop(id, voice, err);
+    more.clear();
+    arg.reset();
+    if (r >= 0)
+      arg = voice_reqs_.get_arg(id);
+    if (r == ReqStreamQueue::POP_TYPE_DATA) {
+      voice_dequeued(id, voice->length());
+      if (arg.get() && is_stream_codec(arg->speech->codec))
+        pace_voice(id, arg->speech->codec, voice, locker);
+      // frames queued meanwhile, sent without locking again per frame
+      while (more.size() < MAX_VOICE_BATCH - 1
+          && voice_reqs_.pop_data(id, frame)) {
+        voice_dequeued(id, frame->length());
+        more.push_back(frame);
+      }
+      stats_.sent_voice_frames += more.size() + 1;
+      ++stats_.voice_send_batches;
+    } else if (r > ReqStreamQueue::POP_TYPE_START) {
+      voice_dequeued(id, 0);
+    }
     if (r >= 0) {
       info.reset(new SpeechReqInfo());
       info->id = id;
       info->type = sqtype_to_reqtype(r);
       info->data = voice;
-      info->options = voice_reqs_.get_arg(id);
+      info->more.swap(more);
+      if (arg.get()) {
+        info->options = arg->voice;
+        info->speech_options = arg->speech;
+      }
     } else {
       bool has_req = false;
       if (!text_reqs_.empty()) {
@@ -569,6 +1293,7 @@ bool SpeechImpl::do_ctl_change_op(shared_ptr<SpeechReqInfo>& req) {
     assert(op.get() == NULL);
     locker.lock();
     controller_.new_op(req->id, SpeechStatus::START);
+    drop_unpolled_ops();
     return true;
   }
   if (op.get()) {
@@ -577,7 +1302,12 @@ bool SpeechImpl::do_ctl_change_op(shared_ptr<SpeechReqInfo>& req) {
       return true;
     if (req->type == SpeechReqType::CANCELLED) {
       locker.lock();
-      op->status = SpeechStatus::CANCELLED;
+      if (expired_ids_.erase(req->id)) {
+        op->status = SpeechStatus::ERROR;
+        op->error = SPEECH_TIMEOUT;
+      } else {
+        op->status = SpeechStatus::CANCELLED;
+      }
       controller_.clear_current_op();
       resp_cond_.notify_one();
       return true;
@@ -586,7 +1316,11 @@ bool SpeechImpl::do_ctl_change_op(shared_ptr<SpeechReqInfo>& req) {
   }
   if (req->type == SpeechReqType::CANCELLED) {
     locker.lock();
-    controller_.new_op(req->id, SpeechStatus::CANCELLED);
+    if (expired_ids_.erase(req->id))
+      controller_.new_op(req->id, SpeechStatus::ERROR, SPEECH_TIMEOUT);
+    else
+      controller_.new_op(req->id, SpeechStatus::CANCELLED);
+    drop_unpolled_ops();
     // no data send to server
     // notify 'poll' function to generate 'CANCEL' result
     resp_cond_.notify_one();
@@ -595,28 +1329,44 @@ bool SpeechImpl::do_ctl_change_op(shared_ptr<SpeechReqInfo>& req) {
   return false;
 }
 
+void SpeechImpl::drop_unpolled_ops() {
+  shared_ptr<SpeechOperationController::Operation> op;
+  shared_ptr<SpeechResultIn> resin;
+  int32_t id;
+  uint32_t err;
+
+  while (controller_.over_limit()) {
+    op = controller_.front_op();
+    // as 'poll' does for cancelled op
+    if (responses_.erase(op->id))
+      responses_.pop(id, resin, err);
+    KLOGW(tag__, "speech %d results not polled, dropped", op->id);
+    controller_.drop_front_op();
+  }
+}
+
 void SpeechImpl::req_config(SpeechRequest& req,
-    const shared_ptr<VoiceOptions>& options) {
+    const shared_ptr<VoiceOptions>& options, const SpeechOptionsHolder& sopts) {
   SpeechOptionsEnc* sopt = req.mutable_options();
   rokid_open_speech_v1_Codec codec;
 
-  sopt->set_lang(static_cast<rokid_open_speech_v2_Lang>(options_.lang));
+  sopt->set_lang(static_cast<rokid_open_speech_v2_Lang>(sopts.lang));
 #ifdef HAS_OPUS_CODEC
-  codec = (options_.codec == Codec::PCM)
+  codec = (sopts.codec == Codec::PCM)
     ? rokid_open_speech_v1_Codec_OPU
-    : static_cast<rokid_open_speech_v1_Codec>(options_.codec);
+    : static_cast<rokid_open_speech_v1_Codec>(sopts.codec);
 #else
-  codec = static_cast<rokid_open_speech_v1_Codec>(options_.codec);
+  codec = static_cast<rokid_open_speech_v1_Codec>(sopts.codec);
 #endif
   sopt->set_codec(codec);
-  sopt->set_vad_mode(static_cast<rokid_open_speech_v2_VadMode>(options_.vad_mode));
-  sopt->set_vend_timeout(options_.vend_timeout);
-  sopt->set_no_nlp(options_.no_nlp);
-  sopt->set_no_intermediate_asr(options_.no_intermediate_asr);
-  sopt->set_vad_begin(options_.vad_begin);
+  sopt->set_vad_mode(static_cast<rokid_open_speech_v2_VadMode>(sopts.vad_mode));
+  sopt->set_vend_timeout(sopts.vend_timeout);
+  sopt->set_no_nlp(sopts.no_nlp);
+  sopt->set_no_intermediate_asr(sopts.no_intermediate_asr);
+  sopt->set_vad_begin(sopts.vad_begin);
   KLOGI(tag__, "speech config: codec(%d), vad mode(%d:%u), vad begin(%u), no nlp(%d), no intermediate asr(%d), voice fragment(%u)",
-      codec, options_.vad_mode, options_.vend_timeout, options_.vad_begin,
-      options_.no_nlp, options_.no_intermediate_asr, options_.voice_fragment);
+      codec, sopts.vad_mode, sopts.vend_timeout, sopts.vad_begin,
+      sopts.no_nlp, sopts.no_intermediate_asr, sopts.voice_fragment);
   if (options.get()) {
     sopt->set_stack(options->stack);
     sopt->set_voice_trigger(options->voice_trigger);
@@ -628,12 +1378,31 @@ void SpeechImpl::req_config(SpeechRequest& req,
     sopt->set_voice_extra(options->voice_extra);
     KLOGD(tag__, "VoiceOptions: stack(%s), voice_trigger(%s), "
         "trigger_start(%u), trigger_length(%u), voice_power(%f), "
-        "skill_options(%s), voice_extra(%s), trigger_confirm_by_cloud(%d)",
+        "skill_options(%s), voice_extra(%s), trigger_confirm_by_cloud(%d), "
+        "deadline(%u)",
         options->stack.c_str(), options->voice_trigger.c_str(),
         options->trigger_start, options->trigger_length,
         options->voice_power, options->skill_options.c_str(),
-        options->voice_extra.c_str(), options->trigger_confirm_by_cloud);
+        options->voice_extra.c_str(), options->trigger_confirm_by_cloud,
+        options->deadline);
+  }
+}
+
+ConnectionOpResult SpeechImpl::send_voice_batch(SpeechRequest& treq,
+    shared_ptr<SpeechReqInfo>& req, uint32_t timeout) {
+  vector<string> bufs(req->more.size() + 1);
+  size_t i;
+
+  // same req, only voice changed
+  for (i = 0; i < bufs.size(); ++i) {
+    if (i)
+      treq.set_voice(*req->more[i - 1]);
+    if (!treq.SerializeToString(&bufs[i])) {
+      KLOGW(tag__, "send voice: protobuf serialize failed");
+      return ConnectionOpResult::INVALID_PB_OBJ;
+    }
   }
+  return connection_.send_batch(bufs, timeout);
 }
 
 int32_t SpeechImpl::do_request(shared_ptr<SpeechReqInfo>& req) {
@@ -645,7 +1414,7 @@ int32_t SpeechImpl::do_request(shared_ptr<SpeechReqInfo>& req) {
       treq.set_id(req->id);
       treq.set_type(rokid_open_speech_v1_ReqType_TEXT);
       treq.set_asr(*req->data);
-      req_config(treq, req->options);
+      req_config(treq, req->options, *req->speech_options);
       rv = 0;
       send_timeout = WS_SEND_TIMEOUT;
 
@@ -661,7 +1430,7 @@ int32_t SpeechImpl::do_request(shared_ptr<SpeechReqInfo>& req) {
     case SpeechReqType::VOICE_START: {
       treq.set_id(req->id);
       treq.set_type(rokid_open_speech_v1_ReqType_START);
-      req_config(treq, req->options);
+      req_config(treq, req->options, *req->speech_options);
       send_timeout = WS_SEND_TIMEOUT;
 
 #ifdef SPEECH_STATISTIC
@@ -693,8 +1462,8 @@ int32_t SpeechImpl::do_request(shared_ptr<SpeechReqInfo>& req) {
       treq.set_id(req->id);
       treq.set_type(rokid_open_speech_v1_ReqType_VOICE);
       treq.set_voice(*req->data);
-      KLOGV(tag__, "SpeechImpl.do_request (%d) send voice data",
-          req->id);
+      KLOGV(tag__, "SpeechImpl.do_request (%d) send voice data, "
+          "%lu frames", req->id, req->more.size() + 1);
       break;
     default:
       KLOGW(tag__, "SpeechImpl.do_request: (%d) req type is %u, "
@@ -703,7 +1472,32 @@ int32_t SpeechImpl::do_request(shared_ptr<SpeechReqInfo>& req) {
       return -1;
   }
 
-  ConnectionOpResult r = connection_.send(treq, send_timeout);
+  ConnectionOpResult r;
+  unique_lock<mutex> ret_locker(retention_mutex_);
+  retain_req(req);
+  if (retention_.id == req->id && req->type != SpeechReqType::VOICE_START
+      && connection_.ready_id() != retention_.conn_id) {
+    // connection changed after voice start, not send to new connection
+    // directly, server not know this voice
+    r = replay_voice();
+  } else {
+    if (req->more.empty())
+      r = connection_.send(treq, send_timeout);
+    else
+      r = send_voice_batch(treq, req, send_timeout);
+    if (retention_.id == req->id) {
+      if (r == ConnectionOpResult::SUCCESS) {
+        if (req->type == SpeechReqType::VOICE_START)
+          retention_.conn_id = connection_.ready_id();
+      } else if (r == ConnectionOpResult::CONNECTION_NOT_AVAILABLE
+          && req->type != SpeechReqType::VOICE_START) {
+        r = replay_voice();
+      }
+    }
+  }
+  if (r != ConnectionOpResult::SUCCESS && retention_.id == req->id)
+    drop_retention_locked();
+  ret_locker.unlock();
   if (r != ConnectionOpResult::SUCCESS) {
     SpeechError err = SPEECH_UNKNOWN;
     if (r == ConnectionOpResult::CONNECTION_NOT_AVAILABLE)
@@ -718,6 +1512,10 @@ int32_t SpeechImpl::do_request(shared_ptr<SpeechReqInfo>& req) {
   } else if (rv == 0) {
     KLOGV(tag__, "req (%d) last data sent, req done", req->id);
   }
+  if (req->type == SpeechReqType::VOICE_DATA) {
+    controller_.refresh_send_time();
+    return rv;
+  }
   lock_guard<mutex> locker(resp_mutex_);
   controller_.refresh_op_time(false);
   return rv;
@@ -752,6 +1550,7 @@ void SpeechImpl::gen_results() {
         resp_cond_.notify_one();
         locker.unlock();
         erase_req(id);
+        drop_retention(id);
 #ifdef SPEECH_STATISTIC
         finish_cur_req();
 #endif
@@ -760,12 +1559,21 @@ void SpeechImpl::gen_results() {
     } else if (r == ConnectionOpResult::CONNECTION_BROKEN) {
       shared_ptr<SpeechOperationController::Operation> op
         = controller_.current_op();
+      if (op.get()) {
+        locker.unlock();
+        // voice resent on new connection, app not aware of the broken
+        if (recover_voice(op->id))
+          continue;
+        locker.lock();
+        op = controller_.current_op();
+      }
       KLOGI(tag__, "connection broken, current speech abort");
       controller_.set_op_error(SPEECH_SERVICE_UNAVAILABLE);
       resp_cond_.notify_one();
       locker.unlock();
       if (op.get()) {
         erase_req(op->id);
+        drop_retention(op->id);
 #ifdef SPEECH_STATISTIC
         finish_cur_req();
 #endif
@@ -779,6 +1587,7 @@ void SpeechImpl::gen_results() {
       locker.unlock();
       if (op.get()) {
         erase_req(op->id);
+        drop_retention(op->id);
 #ifdef SPEECH_STATISTIC
         finish_cur_req();
 #endif
@@ -873,6 +1682,7 @@ void SpeechImpl::gen_result_by_resp(SpeechResponse& resp, unique_lock<mutex>& re
     resp_locker.unlock();
     if (erase_req_id > 0) {
       erase_req(erase_req_id);
+      drop_retention(erase_req_id);
     }
     resp_locker.lock();
   }
@@ -894,7 +1704,7 @@ shared_ptr<Speech> Speech::new_instance() {
 
 VoiceOptions::VoiceOptions()
   : trigger_start(0), trigger_length(0)
-  , trigger_confirm_by_cloud(1), voice_power(0.0) {
+  , trigger_confirm_by_cloud(1), voice_power(0.0), deadline(0) {
 }
 
 VoiceOptions& VoiceOptions::operator = (const VoiceOptions& options) {
@@ -906,6 +1716,7 @@ VoiceOptions& VoiceOptions::operator = (const VoiceOptions& options) {
   voice_power = options.voice_power;
   skill_options = options.skill_options;
   voice_extra = options.voice_extra;
+  deadline = options.deadline;
   return *this;
 }
 
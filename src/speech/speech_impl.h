@@ -1,8 +1,11 @@
 #pragma once
 
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
 #include <list>
+#include <map>
+#include <set>
 #include <string>
 #include <memory>
 #include <thread>
@@ -11,7 +14,9 @@
 #include "types.h"
 #include "op_ctl.h"
 #include "pending_queue.h"
+#include "timer_wheel.h"
 #include "speech_connection.h"
+#include "voice_frontend.h"
 #include "nanopb_encoder.h"
 #include "nanopb_decoder.h"
 #ifdef HAS_OPUS_CODEC
@@ -22,7 +27,7 @@ namespace rokid {
 namespace speech {
 
 typedef OperationController<SpeechStatus, SpeechError> SpeechOperationController;
-typedef StreamQueue<std::string, VoiceOptions> ReqStreamQueue;
+typedef StreamQueue<std::string, VoiceReqArg> ReqStreamQueue;
 typedef StreamQueue<SpeechResultIn, int32_t> RespStreamQueue;
 
 class SpeechOptionsHolder {
@@ -36,6 +41,20 @@ public:
 	uint32_t vad_begin = 0;
 	std::string log_host;
 	uint32_t voice_fragment = 0xffffffff;
+	uint32_t replay_max_bytes = 131072;
+	uint32_t replay_timeout = 3000;
+	uint32_t voice_session_budget = 524288;
+	uint32_t voice_instance_budget = 1048576;
+	VoiceDropPolicy voice_drop_policy = VoiceDropPolicy::DROP_OLDEST;
+	uint32_t opus_min_bitrate = 12000;
+	uint32_t opus_max_bitrate = 27800;
+	OpusProfile opus_profile;
+	uint32_t input_sample_rate = VOICE_SAMPLE_RATE;
+	SampleFormat input_format = SampleFormat::S16;
+	uint32_t input_channels = 1;
+	uint32_t input_channel_mask = 0;
+	std::vector<std::shared_ptr<VoiceStage> > voice_stages;
+	uint32_t max_pending_ops = DEFAULT_MAX_OPS;
 	int32_t log_port = 0;
 	uint32_t no_nlp:1;
 	uint32_t no_intermediate_asr:1;
@@ -56,7 +75,7 @@ public:
 
 	int32_t start_voice(const VoiceOptions* options);
 
-	void put_voice(int32_t id, const uint8_t* data, uint32_t length);
+	int32_t put_voice(int32_t id, const uint8_t* data, uint32_t length);
 
 	void end_voice(int32_t id);
 
@@ -68,8 +87,30 @@ public:
 
 	void reconn();
 
+	void get_connection_stats(ConnectionStats& stats);
+
+	void get_stats(SpeechStats& stats);
+
+	bool get_voice_stats(int32_t id, VoiceSignalStats& stats);
+
+	void get_voice_stage_stats(std::vector<VoiceStageStats>& stats);
+
+	void prewarm();
+
 private:
-	inline int32_t next_id() { return ++next_id_; }
+	inline int32_t next_id() {
+		return next_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+	}
+
+	// latest options, not changed after published
+	inline std::shared_ptr<const SpeechOptionsHolder> options_snapshot() {
+		return std::atomic_load(&options_);
+	}
+
+	// put_voice of new voice 'id', apply options of the voice
+	// to 'frontend_' and encoder if config changed
+	// put_voice thread only
+	bool switch_voice(int32_t id);
 
 	void send_reqs();
 
@@ -81,35 +122,129 @@ private:
 
 	int32_t do_request(std::shared_ptr<SpeechReqInfo>& req);
 
+	// 'treq' with voice of 'req->data' set, send it and 'req->more'
+	ConnectionOpResult send_voice_batch(SpeechRequest& treq,
+			std::shared_ptr<SpeechReqInfo>& req, uint32_t timeout);
+
 	bool do_ctl_change_op(std::shared_ptr<SpeechReqInfo>& req);
 
+	// drop results of oldest operations beyond 'max_pending_ops'
+	// must lock 'resp_mutex_' before invoke
+	void drop_unpolled_ops();
+
 	void req_config(SpeechRequest& req,
-			const std::shared_ptr<VoiceOptions>& options);
+			const std::shared_ptr<VoiceOptions>& options,
+			const SpeechOptionsHolder& sopts);
 
 	void erase_req(int32_t id);
 
+	// speech 'id' ends with SPEECH_TIMEOUT after 'deadline' milliseconds
+	void arm_deadline(int32_t id, uint32_t deadline);
+
+	// result of 'id' polled, deadline not needed
+	void disarm_deadline(int32_t id);
+
+	// invoked by timer wheel thread
+	void on_deadline(int32_t id);
+
+	// queue voice data within budget
+	// must lock 'req_mutex_' before invoke
+	int32_t queue_voice(int32_t id, std::shared_ptr<std::string>& data,
+			const SpeechOptionsHolder& opts);
+
+	// voice data of 'id' popped, 'length' 0: stream finished
+	// must lock 'req_mutex_' before invoke
+	void voice_dequeued(int32_t id, uint32_t length);
+
+	// merge signal statistics of voice 'id'
+	// must lock 'req_mutex_' before invoke
+	void add_signal_stats(const VoiceSignalAcc& acc);
+
+	// bytes per second of voice sent to server
+	uint32_t voice_byte_rate(Codec codec);
+
+	// wait while connection send backlog too large,
+	// then merge queued voice of 'id' into 'voice'
+	// must lock 'req_mutex_' before invoke
+	void pace_voice(int32_t id, Codec codec,
+			std::shared_ptr<std::string>& voice,
+			std::unique_lock<std::mutex>& locker);
+
+#ifdef HAS_OPUS_CODEC
+	// opus bitrate follows uplink throughput and rtt
+	void adapt_bitrate();
+
+	// init encoder at max bitrate, or clamp bitrate to new range
+	void config_encoder(const SpeechOptionsHolder& opts);
+#endif
+
+	// update 'retention_' before send 'req'
+	// must lock 'retention_mutex_' before invoke
+	void retain_req(std::shared_ptr<SpeechReqInfo>& req);
+
+	// resend voice start and retained voice on new connection
+	// must lock 'retention_mutex_' before invoke
+	ConnectionOpResult replay_voice();
+
+	// connection broken, try replay voice 'id'
+	// return false if voice not recoverable
+	bool recover_voice(int32_t id);
+
+	void drop_retention(int32_t id);
+
+	// must lock 'retention_mutex_' before invoke
+	void drop_retention_locked();
+
 #ifdef SPEECH_STATISTIC
 	void finish_cur_req();
 #endif
 
 private:
-	int32_t next_id_;
-	SpeechOptionsHolder options_;
+	std::atomic<int32_t> next_id_;
+	// immutable snapshot, replaced as a whole by 'config'
+	// read by std::atomic_load, writers serialized by 'init_mutex_'
+	// requests capture it when created
+	std::shared_ptr<const SpeechOptionsHolder> options_;
 	SpeechConnection connection_;
 	std::list<std::shared_ptr<SpeechReqInfo> > text_reqs_;
 	ReqStreamQueue voice_reqs_;
+	// bytes of voice queued per voice id, not sent yet
+	// protected by 'req_mutex_'
+	std::map<int32_t, QueuedVoice> queued_voice_;
+	SpeechStats stats_;
+	// signal statistics of latest two voice ids, [0] is the latest
+	// protected by 'req_mutex_'
+	VoiceSignalAcc signal_stats_[2];
 	RespStreamQueue responses_;
 	std::mutex init_mutex_;
 	std::mutex req_mutex_;
 	std::condition_variable req_cond_;
 	std::mutex resp_mutex_;
 	std::condition_variable resp_cond_;
+	// lock order: 'retention_mutex_' before 'req_mutex_', 'resp_mutex_'
+	std::mutex retention_mutex_;
+	VoiceRetention retention_;
 	SpeechOperationController controller_;
+	// timers of speech deadlines, shared timer wheel
+	// lock order: after 'req_mutex_', 'resp_mutex_'
+	std::mutex deadline_mutex_;
+	std::map<int32_t, TimerWheel::TimerId> deadlines_;
+	// expired before sent, cancelled req of these ids ends with error
+	// protected by 'resp_mutex_'
+	std::set<int32_t> expired_ids_;
 	std::thread* req_thread_;
 	std::thread* resp_thread_;
 	bool initialized_;
+	// put_voice thread only, as 'opus_encoder_'
+	VoiceFrontend frontend_;
+	// voice id 'frontend_' processing
+	int32_t frontend_id_;
+	// options of voice 'frontend_id_', 'frontend_' and encoder
+	// configured by it
+	std::shared_ptr<const SpeechOptionsHolder> voice_options_;
 #ifdef HAS_OPUS_CODEC
 	RKOpusEncoder opus_encoder_;
+	SteadyClock::time_point bitrate_tp_;
 #endif
 #ifdef SPEECH_STATISTIC
 	TraceInfo cur_trace_info_;
@@ -3,14 +3,19 @@
 #include <stdint.h>
 #include <memory>
 #include <string>
+#include <list>
+#include <vector>
 #include "speech.pb.h"
 #include "speech.h"
+#include "alt_chrono.h"
 
 #define SOCKET_BUF_SIZE 0x40000
 
 namespace rokid {
 namespace speech {
 
+class SpeechOptionsHolder;
+
 enum class SpeechReqType {
 	TEXT,
 	VOICE_START,
@@ -23,9 +28,51 @@ typedef struct {
 	int32_t id;
 	SpeechReqType type;
 	std::shared_ptr<std::string> data;
+	// VOICE_DATA: frames dequeued with 'data', sent after it
+	std::vector<std::shared_ptr<std::string> > more;
 	std::shared_ptr<VoiceOptions> options;
+	// SpeechOptions snapshot when request created
+	std::shared_ptr<const SpeechOptionsHolder> speech_options;
 } SpeechReqInfo;
 
+// start_voice参数, 及当时的SpeechOptions快照
+// 语音进行中config不影响此语音
+typedef struct {
+	std::shared_ptr<VoiceOptions> voice;
+	std::shared_ptr<const SpeechOptionsHolder> speech;
+} VoiceReqArg;
+
+// 语音请求尚未发送的数据
+typedef struct QueuedVoice {
+	uint32_t bytes = 0;
+	uint32_t frames = 0;
+} QueuedVoice;
+
+// 语音请求的信号统计累加值
+typedef struct VoiceSignalAcc {
+	int32_t id = 0;
+	uint32_t samples = 0;
+	uint64_t sum_sq = 0;
+	uint32_t peak = 0;
+	uint32_t clipped = 0;
+} VoiceSignalAcc;
+
+// 当前语音请求已发送的数据, 连接断开后在新连接上重发
+typedef struct {
+	// 0: no voice retained
+	int32_t id;
+	std::shared_ptr<VoiceOptions> options;
+	std::shared_ptr<const SpeechOptionsHolder> speech_options;
+	std::list<std::shared_ptr<std::string> > frames;
+	uint32_t bytes;
+	// SpeechConnection.ready_id() of connection the voice sent on
+	uint32_t conn_id;
+	// voice end sent
+	bool ended;
+	bool broken;
+	SteadyClock::time_point broken_tp;
+} VoiceRetention;
+
 /**
 typedef struct {
 	int32_t id;
@@ -0,0 +1,243 @@
+#include <string.h>
+#include "voice_frontend.h"
+#include "voice_simd.h"
+#include "alt_chrono.h"
+#include "rlog.h"
+
+#define FRONTEND_TAG "speech.VoiceFrontend"
+// samples converted a time, fit in L1 cache
+#define BLOCK_SAMPLES 512
+
+using std::lock_guard;
+using std::mutex;
+using std::shared_ptr;
+using std::vector;
+using std::chrono::duration_cast;
+using std::chrono::nanoseconds;
+
+namespace rokid {
+namespace speech {
+
+static uint32_t sample_bytes(SampleFormat format) {
+  return format == SampleFormat::S16 ? sizeof(int16_t) : sizeof(int32_t);
+}
+
+VoiceFrontend::VoiceFrontend() : in_rate_(VOICE_SAMPLE_RATE),
+    format_(SampleFormat::S16), channels_(1), channel_mask_(0),
+    frame_bytes_(sizeof(int16_t)), carry_bytes_(0), has_stages_(false) {
+  gains_[0] = 1.0f;
+}
+
+bool VoiceFrontend::init(uint32_t in_rate, SampleFormat format,
+    uint32_t channels, uint32_t channel_mask) {
+  uint32_t c;
+  uint32_t mixed = 0;
+  float scale;
+  bool r = true;
+
+  if (in_rate == in_rate_ && format == format_ && channels == channels_
+      && channel_mask == channel_mask_)
+    return true;
+  if (channels == 0 || channels > MAX_INPUT_CHANNELS) {
+    KLOGW(FRONTEND_TAG, "input channels %u not supported, regard as 1",
+        channels);
+    channels = 1;
+    r = false;
+  }
+  if (channels < 32 && (channel_mask >> channels))
+    channel_mask &= (1u << channels) - 1;
+  if (channel_mask == 0)
+    channel_mask = channels < 32 ? (1u << channels) - 1 : 0xffffffff;
+  for (c = 0; c < channels; ++c) {
+    if (channel_mask & (1u << c))
+      ++mixed;
+  }
+  if (!resampler_.init(in_rate, VOICE_SAMPLE_RATE)) {
+    KLOGW(FRONTEND_TAG, "input sample rate %u not supported, regard as %u",
+        in_rate, VOICE_SAMPLE_RATE);
+    resampler_.init(VOICE_SAMPLE_RATE, VOICE_SAMPLE_RATE);
+    in_rate = VOICE_SAMPLE_RATE;
+    r = false;
+  }
+  in_rate_ = in_rate;
+  format_ = format;
+  channels_ = channels;
+  channel_mask_ = channel_mask;
+  frame_bytes_ = sample_bytes(format) * channels;
+  // scale to int16 range, average of mixed channels
+  if (format == SampleFormat::S32)
+    scale = 1.0f / 65536.0f;
+  else if (format == SampleFormat::F32)
+    scale = 32768.0f;
+  else
+    scale = 1.0f;
+  for (c = 0; c < channels; ++c)
+    gains_[c] = (channel_mask & (1u << c)) ? scale / mixed : 0.0f;
+  carry_bytes_ = 0;
+  KLOGI(FRONTEND_TAG, "input pcm %u Hz, format %d, %u channels, "
+      "mask 0x%x", in_rate, static_cast<int>(format), channels,
+      channel_mask);
+  return r;
+}
+
+void VoiceFrontend::set_stages(const vector<shared_ptr<VoiceStage> >& stages) {
+  size_t i;
+  lock_guard<mutex> locker(stage_mutex_);
+  if (stages.size() == stages_.size()) {
+    for (i = 0; i < stages.size(); ++i) {
+      if (stages[i] != stages_[i].stage)
+        break;
+    }
+    if (i == stages.size())
+      return;
+  }
+  stages_.clear();
+  for (i = 0; i < stages.size(); ++i) {
+    if (stages[i].get() == NULL)
+      continue;
+    StageSlot slot = { stages[i], 0, 0, 0, 0 };
+    stages_.push_back(slot);
+    KLOGI(FRONTEND_TAG, "voice stage %u: %s",
+        static_cast<uint32_t>(stages_.size() - 1), stages[i]->name());
+  }
+  has_stages_ = !stages_.empty();
+}
+
+void VoiceFrontend::get_stage_stats(vector<VoiceStageStats>& stats) {
+  lock_guard<mutex> locker(stage_mutex_);
+  stats.resize(stages_.size());
+  for (size_t i = 0; i < stages_.size(); ++i) {
+    stats[i].name = stages_[i].stage->name();
+    stats[i].calls = stages_[i].calls;
+    stats[i].samples = stages_[i].samples;
+    stats[i].total_us = stages_[i].total_ns / 1000;
+    stats[i].max_us = stages_[i].max_ns / 1000;
+  }
+}
+
+void VoiceFrontend::reset() {
+  resampler_.reset();
+  carry_bytes_ = 0;
+  lock_guard<mutex> locker(stage_mutex_);
+  for (size_t i = 0; i < stages_.size(); ++i)
+    stages_[i].stage->reset();
+}
+
+void VoiceFrontend::run_stages(float* samples, uint32_t n) {
+  SteadyClock::time_point tp;
+  SteadyClock::time_point now;
+  uint64_t ns;
+  lock_guard<mutex> locker(stage_mutex_);
+  if (stages_.empty())
+    return;
+  tp = SteadyClock::now();
+  for (size_t i = 0; i < stages_.size(); ++i) {
+    StageSlot& slot = stages_[i];
+    slot.stage->process(samples, n);
+    now = SteadyClock::now();
+    ns = duration_cast<nanoseconds>(now - tp).count();
+    tp = now;
+    ++slot.calls;
+    slot.samples += n;
+    slot.total_ns += ns;
+    if (ns > slot.max_ns)
+      slot.max_ns = ns;
+  }
+}
+
+void VoiceFrontend::convert(const uint8_t* data, uint32_t frames,
+    float* out) {
+  float block[BLOCK_SAMPLES];
+  int32_t raw[BLOCK_SAMPLES];
+  uint32_t block_frames = BLOCK_SAMPLES / channels_;
+  uint32_t k;
+  uint32_t n;
+  const float* src;
+  bool aligned = reinterpret_cast<uintptr_t>(data)
+    % sample_bytes(format_) == 0;
+
+  if (block_frames == 0)
+    block_frames = 1;
+  while (frames) {
+    k = frames < block_frames ? frames : block_frames;
+    n = k * channels_;
+    // unaligned input copied to aligned buffer first
+    const void* p = data;
+    if (!aligned) {
+      memcpy(raw, data, k * frame_bytes_);
+      p = raw;
+    }
+    switch (format_) {
+      case SampleFormat::S16:
+        s16_to_float(reinterpret_cast<const int16_t*>(p), block, n);
+        src = block;
+        break;
+      case SampleFormat::S32:
+        s32_to_float(reinterpret_cast<const int32_t*>(p), block, n);
+        src = block;
+        break;
+      default:
+        // float input mixed in place
+        src = reinterpret_cast<const float*>(p);
+        break;
+    }
+    mix_channels(src, k, channels_, gains_, out);
+    data += k * frame_bytes_;
+    out += k;
+    frames -= k;
+  }
+}
+
+const int16_t* VoiceFrontend::process(const uint8_t* data, uint32_t length,
+    uint32_t& samples) {
+  uint32_t frames = (carry_bytes_ + length) / frame_bytes_;
+  uint32_t max_out = resampler_.max_output(frames);
+  uint32_t done = 0;
+  uint32_t need;
+  uint32_t n;
+  float* mono;
+
+  if (in_buf_.size() < frames)
+    in_buf_.resize(frames);
+  if (out_buf_.size() < max_out)
+    out_buf_.resize(max_out);
+  if (pcm_.size() < max_out)
+    pcm_.resize(max_out);
+  samples = 0;
+  mono = in_buf_.data();
+  // complete partial frame of previous invocation
+  if (carry_bytes_) {
+    uint8_t* carry = reinterpret_cast<uint8_t*>(carry_);
+    need = frame_bytes_ - carry_bytes_;
+    if (length < need) {
+      memcpy(carry + carry_bytes_, data, length);
+      carry_bytes_ += length;
+      return pcm_.data();
+    }
+    memcpy(carry + carry_bytes_, data, need);
+    convert(carry, 1, mono);
+    data += need;
+    length -= need;
+    carry_bytes_ = 0;
+    done = 1;
+  }
+  n = length / frame_bytes_;
+  convert(data, n, mono + done);
+  carry_bytes_ = length - n * frame_bytes_;
+  if (carry_bytes_)
+    memcpy(carry_, data + n * frame_bytes_, carry_bytes_);
+  frames = done + n;
+  if (resampler_.passthrough()) {
+    samples = frames;
+  } else {
+    samples = resampler_.process(mono, frames, out_buf_.data());
+    mono = out_buf_.data();
+  }
+  if (samples && has_stages_)
+    run_stages(mono, samples);
+  float_to_s16(mono, pcm_.data(), samples);
+  return pcm_.data();
+}
+
+} // namespace speech
+} // namespace rokid
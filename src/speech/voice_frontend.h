@@ -0,0 +1,92 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "speech.h"
+#include "resampler.h"
+
+// sample rate of voice sent to server
+#define VOICE_SAMPLE_RATE 16000
+#define MAX_INPUT_CHANNELS 32
+
+namespace rokid {
+namespace speech {
+
+// put_voice语音前处理
+//   输入pcm格式由SpeechOptions声明: 采样率, 采样格式(int16/int32/float32),
+//   声道数(多声道交错排列)及参与混音的声道
+//   分块转换为float并混音为单声道, 重采样为16k,
+//   经VoiceStage链原地处理后输出int16, 供opus编码或直接发送
+//   与opus编码器相同, 只在put_voice调用线程使用, 不加锁
+class VoiceFrontend {
+public:
+	VoiceFrontend();
+
+	// 'in_rate' sample rate of input pcm
+	// 'channel_mask' bit n: channel n mixed, 0: all channels
+	bool init(uint32_t in_rate, SampleFormat format, uint32_t channels,
+			uint32_t channel_mask);
+
+	// 'stages' processed in order, statistics cleared if changed
+	// may invoke on other thread
+	void set_stages(const std::vector<std::shared_ptr<VoiceStage> >& stages);
+
+	// may invoke on other thread
+	void get_stage_stats(std::vector<VoiceStageStats>& stats);
+
+	// new voice stream, clear history samples
+	void reset();
+
+	// input is 16k mono int16, no processing needed
+	bool passthrough() const {
+		return resampler_.passthrough() && format_ == SampleFormat::S16
+			&& channels_ == 1 && !has_stages_;
+	}
+
+	// 'data' 'length' bytes of input pcm
+	// partial frame at end kept for next invocation
+	// return 16k pcm in internal buffer, 'samples' count of it
+	// valid until next invocation
+	const int16_t* process(const uint8_t* data, uint32_t length,
+			uint32_t& samples);
+
+private:
+	// 'frames' input frames to mono float, int16 range
+	void convert(const uint8_t* data, uint32_t frames, float* out);
+
+	void run_stages(float* samples, uint32_t n);
+
+private:
+	typedef struct {
+		std::shared_ptr<VoiceStage> stage;
+		uint64_t calls;
+		uint64_t samples;
+		uint64_t total_ns;
+		uint64_t max_ns;
+	} StageSlot;
+
+	Resampler resampler_;
+	uint32_t in_rate_;
+	SampleFormat format_;
+	uint32_t channels_;
+	uint32_t channel_mask_;
+	// bytes per input frame (all channels)
+	uint32_t frame_bytes_;
+	// mix gain per channel, sample scale to int16 range included
+	float gains_[MAX_INPUT_CHANNELS];
+	// partial frame of previous 'process', float for alignment
+	float carry_[MAX_INPUT_CHANNELS];
+	uint32_t carry_bytes_;
+	std::vector<float> in_buf_;
+	std::vector<float> out_buf_;
+	std::vector<int16_t> pcm_;
+	// 'stages_' replaced by config thread while put_voice running
+	std::mutex stage_mutex_;
+	std::vector<StageSlot> stages_;
+	std::atomic<bool> has_stages_;
+};
+
+} // namespace speech
+} // namespace rokid
@@ -0,0 +1,391 @@
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define VOICE_SIMD_NEON
+#endif
+
+// 语音前处理向量化基础函数
+// 按编译目标选择 AVX / SSE2 / NEON 实现, 否则使用标量实现
+// 采样值以float表示, 范围与int16相同 [-32768, 32767]
+
+namespace rokid {
+namespace speech {
+
+static inline int16_t saturate_s16(float v) {
+	if (v >= 32767.0f)
+		return 32767;
+	if (v <= -32768.0f)
+		return -32768;
+	return static_cast<int16_t>(lrintf(v));
+}
+
+static inline float dot_product(const float* a, const float* b, uint32_t n) {
+	uint32_t i = 0;
+	float r = 0.0f;
+#if defined(__AVX__)
+	__m256 acc8 = _mm256_setzero_ps();
+	for (; i + 8 <= n; i += 8)
+		acc8 = _mm256_add_ps(acc8, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+					_mm256_loadu_ps(b + i)));
+	__m128 acc = _mm_add_ps(_mm256_castps256_ps128(acc8),
+			_mm256_extractf128_ps(acc8, 1));
+#elif defined(__SSE2__)
+	__m128 acc = _mm_setzero_ps();
+#endif
+#if defined(__AVX__) || defined(__SSE2__)
+	for (; i + 4 <= n; i += 4)
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i),
+					_mm_loadu_ps(b + i)));
+	acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+	acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 0x55));
+	r = _mm_cvtss_f32(acc);
+#elif defined(VOICE_SIMD_NEON)
+	float32x4_t acc = vdupq_n_f32(0.0f);
+	for (; i + 4 <= n; i += 4)
+		acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+	float32x2_t s = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+	r = vget_lane_f32(vpadd_f32(s, s), 0);
+#endif
+	for (; i < n; ++i)
+		r += a[i] * b[i];
+	return r;
+}
+
+static inline void s16_to_float(const int16_t* in, float* out, uint32_t n) {
+	uint32_t i = 0;
+#if defined(__SSE2__)
+	for (; i + 8 <= n; i += 8) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+		// sign extend by arithmetic shift
+		__m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		__m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		_mm_storeu_ps(out + i, _mm_cvtepi32_ps(lo));
+		_mm_storeu_ps(out + i + 4, _mm_cvtepi32_ps(hi));
+	}
+#elif defined(VOICE_SIMD_NEON)
+	for (; i + 8 <= n; i += 8) {
+		int16x8_t v = vld1q_s16(in + i);
+		vst1q_f32(out + i, vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))));
+		vst1q_f32(out + i + 4, vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))));
+	}
+#endif
+	for (; i < n; ++i)
+		out[i] = in[i];
+}
+
+// no scaling, int32 range
+static inline void s32_to_float(const int32_t* in, float* out, uint32_t n) {
+	uint32_t i = 0;
+#if defined(__SSE2__)
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(out + i, _mm_cvtepi32_ps(_mm_loadu_si128(
+						reinterpret_cast<const __m128i*>(in + i))));
+#elif defined(VOICE_SIMD_NEON)
+	for (; i + 4 <= n; i += 4)
+		vst1q_f32(out + i, vcvtq_f32_s32(vld1q_s32(in + i)));
+#endif
+	for (; i < n; ++i)
+		out[i] = static_cast<float>(in[i]);
+}
+
+static inline void scale_float(const float* in, float* out, uint32_t n,
+		float k) {
+	uint32_t i = 0;
+#if defined(__SSE2__)
+	__m128 vk = _mm_set1_ps(k);
+	for (; i + 4 <= n; i += 4)
+		_mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(in + i), vk));
+#elif defined(VOICE_SIMD_NEON)
+	for (; i + 4 <= n; i += 4)
+		vst1q_f32(out + i, vmulq_n_f32(vld1q_f32(in + i), k));
+#endif
+	for (; i < n; ++i)
+		out[i] = in[i] * k;
+}
+
+// interleaved 'channels' to mono, out[f] = sum(in[f][c] * gains[c])
+static inline void mix_channels(const float* in, uint32_t frames,
+		uint32_t channels, const float* gains, float* out) {
+	uint32_t f = 0;
+	uint32_t c;
+	if (channels == 1) {
+		scale_float(in, out, frames, gains[0]);
+		return;
+	}
+#if defined(__SSE2__)
+	if (channels % 4 == 0) {
+		// 4 frames a time, transpose to channel major and sum
+		for (; f + 4 <= frames; f += 4) {
+			const float* p = in + f * channels;
+			__m128 acc = _mm_setzero_ps();
+			for (c = 0; c < channels; c += 4) {
+				__m128 g = _mm_loadu_ps(gains + c);
+				__m128 r0 = _mm_mul_ps(_mm_loadu_ps(p + c), g);
+				__m128 r1 = _mm_mul_ps(_mm_loadu_ps(p + channels + c), g);
+				__m128 r2 = _mm_mul_ps(_mm_loadu_ps(p + channels * 2 + c), g);
+				__m128 r3 = _mm_mul_ps(_mm_loadu_ps(p + channels * 3 + c), g);
+				_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+				acc = _mm_add_ps(acc, _mm_add_ps(_mm_add_ps(r0, r1),
+							_mm_add_ps(r2, r3)));
+			}
+			_mm_storeu_ps(out + f, acc);
+		}
+	}
+#endif
+	for (; f < frames; ++f)
+		out[f] = dot_product(in + f * channels, gains, channels);
+}
+
+// round to nearest, saturate
+static inline void float_to_s16(const float* in, int16_t* out, uint32_t n) {
+	uint32_t i = 0;
+#if defined(__SSE2__)
+	for (; i + 8 <= n; i += 8) {
+		__m128i lo = _mm_cvtps_epi32(_mm_loadu_ps(in + i));
+		__m128i hi = _mm_cvtps_epi32(_mm_loadu_ps(in + i + 4));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+				_mm_packs_epi32(lo, hi));
+	}
+#elif defined(VOICE_SIMD_NEON)
+	const uint32x4_t sign = vdupq_n_u32(0x80000000);
+	const uint32x4_t half = vreinterpretq_u32_f32(vdupq_n_f32(0.5f));
+	for (; i + 8 <= n; i += 8) {
+		float32x4_t a = vld1q_f32(in + i);
+		float32x4_t b = vld1q_f32(in + i + 4);
+		// add copysign(0.5, v), conversion truncates toward zero
+		a = vaddq_f32(a, vreinterpretq_f32_u32(vorrq_u32(half,
+						vandq_u32(vreinterpretq_u32_f32(a), sign))));
+		b = vaddq_f32(b, vreinterpretq_f32_u32(vorrq_u32(half,
+						vandq_u32(vreinterpretq_u32_f32(b), sign))));
+		vst1q_s16(out + i, vcombine_s16(vqmovn_s32(vcvtq_s32_f32(a)),
+					vqmovn_s32(vcvtq_s32_f32(b))));
+	}
+#endif
+	for (; i < n; ++i)
+		out[i] = saturate_s16(in[i]);
+}
+
+static inline float sum_float(const float* in, uint32_t n) {
+	uint32_t i = 0;
+	float r = 0.0f;
+#if defined(__SSE2__)
+	__m128 acc = _mm_setzero_ps();
+	for (; i + 4 <= n; i += 4)
+		acc = _mm_add_ps(acc, _mm_loadu_ps(in + i));
+	acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+	acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 0x55));
+	r = _mm_cvtss_f32(acc);
+#elif defined(VOICE_SIMD_NEON)
+	float32x4_t acc = vdupq_n_f32(0.0f);
+	for (; i + 4 <= n; i += 4)
+		acc = vaddq_f32(acc, vld1q_f32(in + i));
+	float32x2_t s = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+	r = vget_lane_f32(vpadd_f32(s, s), 0);
+#endif
+	for (; i < n; ++i)
+		r += in[i];
+	return r;
+}
+
+// in place, x[i] -= start + step * (i + 1)
+static inline void sub_ramp(float* x, uint32_t n, float start, float step) {
+	uint32_t i = 0;
+#if defined(__SSE2__)
+	__m128 v = _mm_setr_ps(start + step, start + step * 2,
+			start + step * 3, start + step * 4);
+	__m128 d = _mm_set1_ps(step * 4);
+	for (; i + 4 <= n; i += 4) {
+		_mm_storeu_ps(x + i, _mm_sub_ps(_mm_loadu_ps(x + i), v));
+		v = _mm_add_ps(v, d);
+	}
+#elif defined(VOICE_SIMD_NEON)
+	float r[4] = { start + step, start + step * 2, start + step * 3,
+		start + step * 4 };
+	float32x4_t v = vld1q_f32(r);
+	float32x4_t d = vdupq_n_f32(step * 4);
+	for (; i + 4 <= n; i += 4) {
+		vst1q_f32(x + i, vsubq_f32(vld1q_f32(x + i), v));
+		v = vaddq_f32(v, d);
+	}
+#endif
+	for (; i < n; ++i)
+		x[i] -= start + step * (i + 1);
+}
+
+// 2阶IIR(转置直接II型), 原地处理
+//   'c' b0 b1 b2 a1 a2, 'st' 状态s1 s2
+//   向量化实现每次计算4个输出:
+//   y[0..3] = sum(m[j] * x[j]) + m[4] * s1 + m[5] * s2
+//   'm' 6列, 每列4个系数, 由biquad_block_matrix生成
+static inline void biquad_block_matrix(const float* c, float* m) {
+	double y[4];
+	double s1;
+	double s2;
+	double in;
+	uint32_t col;
+	uint32_t k;
+	// response of unit x[col] or unit state, others zero
+	for (col = 0; col < 6; ++col) {
+		s1 = col == 4 ? 1.0 : 0.0;
+		s2 = col == 5 ? 1.0 : 0.0;
+		for (k = 0; k < 4; ++k) {
+			in = k == col ? 1.0 : 0.0;
+			y[k] = c[0] * in + s1;
+			s1 = c[1] * in - c[3] * y[k] + s2;
+			s2 = c[2] * in - c[4] * y[k];
+			m[col * 4 + k] = static_cast<float>(y[k]);
+		}
+	}
+}
+
+static inline void biquad(float* x, uint32_t n, const float* c,
+		const float* m, float* st) {
+	uint32_t i = 0;
+	float s1 = st[0];
+	float s2 = st[1];
+	float y;
+#if defined(__SSE2__) || defined(VOICE_SIMD_NEON)
+	float s2n;
+	for (; i + 4 <= n; i += 4) {
+		float* p = x + i;
+#if defined(__SSE2__)
+		__m128 v = _mm_mul_ps(_mm_loadu_ps(m + 16), _mm_set1_ps(s1));
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(m + 20), _mm_set1_ps(s2)));
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(m), _mm_set1_ps(p[0])));
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_set1_ps(p[1])));
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(m + 8), _mm_set1_ps(p[2])));
+		v = _mm_add_ps(v, _mm_mul_ps(_mm_loadu_ps(m + 12), _mm_set1_ps(p[3])));
+#else
+		float32x4_t v = vmulq_n_f32(vld1q_f32(m + 16), s1);
+		v = vmlaq_n_f32(v, vld1q_f32(m + 20), s2);
+		v = vmlaq_n_f32(v, vld1q_f32(m), p[0]);
+		v = vmlaq_n_f32(v, vld1q_f32(m + 4), p[1]);
+		v = vmlaq_n_f32(v, vld1q_f32(m + 8), p[2]);
+		v = vmlaq_n_f32(v, vld1q_f32(m + 12), p[3]);
+#endif
+		// state after last 2 samples
+		s2n = c[2] * p[2];
+		s1 = c[1] * p[3];
+		s2 = c[2] * p[3];
+#if defined(__SSE2__)
+		_mm_storeu_ps(p, v);
+#else
+		vst1q_f32(p, v);
+#endif
+		s2n -= c[4] * p[2];
+		s1 += s2n - c[3] * p[3];
+		s2 -= c[4] * p[3];
+	}
+#endif
+	for (; i < n; ++i) {
+		y = c[0] * x[i] + s1;
+		s1 = c[1] * x[i] - c[3] * y + s2;
+		s2 = c[2] * x[i] - c[4] * y;
+		x[i] = y;
+	}
+	st[0] = s1;
+	st[1] = s2;
+}
+
+// 16 bit lane counters, flush before overflow
+#define SIGNAL_STATS_BLOCK (8 * 4096)
+
+// int16 signal statistics, accumulated to 'sum_sq' 'peak' 'clipped'
+//   peak: max absolute value
+//   clipped: samples reach int16 limits
+static inline void signal_stats_s16(const int16_t* in, uint32_t n,
+		uint64_t& sum_sq, uint32_t& peak, uint32_t& clipped) {
+	uint32_t i = 0;
+	uint32_t end;
+	int32_t vmax = 0;
+	int32_t vmin = 0;
+	int32_t s;
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i hi = _mm_set1_epi16(32767);
+	const __m128i lo = _mm_set1_epi16(-32768);
+	// 2 x uint64
+	__m128i acc = zero;
+	__m128i mx = zero;
+	__m128i mn = zero;
+	uint32_t t[4];
+	uint64_t t64[2];
+	int16_t m16[8];
+	while (i + 8 <= n) {
+		__m128i cnt = zero;
+		end = n - i > SIGNAL_STATS_BLOCK ? i + SIGNAL_STATS_BLOCK : n;
+		for (; i + 8 <= end; i += 8) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			// sum of 2 squares not exceeds 2^31, regarded as uint32
+			__m128i sq = _mm_madd_epi16(v, v);
+			acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(sq, zero));
+			acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(sq, zero));
+			mx = _mm_max_epi16(mx, v);
+			mn = _mm_min_epi16(mn, v);
+			cnt = _mm_sub_epi16(cnt, _mm_or_si128(_mm_cmpeq_epi16(v, hi),
+						_mm_cmpeq_epi16(v, lo)));
+		}
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(t),
+				_mm_madd_epi16(cnt, _mm_set1_epi16(1)));
+		clipped += t[0] + t[1] + t[2] + t[3];
+	}
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(t64), acc);
+	sum_sq += t64[0] + t64[1];
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(m16), mx);
+	for (s = 0; s < 8; ++s)
+		vmax = m16[s] > vmax ? m16[s] : vmax;
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(m16), mn);
+	for (s = 0; s < 8; ++s)
+		vmin = m16[s] < vmin ? m16[s] : vmin;
+#elif defined(VOICE_SIMD_NEON)
+	const int16x8_t hi = vdupq_n_s16(32767);
+	const int16x8_t lo = vdupq_n_s16(-32768);
+	uint64x2_t acc = vdupq_n_u64(0);
+	int16x8_t mx = vdupq_n_s16(0);
+	int16x8_t mn = vdupq_n_s16(0);
+	int16_t m16[8];
+	while (i + 8 <= n) {
+		uint16x8_t cnt = vdupq_n_u16(0);
+		end = n - i > SIGNAL_STATS_BLOCK ? i + SIGNAL_STATS_BLOCK : n;
+		for (; i + 8 <= end; i += 8) {
+			int16x8_t v = vld1q_s16(in + i);
+			int16x4_t l = vget_low_s16(v);
+			int16x4_t h = vget_high_s16(v);
+			acc = vpadalq_u32(acc, vreinterpretq_u32_s32(vmull_s16(l, l)));
+			acc = vpadalq_u32(acc, vreinterpretq_u32_s32(vmull_s16(h, h)));
+			mx = vmaxq_s16(mx, v);
+			mn = vminq_s16(mn, v);
+			cnt = vsubq_u16(cnt, vorrq_u16(vceqq_s16(v, hi), vceqq_s16(v, lo)));
+		}
+		uint64x2_t c = vpaddlq_u32(vpaddlq_u16(cnt));
+		clipped += vgetq_lane_u64(c, 0) + vgetq_lane_u64(c, 1);
+	}
+	sum_sq += vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+	vst1q_s16(m16, mx);
+	for (s = 0; s < 8; ++s)
+		vmax = m16[s] > vmax ? m16[s] : vmax;
+	vst1q_s16(m16, mn);
+	for (s = 0; s < 8; ++s)
+		vmin = m16[s] < vmin ? m16[s] : vmin;
+#endif
+	for (; i < n; ++i) {
+		s = in[i];
+		sum_sq += static_cast<uint64_t>(s * s);
+		vmax = s > vmax ? s : vmax;
+		vmin = s < vmin ? s : vmin;
+		if (s == 32767 || s == -32768)
+			++clipped;
+	}
+	s = vmax > -vmin ? vmax : -vmin;
+	if (static_cast<uint32_t>(s) > peak)
+		peak = s;
+}
+
+} // namespace speech
+} // namespace rokid
@@ -0,0 +1,132 @@
+#include <math.h>
+#include "speech.h"
+#include "voice_simd.h"
+#include "voice_frontend.h"
+
+// samples per dc estimation, 10ms
+#define DC_BLOCK_SAMPLES 160
+
+using std::shared_ptr;
+using std::make_shared;
+
+namespace rokid {
+namespace speech {
+
+// 分块估计直流分量(一阶平滑), 块内线性插值后减去
+class DcRemovalStage : public VoiceStage {
+public:
+  DcRemovalStage(uint32_t time_constant) : dc_(0.0f), primed_(false) {
+    double tc = time_constant ? time_constant : 1;
+    alpha_ = 1.0 - exp(-DC_BLOCK_SAMPLES * 1000.0
+        / (tc * VOICE_SAMPLE_RATE));
+  }
+
+  const char* name() const {
+    return "dc_removal";
+  }
+
+  void reset() {
+    dc_ = 0.0f;
+    primed_ = false;
+  }
+
+  void process(float* samples, uint32_t count) {
+    uint32_t k;
+    float mean;
+    float dc;
+    while (count) {
+      k = count < DC_BLOCK_SAMPLES ? count : DC_BLOCK_SAMPLES;
+      mean = sum_float(samples, k) / k;
+      if (!primed_) {
+        dc_ = mean;
+        primed_ = true;
+      }
+      // short block moves estimation less
+      dc = dc_ + (mean - dc_) * alpha_ * k / DC_BLOCK_SAMPLES;
+      sub_ramp(samples, k, dc_, (dc - dc_) / k);
+      dc_ = dc;
+      samples += k;
+      count -= k;
+    }
+  }
+
+private:
+  float dc_;
+  float alpha_;
+  bool primed_;
+};
+
+// 2阶巴特沃斯高通, 系数见RBJ audio EQ cookbook
+class HighPassStage : public VoiceStage {
+public:
+  HighPassStage(float cutoff) {
+    double w0;
+    double cw;
+    double alpha;
+    double a0;
+    if (cutoff <= 0.0f || cutoff >= VOICE_SAMPLE_RATE / 2)
+      cutoff = 80.0f;
+    w0 = 2.0 * M_PI * cutoff / VOICE_SAMPLE_RATE;
+    cw = cos(w0);
+    alpha = sin(w0) / (2.0 * M_SQRT1_2);
+    a0 = 1.0 + alpha;
+    coeffs_[0] = (1.0 + cw) / 2.0 / a0;
+    coeffs_[1] = -(1.0 + cw) / a0;
+    coeffs_[2] = coeffs_[0];
+    coeffs_[3] = -2.0 * cw / a0;
+    coeffs_[4] = (1.0 - alpha) / a0;
+    biquad_block_matrix(coeffs_, matrix_);
+    reset();
+  }
+
+  const char* name() const {
+    return "high_pass";
+  }
+
+  void reset() {
+    state_[0] = 0.0f;
+    state_[1] = 0.0f;
+  }
+
+  void process(float* samples, uint32_t count) {
+    biquad(samples, count, coeffs_, matrix_, state_);
+  }
+
+private:
+  // b0 b1 b2 a1 a2
+  float coeffs_[5];
+  float matrix_[24];
+  float state_[2];
+};
+
+class GainStage : public VoiceStage {
+public:
+  GainStage(float db) : gain_(powf(10.0f, db / 20.0f)) {
+  }
+
+  const char* name() const {
+    return "gain";
+  }
+
+  void process(float* samples, uint32_t count) {
+    scale_float(samples, samples, count, gain_);
+  }
+
+private:
+  float gain_;
+};
+
+shared_ptr<VoiceStage> VoiceStage::new_dc_removal(uint32_t time_constant) {
+  return make_shared<DcRemovalStage>(time_constant);
+}
+
+shared_ptr<VoiceStage> VoiceStage::new_high_pass(float cutoff) {
+  return make_shared<HighPassStage>(cutoff);
+}
+
+shared_ptr<VoiceStage> VoiceStage::new_gain(float db) {
+  return make_shared<GainStage>(db);
+}
+
+} // namespace speech
+} // namespace rokid
@@ -56,7 +56,8 @@ private:
 	uint32_t _mask;
 };
 
-TtsImpl::TtsImpl() : initialized_(false) {
+TtsImpl::TtsImpl() : next_id_(0),
+		options_(make_shared<TtsOptionsHolder>()), initialized_(false) {
 #ifdef SPEECH_STATISTIC
 	cur_trace_info_.id = 0;
 #endif
@@ -70,7 +71,7 @@ bool TtsImpl::prepare(const PrepareOptions& options) {
 	lock_guard<mutex> locker(req_mutex_);
 	if (initialized_)
 		return true;
-	next_id_ = 0;
+	next_id_.store(0, std::memory_order_relaxed);
 	connection_.initialize(SOCKET_BUF_SIZE, options, "tts");
 	initialized_ = true;
 	req_thread_ = new thread([=] { send_reqs(); });
@@ -109,6 +110,7 @@ int32_t TtsImpl::speak(const char* text) {
 	shared_ptr<TtsReqInfo> req(new TtsReqInfo());
 	req->data = text;
 	req->deleted = false;
+	req->options = std::atomic_load(&options_);
 	lock_guard<mutex> locker(req_mutex_);
 	int32_t id = next_id();
 	req->id = id;
@@ -146,13 +148,27 @@ void TtsImpl::config(const shared_ptr<TtsOptions>& options) {
 		return;
 	shared_ptr<TtsOptionsModifier> mod =
 		static_pointer_cast<TtsOptionsModifier>(options);
-	mod->modify(options_);
+	lock_guard<mutex> locker(config_mutex_);
+	shared_ptr<TtsOptionsHolder> opts =
+		make_shared<TtsOptionsHolder>(*options_);
+	mod->modify(*opts);
+	// requests already queued keep previous snapshot
+	std::atomic_store(&options_, shared_ptr<const TtsOptionsHolder>(opts));
+}
+
+void TtsImpl::set_voice_sink(const shared_ptr<TtsVoiceSink>& sink) {
+	lock_guard<mutex> locker(resp_mutex_);
+	voice_sink_ = sink;
 }
 
 void TtsImpl::reconn() {
 	connection_.reconn();
 }
 
+void TtsImpl::get_connection_stats(ConnectionStats& stats) {
+	connection_.get_stats(stats);
+}
+
 static TtsResultType poptype_to_restype(int32_t type) {
 	static TtsResultType _tps[] = {
 		TTS_RES_VOICE,
@@ -284,14 +300,32 @@ TtsStatus TtsImpl::do_ctl_new_op(shared_ptr<TtsReqInfo>& req) {
 	if (req->deleted) {
 		KLOGV(tag__, "do_ctl_new_op: cancelled");
 		controller_.new_op(req->id, TtsStatus::CANCELLED);
+		drop_unpolled_ops();
 		resp_cond_.notify_one();
 		return TtsStatus::CANCELLED;
 	}
 	KLOGV(tag__, "do_ctl_new_op: start");
 	controller_.new_op(req->id, TtsStatus::START);
+	drop_unpolled_ops();
 	return TtsStatus::START;
 }
 
+void TtsImpl::drop_unpolled_ops() {
+	shared_ptr<TtsOperationController::Operation> op;
+	shared_ptr<TtsResultIn> resin;
+	int32_t id;
+	uint32_t err;
+
+	while (controller_.over_limit()) {
+		op = controller_.front_op();
+		// as 'poll' does for cancelled op
+		if (responses_.erase(op->id))
+			responses_.pop(id, resin, err);
+		KLOGW(tag__, "tts %d results not polled, dropped", op->id);
+		controller_.drop_front_op();
+	}
+}
+
 static const char* get_codec_str(Codec codec) {
 	switch (codec) {
 	case Codec::PCM:
@@ -307,15 +341,16 @@ static const char* get_codec_str(Codec codec) {
 }
 
 bool TtsImpl::do_request(shared_ptr<TtsReqInfo>& req) {
+	const TtsOptionsHolder& opts = *req->options;
 	KLOGI(tag__, "do_request: send req to server. (%d:%s), codec(%s), declaimer(%s), samplerate(%u)",
-			req->id, req->data.c_str(), get_codec_str(options_.codec),
-			options_.declaimer.c_str(), options_.samplerate);
+			req->id, req->data.c_str(), get_codec_str(opts.codec),
+			opts.declaimer.c_str(), opts.samplerate);
 	TtsRequest treq;
 	treq.set_id(req->id);
 	treq.set_text(req->data.c_str());
-	treq.set_declaimer(options_.declaimer);
-	treq.set_codec(get_codec_str(options_.codec));
-	treq.set_sample_rate(options_.samplerate);
+	treq.set_declaimer(opts.declaimer);
+	treq.set_codec(get_codec_str(opts.codec));
+	treq.set_sample_rate(opts.samplerate);
 #ifdef SPEECH_STATISTIC
 	cur_trace_info_.id = req->id;
 	cur_trace_info_.req_tp = system_clock::now();
@@ -401,7 +436,21 @@ void TtsImpl::gen_result_by_resp(TtsResponse& resp) {
 
 		KLOGV(tag__, "TtsResponse has_voice(%d), finish(%d)",
 				resp.has_voice(), resp.finish());
-		if (resp.has_voice()) {
+		if (resp.has_voice() && voice_sink_.get()) {
+			// write voice data to sink directly, no copy, no allocation
+			voice_sink_->write(resp.id(),
+					reinterpret_cast<const uint8_t*>(resp.voice_data()),
+					resp.voice_length());
+			KLOGV(tag__, "gen_result_by_resp(%d): write voice "
+					"to sink, %u bytes", resp.id(), resp.voice_length());
+			shared_ptr<string> text(resp.release_text());
+			if (text.get()) {
+				shared_ptr<TtsResultIn>resin = make_shared<TtsResultIn>();
+				resin->text = text;
+				responses_.stream(resp.id(), resin);
+				new_data = true;
+			}
+		} else if (resp.has_voice()) {
 			shared_ptr<TtsResultIn>resin;
 
 			resin = make_shared<TtsResultIn>();
@@ -2,6 +2,7 @@
 
 #include <list>
 #include <memory>
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
@@ -51,10 +52,16 @@ public:
 
 	void config(const std::shared_ptr<TtsOptions>& options);
 
+	void set_voice_sink(const std::shared_ptr<TtsVoiceSink>& sink);
+
 	void reconn();
 
+	void get_connection_stats(ConnectionStats& stats);
+
 private:
-	inline int32_t next_id() { return ++next_id_; }
+	inline int32_t next_id() {
+		return next_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+	}
 
 	void send_reqs();
 
@@ -68,13 +75,20 @@ private:
 
 	TtsStatus do_ctl_new_op(std::shared_ptr<TtsReqInfo>& req);
 
+	// drop results of oldest operations not polled beyond limit
+	// must lock 'resp_mutex_' before invoke
+	void drop_unpolled_ops();
+
 #ifdef SPEECH_STATISTIC
 	void finish_cur_req();
 #endif
 
 private:
-	int32_t next_id_;
-	TtsOptionsHolder options_;
+	std::atomic<int32_t> next_id_;
+	// immutable snapshot, replaced as a whole by 'config'
+	// read by std::atomic_load, writers serialized by 'config_mutex_'
+	std::shared_ptr<const TtsOptionsHolder> options_;
+	std::mutex config_mutex_;
 	SpeechConnection connection_;
 	std::list<std::shared_ptr<TtsReqInfo> > requests_;
 	TtsStreamQueue responses_;
@@ -83,6 +97,8 @@ private:
 	std::mutex resp_mutex_;
 	std::condition_variable resp_cond_;
 	TtsOperationController controller_;
+	// protected by 'resp_mutex_'
+	std::shared_ptr<TtsVoiceSink> voice_sink_;
 	std::thread* req_thread_;
 	std::thread* resp_thread_;
 	bool initialized_;
@@ -0,0 +1,108 @@
+#include <string.h>
+#include <atomic>
+#include "tts.h"
+
+namespace rokid {
+namespace speech {
+
+using std::shared_ptr;
+using std::make_shared;
+using std::atomic;
+using std::memory_order_relaxed;
+using std::memory_order_acquire;
+using std::memory_order_release;
+
+// single producer (sdk recv thread), single consumer (app thread)
+// 'wpos_' only modified by producer, 'rpos_' only modified by consumer
+// positions increase monotonically, index = pos & mask_
+class TtsVoiceRingImpl : public TtsVoiceRing {
+public:
+	TtsVoiceRingImpl(uint32_t cap) : wpos_(0), rpos_(0), dropped_(0) {
+		uint32_t c = 1;
+		while (c < cap && c < 0x80000000)
+			c <<= 1;
+		capacity_ = c;
+		mask_ = c - 1;
+		buffer_ = new uint8_t[c];
+	}
+
+	~TtsVoiceRingImpl() {
+		delete[] buffer_;
+	}
+
+	void write(int32_t id, const uint8_t* data, uint32_t length) {
+		uint32_t w = wpos_.load(memory_order_relaxed);
+		uint32_t r = rpos_.load(memory_order_acquire);
+		uint32_t space = capacity_ - (w - r);
+		if (length == 0)
+			return;
+		// 整块丢弃, 不留下截断的编码帧或半个pcm采样
+		if (length > space) {
+			dropped_.fetch_add(length, memory_order_relaxed);
+			return;
+		}
+		copy_in(w & mask_, data, length);
+		wpos_.store(w + length, memory_order_release);
+	}
+
+	uint32_t read(uint8_t* buf, uint32_t size) {
+		uint32_t r = rpos_.load(memory_order_relaxed);
+		uint32_t w = wpos_.load(memory_order_acquire);
+		uint32_t avail = w - r;
+		if (size > avail)
+			size = avail;
+		if (size == 0)
+			return 0;
+		copy_out(r & mask_, buf, size);
+		rpos_.store(r + size, memory_order_release);
+		return size;
+	}
+
+	uint32_t available() const {
+		return wpos_.load(memory_order_acquire) - rpos_.load(memory_order_acquire);
+	}
+
+	uint32_t capacity() const {
+		return capacity_;
+	}
+
+	uint64_t dropped() const {
+		return dropped_.load(memory_order_relaxed);
+	}
+
+private:
+	void copy_in(uint32_t idx, const uint8_t* data, uint32_t length) {
+		uint32_t first = capacity_ - idx;
+		if (first > length)
+			first = length;
+		memcpy(buffer_ + idx, data, first);
+		if (length > first)
+			memcpy(buffer_, data + first, length - first);
+	}
+
+	void copy_out(uint32_t idx, uint8_t* buf, uint32_t size) {
+		uint32_t first = capacity_ - idx;
+		if (first > size)
+			first = size;
+		memcpy(buf, buffer_ + idx, first);
+		if (size > first)
+			memcpy(buf + first, buffer_, size - first);
+	}
+
+private:
+	uint8_t* buffer_;
+	uint32_t capacity_;
+	uint32_t mask_;
+	atomic<uint32_t> wpos_;
+	atomic<uint32_t> rpos_;
+	atomic<uint64_t> dropped_;
+};
+
+shared_ptr<TtsVoiceRing> TtsVoiceRing::new_instance(uint32_t capacity) {
+	if (capacity == 0)
+		return NULL;
+	return make_shared<TtsVoiceRingImpl>(capacity);
+}
+
+} // namespace speech
+} // namespace rokid
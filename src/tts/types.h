@@ -1,12 +1,15 @@
 #pragma once
 
 #include <string>
+#include <memory>
 
 namespace rokid {
 namespace speech {
 
 #define SOCKET_BUF_SIZE 0x40000
 
+class TtsOptionsHolder;
+
 typedef struct {
 	std::shared_ptr<std::string> voice;
 	std::shared_ptr<std::string> text;
@@ -16,6 +19,8 @@ typedef struct {
 	int32_t id;
 	bool deleted;
 	std::string data;
+	// TtsOptions snapshot when speak invoked
+	std::shared_ptr<const TtsOptionsHolder> options;
 } TtsReqInfo;
 
 /**